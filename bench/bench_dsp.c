@@ -0,0 +1,325 @@
+// Microbenchmarks of the DSP kernels, to back up (or catch regressions in) any change to them
+// Times the sample conversion, each FFT engine, nyquist_filter and set_magnitude at sizes from 64 to 65536 samples
+// Each kernel/size is warmed up, then timed over repeated trials on a pinned CPU, the median trial is reported
+// Usage: bench [-c cpu] [-s min size] [-S max size] [-o results.json]
+//
+// GFLOPS are nominal, 5N*log2(N) for an FFT and 8N^2 for a DFT, so they're comparable between algorithms
+// Each engine's speedup is against dft at the same size, where dft was timed
+// Build with BENCH_FLAGS set to the compiler flags (see the Makefile), they're printed with the results
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <shared.h>
+#include <processing.h>
+#include <log.h>
+
+#define BENCH_MIN_SIZE 64
+#define BENCH_MAX_SIZE 65536
+#define BENCH_TRIALS 7
+#define BENCH_WARMUP_NS 50000000
+#define BENCH_TRIAL_NS 40000000
+// Once a single op of a kernel takes longer than this, larger sizes are skipped (dft is O(N^2))
+#define BENCH_MAX_OP_NS 1000000000
+#define BENCH_DEFAULT_OUTPUT "bench.json"
+#define BENCH_TIMER_SAMPLES 1001
+#ifndef BENCH_FLAGS
+#define BENCH_FLAGS "unknown"
+#endif
+
+typedef struct bench_data {
+	int size;
+	int16_t* samples;
+	complex_set_t* input;
+	complex_set_t* output;
+	// output as it was set up, for kernels that change it in place
+	complex_set_t* pristine;
+} bench_data_t;
+
+typedef struct bench_kernel {
+	const char* name;
+	void (*run)(bench_data_t* data);
+	// Nominal floating point operations per op, 0 if it isn't meaningful
+	double (*flops)(int size);
+	// Run before each op outside the timing, NULL if the ops can repeat on the same data
+	void (*setup)(bench_data_t* data);
+} bench_kernel_t;
+
+typedef struct bench_result {
+	const char* kernel;
+	int size;
+	unsigned long ops;
+	double ns_per_op;
+	double ns_per_sample;
+	double gflops;
+	// dft's ns/op over this one's, 0 if it isn't an engine or dft wasn't timed at this size
+	double speedup;
+} bench_result_t;
+
+// Into a set allocated up front, as analysis.c does, so the conversion is timed rather than malloc and free
+static void run_convert(bench_data_t* data) {
+	fill_complex_set(data -> input, data -> samples, data -> size);
+}
+
+static void run_dft(bench_data_t* data) {
+	dft(data -> input, data -> output);
+}
+
+static void run_ct_fft(bench_data_t* data) {
+	ct_fft(data -> input, data -> output);
+}
+
+static void run_iterative_fft(bench_data_t* data) {
+	iterative_fft(data -> input, data -> output);
+}
+
+static void run_nyquist_filter(bench_data_t* data) {
+	nyquist_filter(data -> output);
+}
+
+// The filter doubles the values and halves data_size in place, so each op starts from the original
+static void restore_output(bench_data_t* data) {
+	memcpy(data -> output -> complex_numbers, data -> pristine -> complex_numbers, sizeof(complex_wrapper_t) * data -> size);
+	data -> output -> data_size = data -> size;
+}
+
+static void run_set_magnitude(bench_data_t* data) {
+	set_magnitude(data -> input, data -> size);
+}
+
+static double fft_flops(int size) {
+	return 5.0 * size * log2(size);
+}
+
+static double dft_flops(int size) {
+	return 8.0 * size * (double) size;
+}
+
+static const bench_kernel_t KERNELS[] = {
+	{"convert", run_convert, NULL, NULL},
+	{"dft", run_dft, dft_flops, NULL},
+	{"ct_fft", run_ct_fft, fft_flops, NULL},
+	{"iterative_fft", run_iterative_fft, fft_flops, NULL},
+	{"nyquist_filter", run_nyquist_filter, NULL, restore_output},
+	{"set_magnitude", run_set_magnitude, NULL, NULL}
+};
+static const int KERNEL_COUNT = sizeof(KERNELS) / sizeof(bench_kernel_t);
+
+// Two tones and some noise, so nothing is trivially zero
+static void init_bench_data(bench_data_t* data, int size) {
+	data -> size = size;
+	data -> samples = malloc(sizeof(int16_t) * size);
+	malloc_complex_set(&data -> input, size, MAX_SAMPLE_RATE);
+	malloc_complex_set(&data -> output, size, MAX_SAMPLE_RATE);
+	malloc_complex_set(&data -> pristine, size, MAX_SAMPLE_RATE);
+	srand(size);
+	for (int i=0; i < size; i++) {
+		double t = (double) i / MAX_SAMPLE_RATE;
+		data -> samples[i] = (int16_t) (8000 * sin(2 * M_PI * 440 * t) + 4000 * sin(2 * M_PI * 5000 * t) + (rand() % 512) - 256);
+		data -> input -> complex_numbers[i].complex_number = CMPLX(data -> samples[i], 0.0);
+		data -> output -> complex_numbers[i].complex_number = CMPLX(data -> samples[i], 0.0);
+	}
+	memcpy(data -> pristine -> complex_numbers, data -> output -> complex_numbers, sizeof(complex_wrapper_t) * size);
+}
+
+static void free_bench_data(bench_data_t* data) {
+	free(data -> samples);
+	free_complex_set(data -> input);
+	free_complex_set(data -> output);
+	free_complex_set(data -> pristine);
+}
+
+static int compare_doubles(const void* a, const void* b) {
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+// What reading the clock costs, taken off ops that have to be timed one at a time
+static double timer_overhead_ns = 0;
+
+// The median gap between back to back clock reads
+static double measure_timer_overhead() {
+	double gaps[BENCH_TIMER_SAMPLES];
+	for (int i=0; i < BENCH_TIMER_SAMPLES; i++) {
+		uint64_t start_ns = get_monotonic_ns();
+		gaps[i] = get_monotonic_ns() - start_ns;
+	}
+	qsort(gaps, BENCH_TIMER_SAMPLES, sizeof(double), compare_doubles);
+	return gaps[BENCH_TIMER_SAMPLES / 2];
+}
+
+// Runs ops of the kernel, returning how long they took
+// Kernels with a setup are timed an op at a time, so the setup isn't counted
+static uint64_t run_ops(const bench_kernel_t* kernel, bench_data_t* data, unsigned long ops) {
+	uint64_t elapsed_ns = 0;
+	if (kernel -> setup == NULL) {
+		uint64_t start_ns = get_monotonic_ns();
+		for (unsigned long i=0; i < ops; i++) kernel -> run(data);
+		return get_monotonic_ns() - start_ns;
+	}
+	for (unsigned long i=0; i < ops; i++) {
+		kernel -> setup(data);
+		uint64_t start_ns = get_monotonic_ns();
+		kernel -> run(data);
+		uint64_t op_ns = get_monotonic_ns() - start_ns;
+		elapsed_ns += op_ns > timer_overhead_ns ? op_ns - timer_overhead_ns : 0;
+	}
+	return elapsed_ns;
+}
+
+// Runs the kernel for at least min_ns (and at least once)
+// Returns how many ops were run, elapsed_ns is set to how long they took
+static unsigned long run_for(const bench_kernel_t* kernel, bench_data_t* data, uint64_t min_ns, uint64_t* elapsed_ns) {
+	unsigned long ops = 0;
+	*elapsed_ns = 0;
+	// Stops on the wall clock, setups and all, in case the ops alone barely register
+	uint64_t start_ns = get_monotonic_ns();
+	do {
+		*elapsed_ns += run_ops(kernel, data, 1);
+		ops++;
+	} while (get_monotonic_ns() - start_ns < min_ns);
+	return ops;
+}
+
+// Times a fixed number of ops, sized from the warm-up to take about BENCH_TRIAL_NS
+static double time_trial(const bench_kernel_t* kernel, bench_data_t* data, unsigned long ops) {
+	return (double) run_ops(kernel, data, ops) / ops;
+}
+
+static bench_result_t bench_kernel(const bench_kernel_t* kernel, int size) {
+	bench_data_t data;
+	init_bench_data(&data, size);
+	uint64_t warmup_ns = 0;
+	unsigned long warmup_ops = run_for(kernel, &data, BENCH_WARMUP_NS, &warmup_ns);
+	double warmup_op_ns = (double) warmup_ns / warmup_ops;
+
+	unsigned long trial_ops = warmup_op_ns > 0 ? BENCH_TRIAL_NS / warmup_op_ns : 1;
+	if (trial_ops < 1) trial_ops = 1;
+	// A single op that's already slow is its own trial, rather than repeating it for minutes
+	int trials = warmup_op_ns * trial_ops > BENCH_MAX_OP_NS / 10 ? 1 : BENCH_TRIALS;
+	double trial_ns[BENCH_TRIALS];
+	for (int i=0; i < trials; i++) trial_ns[i] = time_trial(kernel, &data, trial_ops);
+	qsort(trial_ns, trials, sizeof(double), compare_doubles);
+	free_bench_data(&data);
+
+	bench_result_t result;
+	result.kernel = kernel -> name;
+	result.size = size;
+	result.ops = warmup_ops + (trial_ops * trials);
+	result.ns_per_op = trial_ns[trials / 2];
+	result.ns_per_sample = result.ns_per_op / size;
+	result.gflops = kernel -> flops != NULL ? kernel -> flops(size) / result.ns_per_op : 0;
+	result.speedup = 0;
+	return result;
+}
+
+// Keeps us on the one CPU, so migrations don't show up in the timings
+// Returns 0 on success, 1 on failure
+static int pin_cpu(int cpu) {
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	return sched_setaffinity(0, sizeof(cpus), &cpus) == 0 ? 0 : 1;
+}
+
+// How many powers of 2 there are from min_size up to max_size, the sizes each kernel is timed at
+static int count_sizes(int min_size, int max_size) {
+	int sizes = 0;
+	for (long size=min_size; size <= max_size; size *= 2) sizes++;
+	return sizes;
+}
+
+// Returns the earlier result for the kernel at this size, or NULL if it wasn't timed
+static const bench_result_t* find_result(bench_result_t* results, int count, const char* kernel, int size) {
+	for (int i=0; i < count; i++) {
+		if (results[i].size == size && strcmp(results[i].kernel, kernel) == 0) return &results[i];
+	}
+	return NULL;
+}
+
+static int write_json(const char* path, bench_result_t* results, int count, int cpu) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) return 1;
+	fprintf(file, "{\"timestamp_ns\":%lu,\"cpu\":%d,\"flags\":\"%s\",\"results\":[\n", (unsigned long) get_realtime_ns(), cpu, BENCH_FLAGS);
+	for (int i=0; i < count; i++) {
+		bench_result_t* result = &results[i];
+		fprintf(file, "{\"kernel\":\"%s\",\"size\":%d,\"ops\":%lu,\"ns_per_op\":%.1f,\"ns_per_sample\":%.3f,\"gflops\":%.4f,\"speedup\":%.2f}%s\n",
+			result -> kernel, result -> size, result -> ops, result -> ns_per_op, result -> ns_per_sample, result -> gflops, result -> speedup, i + 1 < count ? "," : "");
+	}
+	fprintf(file, "]}\n");
+	return fclose(file) == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+	int cpu = sched_getcpu();
+	int min_size = BENCH_MIN_SIZE;
+	int max_size = BENCH_MAX_SIZE;
+	const char* output_path = BENCH_DEFAULT_OUTPUT;
+	int option;
+	while ((option = getopt(argc, argv, "c:s:S:o:")) != -1) {
+		switch (option) {
+			case 'c': cpu = atoi(optarg); break;
+			case 's': min_size = atoi(optarg); break;
+			case 'S': max_size = atoi(optarg); break;
+			case 'o': output_path = optarg; break;
+			default:
+				fprintf(stderr, "Usage: %s [-c cpu] [-s min size] [-S max size] [-o results.json]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (min_size < 2 || (min_size & (min_size - 1)) != 0) {
+		fprintf(stderr, "The minimum size must be a power of 2\n");
+		return 1;
+	}
+	// Sizes double until they pass the maximum, which mustn't overflow
+	if (max_size < min_size || max_size > (1 << 29)) {
+		fprintf(stderr, "The maximum size must be from the minimum size up to %d\n", 1 << 29);
+		return 1;
+	}
+	set_log_level(LOG_ERROR);
+	if (pin_cpu(cpu) != 0) {
+		fprintf(stderr, "Couldn't pin to CPU %d, timings may be noisier\n", cpu);
+	}
+
+	int max_results = KERNEL_COUNT * count_sizes(min_size, max_size);
+	bench_result_t* results = malloc(sizeof(bench_result_t) * max_results);
+	if (results == NULL) {
+		fprintf(stderr, "Couldn't allocate the results for %d kernel sizes\n", max_results);
+		return 1;
+	}
+	timer_overhead_ns = measure_timer_overhead();
+	int count = 0;
+	printf("Built with: %s\n", BENCH_FLAGS);
+	printf("%-15s %7s %14s %12s %9s %9s\n", "kernel", "size", "ns/op", "ns/sample", "GFLOPS", "speedup");
+	for (int k=0; k < KERNEL_COUNT; k++) {
+		for (int size=min_size; size <= max_size; size *= 2) {
+			bench_result_t result = bench_kernel(&KERNELS[k], size);
+			const bench_result_t* reference = find_result(results, count, "dft", size);
+			if (result.gflops > 0 && reference != NULL) result.speedup = reference -> ns_per_op / result.ns_per_op;
+			results[count++] = result;
+			printf("%-15s %7d %14.1f %12.3f ", result.kernel, result.size, result.ns_per_op, result.ns_per_sample);
+			if (result.gflops > 0) printf("%9.4f ", result.gflops);
+			else printf("%9s ", "-");
+			if (result.speedup > 0) printf("%8.1fx\n", result.speedup);
+			else printf("%9s\n", "-");
+			fflush(stdout);
+			if (result.ns_per_op > BENCH_MAX_OP_NS) {
+				printf("%-15s skipping sizes above %d, a single op takes over %ds\n", result.kernel, size, BENCH_MAX_OP_NS / 1000000000);
+				break;
+			}
+		}
+	}
+
+	int stat = write_json(output_path, results, count, cpu);
+	if (stat != 0) fprintf(stderr, "Failed to write results to: %s\n", output_path);
+	else printf("Results written to: %s\n", output_path);
+	free(results);
+	return stat;
+}
@@ -0,0 +1,62 @@
+// An example consumer of the spectra purses publishes to shared memory
+// Start purses with PURSES_SHM=1 (or a name), then run this with the same name
+// Prints the loudest bin of each spectrum, reading it in place without copying it
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <shm/shm_reader.h>
+
+int main(int argc, char** argv) {
+	const char* name = argc > 1 ? argv[1] : SPECTRUM_SHM_DEFAULT_NAME;
+	shm_reader_t reader;
+	if (open_shm_reader(&reader, name) != 0) {
+		fprintf(stderr, "Couldn't open shared memory: %s, is purses running with PURSES_SHM set?\n", name);
+		return 1;
+	}
+
+	// Poll for new spectra, there's one roughly every 23ms at 44100Hz
+	struct timespec poll_sleep = {0, 5000000};
+	uint64_t next_sequence = shm_latest_sequence(&reader) + 1;
+	unsigned long missed = 0;
+	while (true) {
+		uint64_t latest = shm_latest_sequence(&reader);
+		if (latest < next_sequence) {
+			nanosleep(&poll_sleep, NULL);
+			continue;
+		}
+		// Too far behind, skip to the oldest spectrum still in the ring
+		if (latest - next_sequence >= SPECTRUM_SHM_SLOTS) {
+			uint64_t oldest = latest - SPECTRUM_SHM_SLOTS + 1;
+			missed += oldest - next_sequence;
+			next_sequence = oldest;
+		}
+
+		uint32_t token;
+		const spectrum_shm_slot_t* slot = shm_begin_read(&reader, next_sequence, &token);
+		if (slot != NULL) {
+			uint32_t peak_bin = 0;
+			float peak = 0;
+			uint32_t bin_count = slot -> bin_count < SPECTRUM_SHM_MAX_BINS ? slot -> bin_count : SPECTRUM_SHM_MAX_BINS;
+			for (uint32_t i=1; i < bin_count; i++) {
+				if (slot -> magnitudes[i] > peak) {
+					peak = slot -> magnitudes[i];
+					peak_bin = i;
+				}
+			}
+			int bin_hz = bin_count > 0 ? slot -> sample_rate / (2 * bin_count) : 0;
+			// Only trust what we read if the slot wasn't rewritten under us
+			if (shm_end_read(slot, token)) {
+				printf("%lu: peak %dHz (%.1f), missed %lu\n", (unsigned long) next_sequence, peak_bin * bin_hz, peak, missed);
+			} else {
+				missed++;
+			}
+		} else {
+			missed++;
+		}
+		next_sequence++;
+	}
+
+	close_shm_reader(&reader);
+	return 0;
+}
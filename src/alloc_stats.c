@@ -0,0 +1,83 @@
+#include <malloc.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include <alloc_stats.h>
+
+// Stay at 0 unless the wrappers below are built in
+static _Atomic uint64_t allocations = 0;
+static _Atomic uint64_t frees = 0;
+static _Atomic uint64_t bytes = 0;
+static _Atomic int64_t live_bytes = 0;
+
+#ifdef PURSES_ALLOC_STATS
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+void __real_free(void* pointer);
+int __real_posix_memalign(void** pointer, size_t alignment, size_t size);
+
+// Blocks are measured by their usable size, so frees balance allocations whatever size was asked for
+static void add_live_bytes(void* pointer, int64_t sign) {
+	if (pointer != NULL) atomic_fetch_add_explicit(&live_bytes, sign * (int64_t) malloc_usable_size(pointer), memory_order_relaxed);
+}
+
+void* __wrap_malloc(size_t size) {
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&bytes, size, memory_order_relaxed);
+	void* pointer = __real_malloc(size);
+	add_live_bytes(pointer, 1);
+	return pointer;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&bytes, count * size, memory_order_relaxed);
+	void* pointer = __real_calloc(count, size);
+	add_live_bytes(pointer, 1);
+	return pointer;
+}
+
+// Counted as an allocation, as it usually has to find a new block
+void* __wrap_realloc(void* pointer, size_t size) {
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&bytes, size, memory_order_relaxed);
+	// The old block is released even if it's returned again, then the (possibly moved) block is added back
+	size_t old_size = pointer != NULL ? malloc_usable_size(pointer) : 0;
+	void* resized = __real_realloc(pointer, size);
+	if (resized == NULL && size > 0) return NULL;
+	atomic_fetch_sub_explicit(&live_bytes, (int64_t) old_size, memory_order_relaxed);
+	add_live_bytes(resized, 1);
+	return resized;
+}
+
+int __wrap_posix_memalign(void** pointer, size_t alignment, size_t size) {
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&bytes, size, memory_order_relaxed);
+	int stat = __real_posix_memalign(pointer, alignment, size);
+	if (stat == 0) add_live_bytes(*pointer, 1);
+	return stat;
+}
+
+void __wrap_free(void* pointer) {
+	if (pointer != NULL) atomic_fetch_add_explicit(&frees, 1, memory_order_relaxed);
+	add_live_bytes(pointer, -1);
+	__real_free(pointer);
+}
+
+#endif
+
+bool alloc_stats_enabled() {
+#ifdef PURSES_ALLOC_STATS
+	return true;
+#else
+	return false;
+#endif
+}
+
+void read_alloc_stats(alloc_stats_t* stats) {
+	stats -> allocations = atomic_load_explicit(&allocations, memory_order_relaxed);
+	stats -> frees = atomic_load_explicit(&frees, memory_order_relaxed);
+	stats -> bytes = atomic_load_explicit(&bytes, memory_order_relaxed);
+	stats -> live_bytes = atomic_load_explicit(&live_bytes, memory_order_relaxed);
+}
@@ -0,0 +1,18 @@
+#pragma once
+// Counts our own heap allocations, to find allocations hiding in the per-frame path
+// malloc/calloc/realloc/posix_memalign/free are wrapped at link time (-Wl,--wrap=...), so only calls from our objects are counted
+// Only built in with PURSES_ALLOC_STATS defined (make compile-counted and make test), otherwise every count reads 0
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct alloc_stats {
+	uint64_t allocations;
+	uint64_t frees;
+	uint64_t bytes;
+	// Bytes currently allocated (as malloc_usable_size sees them), to check everything's freed again
+	int64_t live_bytes;
+} alloc_stats_t;
+
+bool alloc_stats_enabled();
+void read_alloc_stats(alloc_stats_t* stats);
@@ -0,0 +1,366 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <analysis.h>
+#include <processing.h>
+#include <log.h>
+#include <trace/trace.h>
+#include <latency.h>
+#include <perf_counters.h>
+
+// Transforms the samples with the engine
+// input_set/output_set - must have space for streamed_data_size values, nothing is allocated per frame
+static void transform_samples(const fft_engine_t* engine, const int16_t* samples, int streamed_data_size, complex_set_t* input_set, complex_set_t* output_set) {
+	uint64_t stage_ns = begin_stage();
+	trace_begin(TRACE_CONVERT);
+	input_set -> sample_rate = MAX_SAMPLE_RATE;
+	fill_complex_set(input_set, samples, streamed_data_size);
+	// The nyquist filter halved data_size last time round
+	output_set -> data_size = streamed_data_size;
+	output_set -> sample_rate = MAX_SAMPLE_RATE;
+	output_set -> frequency = MAX_SAMPLE_RATE;
+	trace_end(TRACE_CONVERT);
+	stage_ns = end_stage(LATENCY_CONVERT, stage_ns);
+	log_trace("=== Recorded Data ===\n");
+	log_data(LOG_TRACE, input_set);
+
+	trace_begin(TRACE_FFT);
+	engine -> transform(input_set, output_set);
+	trace_end(TRACE_FFT);
+	stage_ns = end_stage(LATENCY_FFT, stage_ns);
+	trace_begin(TRACE_MAGNITUDE);
+	nyquist_filter(output_set);
+	set_magnitude(output_set, streamed_data_size);
+	trace_end(TRACE_MAGNITUDE);
+	end_stage(LATENCY_MAGNITUDE, stage_ns);
+	log_trace("=== Result Data ===\n");
+	log_data(LOG_TRACE, output_set);
+}
+
+// Hands a completed spectrum to the reader, and to the outputs
+// The set isn't written again until it's come back round, and the readers only read it
+static void publish_spectrum(analysis_t* analysis, complex_set_t* output_set, uint64_t analysis_ns) {
+	pthread_mutex_lock(&analysis -> lock);
+	publish_triple_buffer(&analysis -> spectra);
+	unsigned long sequence = ++analysis -> sequence;
+	analysis -> analysis_ns = analysis_ns;
+	pthread_cond_broadcast(&analysis -> published);
+	pthread_mutex_unlock(&analysis -> lock);
+	if (analysis -> outputs != NULL) publish_outputs(analysis -> outputs, output_set, sequence);
+}
+
+// Slides the block through the sliding DFT, a spectrum at a time
+// Every hop samples the spectrum is published, if publish is set
+// block_ns - set to the time the whole block took, every hop of it
+// Returns the number of spectra published
+static unsigned long slide_block(analysis_t* analysis, const int16_t* block, int hop, bool publish, uint64_t* block_ns) {
+	unsigned long published = 0;
+	*block_ns = 0;
+	for (int offset=0; offset < NUM_SAMPLES; offset += hop) {
+		int count = NUM_SAMPLES - offset < hop ? NUM_SAMPLES - offset : hop;
+		uint64_t before_ns = begin_stage();
+		trace_begin(TRACE_FFT);
+		slide_dft(&analysis -> sliding, block + offset, count);
+		trace_end(TRACE_FFT);
+		uint64_t stage_ns = end_stage(LATENCY_FFT, before_ns);
+		if (!publish) {
+			*block_ns += stage_ns - before_ns;
+			continue;
+		}
+
+		complex_set_t* output_set = triple_buffer_back(&analysis -> spectra);
+		trace_begin(TRACE_MAGNITUDE);
+		sliding_dft_spectrum(&analysis -> sliding, output_set, MAX_SAMPLE_RATE);
+		trace_end(TRACE_MAGNITUDE);
+		*block_ns += end_stage(LATENCY_MAGNITUDE, stage_ns) - before_ns;
+		// A single hop is a fraction of the cost, so the last full hop's stays up until this one's summed
+		publish_spectrum(analysis, output_set, analysis -> analysis_ns);
+		published++;
+	}
+	return published;
+}
+
+// Switches the thread's sliding DFT on or off to match the engine
+// If it can't be allocated, the engine falls back to the default so it isn't tried again every block
+// Returns true if the sliding DFT is in use
+static bool use_sliding_dft(analysis_t* analysis, bool sliding) {
+	if (sliding && analysis -> sliding.window == NULL && init_sliding_dft(&analysis -> sliding, NUM_SAMPLES) != 0) {
+		log_error("Failed to allocate the sliding DFT, using %s instead\n", DEFAULT_FFT_ENGINE);
+		pthread_mutex_lock(&analysis -> lock);
+		analysis -> engine = find_fft_engine(DEFAULT_FFT_ENGINE);
+		pthread_mutex_unlock(&analysis -> lock);
+		return false;
+	}
+	if (!sliding && analysis -> sliding.window != NULL) free_sliding_dft(&analysis -> sliding);
+	return sliding;
+}
+
+void* analysis_thread(void* userdata) {
+	analysis_t* analysis = userdata;
+	unsigned long int i = 0;
+	unsigned long block_sequence = 0;
+	// Blocks taken since the last transform
+	int hop_count = 0;
+	// Time spent sliding blocks through the sliding DFT since the last one that was published
+	uint64_t sliding_ns = 0;
+	trace_thread(TRACE_THREAD_ANALYSIS);
+	open_thread_perf_counters();
+
+	while (true) {
+		pthread_mutex_lock(&analysis -> lock);
+		bool running = analysis -> running;
+		int fft_size = analysis -> fft_size;
+		int hop_blocks = analysis -> hop_blocks;
+		const fft_engine_t* engine = analysis -> engine;
+		int sliding_hop = analysis -> sliding_hop;
+		pthread_mutex_unlock(&analysis -> lock);
+		if (!running) break;
+		bool sliding = use_sliding_dft(analysis, engine == NULL);
+		if (!sliding) sliding_ns = 0;
+		if (engine == NULL) engine = find_fft_engine(DEFAULT_FFT_ENGINE);
+
+		// Capture carries on with the next block while this one's transformed, any we're too slow for are skipped
+		pa_reconnect_t reconnect;
+		const int16_t* block = NULL;
+		unsigned long last_block = block_sequence;
+		int block_stat = wait_for_block(&analysis -> capture, &block_sequence, &block, &reconnect, ANALYSIS_BLOCK_WAIT_NS);
+		if (block_stat == 0 && block_sequence - last_block > 1) {
+			log_debug("Analysis missed %ld captured blocks\n", block_sequence - last_block - 1);
+		}
+		bool finished = block_stat != 0 && capture_finished(&analysis -> capture);
+		bool idle = analysis -> idle;
+		if (block_stat == 0) idle = update_silence_gate(&analysis -> silence, block, NUM_SAMPLES, get_monotonic_ns());
+		if (idle != analysis -> idle) {
+			if (idle) log_info("Input silent for %dms, pausing analysis\n", analysis -> silence.options.hold_ms);
+			else log_info("Input resumed, analysing again\n");
+			// The window's been silent all along, bar the odd quiet sample
+			if (idle && sliding) reset_sliding_dft(&analysis -> sliding);
+		}
+
+		// Only every hop_blocks'th block is transformed
+		bool due = false;
+		if (block_stat == 0 && !idle && ++hop_count >= hop_blocks) {
+			due = true;
+			hop_count = 0;
+		}
+
+		if (due || (sliding && block_stat == 0 && !idle)) {
+			log_debug("=== Performing analysis frame no: %ld\n", i);
+			trace_frame(i);
+			trace_begin(TRACE_FRAME);
+		}
+		if (sliding && block_stat == 0 && !idle) {
+			// Every block has to go through the window, even those that aren't due to be published
+			uint64_t block_ns;
+			i += slide_block(analysis, block, sliding_hop, due, &block_ns);
+			sliding_ns += block_ns;
+			if (due) {
+				// Every block between transforms is slid, so they're all counted against the budget
+				pthread_mutex_lock(&analysis -> lock);
+				analysis -> analysis_ns = sliding_ns;
+				pthread_mutex_unlock(&analysis -> lock);
+				sliding_ns = 0;
+			}
+			trace_end(TRACE_FRAME);
+		} else if (due) {
+			// Transformed into the back set, which is published once it's complete
+			complex_set_t* output_set = triple_buffer_back(&analysis -> spectra);
+			uint64_t before_ns = get_monotonic_ns();
+			// A smaller FFT takes the newest samples of the block
+			transform_samples(engine, block + NUM_SAMPLES - fft_size, fft_size, analysis -> input, output_set);
+			publish_spectrum(analysis, output_set, get_monotonic_ns() - before_ns);
+			trace_end(TRACE_FRAME);
+			i++;
+		}
+
+		pthread_mutex_lock(&analysis -> lock);
+		analysis -> reconnect = reconnect;
+		if (idle != analysis -> idle) {
+			analysis -> idle = idle;
+			pthread_cond_broadcast(&analysis -> published);
+		}
+		if (finished) {
+			log_info("Analysis finished with the replay after %ld frames\n", i);
+			analysis -> finished = true;
+			pthread_cond_broadcast(&analysis -> published);
+		}
+		pthread_mutex_unlock(&analysis -> lock);
+		if (finished) break;
+
+		// The block isn't written again until it's come back round
+		// Silence is still recorded, only the spectra stop
+		if (block_stat == 0 && analysis -> outputs != NULL) {
+			publish_outputs_pcm(analysis -> outputs, block, NUM_SAMPLES);
+		}
+	}
+
+	use_sliding_dft(analysis, false);
+	free_fft_scratch();
+	close_thread_perf_counters();
+	return NULL;
+}
+
+static void free_analysis_sets(analysis_t* analysis) {
+	free_complex_set(analysis -> input);
+	analysis -> input = NULL;
+	for (int i=0; i < 3; i++) {
+		free_complex_set(analysis -> spectra.buffers[i]);
+		analysis -> spectra.buffers[i] = NULL;
+	}
+}
+
+// Empty until the first spectrum is transformed into it, so the render loop draws nothing
+static complex_set_t* malloc_spectrum() {
+	complex_set_t* spectrum = NULL;
+	malloc_complex_set(&spectrum, NUM_SAMPLES, MAX_SAMPLE_RATE);
+	spectrum -> data_size = 0;
+	return spectrum;
+}
+
+// Starts capturing from the device on a thread of its own, and transforming what's captured on another
+// replay - optional, replayed instead of capturing from the device
+// outputs - optional, every spectrum is also published to these
+// capture_options - optional, how the capture thread is scheduled
+// silence_options - optional, when silent input stops being transformed
+// Returns 0 on success, 1 if the threads couldn't be started
+int start_analysis(analysis_t* analysis, pa_device_t device, replay_source_t* replay, spectrum_outputs_t* outputs, const capture_options_t* capture_options, const silence_options_t* silence_options) {
+	pthread_mutex_init(&analysis -> lock, NULL);
+	pthread_cond_init(&analysis -> published, NULL);
+	analysis -> running = true;
+	analysis -> finished = false;
+	analysis -> idle = false;
+	analysis -> fft_size = NUM_SAMPLES;
+	analysis -> hop_blocks = 1;
+	analysis -> engine = find_fft_engine(DEFAULT_FFT_ENGINE);
+	analysis -> sliding_hop = SLIDING_DFT_DEFAULT_HOP;
+	analysis -> sliding.window = NULL;
+	init_silence_gate(&analysis -> silence, silence_options);
+	analysis -> sequence = 0;
+	analysis -> analysis_ns = 0;
+	init_reconnect(&analysis -> reconnect);
+	analysis -> outputs = outputs;
+	// Every set the thread needs is allocated up front, so a steady-state frame allocates nothing
+	analysis -> input = NULL;
+	malloc_complex_set(&analysis -> input, NUM_SAMPLES, MAX_SAMPLE_RATE);
+	init_triple_buffer(&analysis -> spectra, malloc_spectrum(), malloc_spectrum(), malloc_spectrum());
+
+	if (start_capture(&analysis -> capture, device, replay, capture_options) != 0) {
+		free_analysis_sets(analysis);
+		return 1;
+	}
+	int create_stat = pthread_create(&analysis -> thread, NULL, analysis_thread, analysis);
+	if (create_stat != 0) {
+		log_error("Failed to start the analysis thread, error: %d\n", create_stat);
+		stop_capture(&analysis -> capture);
+		free_analysis_sets(analysis);
+		return 1;
+	}
+	return 0;
+}
+
+// Stops the analysis thread, then the capture thread once it's finished its current block
+void stop_analysis(analysis_t* analysis) {
+	pthread_mutex_lock(&analysis -> lock);
+	analysis -> running = false;
+	pthread_cond_broadcast(&analysis -> published);
+	pthread_mutex_unlock(&analysis -> lock);
+	// It's waiting on the capture for at most ANALYSIS_BLOCK_WAIT_NS
+	pthread_join(analysis -> thread, NULL);
+	stop_capture(&analysis -> capture);
+	free_analysis_sets(analysis);
+	pthread_cond_destroy(&analysis -> published);
+	pthread_mutex_destroy(&analysis -> lock);
+}
+
+// Switches capture to another device from the next block
+void set_analysis_device(analysis_t* analysis, pa_device_t device) {
+	set_capture_device(&analysis -> capture, device);
+}
+
+// True once a replay has run out, no more spectra will be published
+bool analysis_finished(analysis_t* analysis) {
+	pthread_mutex_lock(&analysis -> lock);
+	bool finished = analysis -> finished;
+	pthread_mutex_unlock(&analysis -> lock);
+	return finished;
+}
+
+// Changes the FFT size (a power of 2, up to NUM_SAMPLES) and how many blocks there are per transform, from the next block
+void set_analysis_quality(analysis_t* analysis, int fft_size, int hop_blocks) {
+	pthread_mutex_lock(&analysis -> lock);
+	analysis -> fft_size = fft_size;
+	analysis -> hop_blocks = hop_blocks;
+	pthread_mutex_unlock(&analysis -> lock);
+}
+
+// Switches to another engine from the next block, one of FFT_ENGINES or SLIDING_DFT_ENGINE
+// sliding_hop - with the sliding DFT, a spectrum is published every this many samples
+// Returns 0 on success, 1 if there's no such engine
+int set_analysis_engine(analysis_t* analysis, const char* name, int sliding_hop) {
+	bool sliding = strcmp(name, SLIDING_DFT_ENGINE) == 0;
+	const fft_engine_t* engine = find_fft_engine(name);
+	if (!sliding && engine == NULL) return 1;
+	pthread_mutex_lock(&analysis -> lock);
+	analysis -> engine = engine;
+	analysis -> sliding_hop = sliding_hop > 0 ? sliding_hop : SLIDING_DFT_DEFAULT_HOP;
+	pthread_mutex_unlock(&analysis -> lock);
+	return 0;
+}
+
+// True while the input is silent, no spectra are published until it isn't
+// Never once a replay's finished, there's nothing left to wait for then
+bool analysis_idle(analysis_t* analysis) {
+	pthread_mutex_lock(&analysis -> lock);
+	bool idle = analysis -> idle && !analysis -> finished;
+	pthread_mutex_unlock(&analysis -> lock);
+	return idle;
+}
+
+// Takes the latest spectrum if it's newer than sequence, the lock must be held
+// spectrum is always set to the reader's set, whether or not it changed
+static bool take_latest_spectrum(analysis_t* analysis, unsigned long* sequence, complex_set_t** spectrum) {
+	// Nothing's been published until the first sequence number
+	bool updated = analysis -> sequence != 0 && analysis -> sequence != *sequence;
+	if (updated) {
+		acquire_triple_buffer(&analysis -> spectra);
+		*sequence = analysis -> sequence;
+	}
+	*spectrum = triple_buffer_front(&analysis -> spectra);
+	return updated;
+}
+
+// Takes the latest spectrum if it's newer than the given sequence number
+// Only one thread may read spectra, the one it's given is its own to read until it takes another
+// spectrum - set to the latest spectrum, or the last one taken if there isn't a newer one (empty before the first)
+// sequence - the caller's last seen sequence number, updated if a newer spectrum was taken
+// analysis_ns/reconnect - are always updated with the latest values
+// Returns true if a newer spectrum was taken
+bool read_latest_spectrum(analysis_t* analysis, unsigned long* sequence, complex_set_t** spectrum, uint64_t* analysis_ns, pa_reconnect_t* reconnect) {
+	pthread_mutex_lock(&analysis -> lock);
+	bool updated = take_latest_spectrum(analysis, sequence, spectrum);
+	*analysis_ns = analysis -> analysis_ns;
+	*reconnect = analysis -> reconnect;
+	pthread_mutex_unlock(&analysis -> lock);
+	return updated;
+}
+
+// Blocks until there's a spectrum newer than sequence, then takes it as read_latest_spectrum does
+// spectrum may be NULL to only wait, leaving the spectrum (and sequence) for read_latest_spectrum
+// Gives up after timeout_ns, or when the thread is stopping
+// Returns true if a newer spectrum was taken
+bool wait_for_spectrum(analysis_t* analysis, unsigned long* sequence, complex_set_t** spectrum, uint64_t timeout_ns) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	uint64_t deadline_ns = (deadline.tv_nsec + timeout_ns);
+	deadline.tv_sec += deadline_ns / 1000000000;
+	deadline.tv_nsec = deadline_ns % 1000000000;
+
+	pthread_mutex_lock(&analysis -> lock);
+	while (analysis -> running && !analysis -> finished && (analysis -> sequence == 0 || analysis -> sequence == *sequence)) {
+		if (pthread_cond_timedwait(&analysis -> published, &analysis -> lock, &deadline) != 0) break;
+	}
+	bool updated = spectrum != NULL ? take_latest_spectrum(analysis, sequence, spectrum) : analysis -> sequence != 0 && analysis -> sequence != *sequence;
+	pthread_mutex_unlock(&analysis -> lock);
+	return updated;
+}
@@ -0,0 +1,66 @@
+#pragma once
+// Transforms the blocks captured from PulseAudio (or a replayed recording) on a thread of its own
+// Capture runs on another thread (see capture.h), the render loop picks up the latest completed spectrum whenever it draws
+// Capture, analysis and render each work on a buffer of their own, handed on through triple buffers, so each stage only waits on the one before when it has nothing new
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pulseaudio/pulsehandler.h>
+#include <shared.h>
+#include <outputs.h>
+#include <replay.h>
+#include <capture.h>
+#include <silence.h>
+#include <processing.h>
+#include <sliding_dft.h>
+
+// How long to wait for a captured block before checking whether we're stopping
+#define ANALYSIS_BLOCK_WAIT_NS 50000000
+
+typedef struct analysis {
+	pthread_t thread;
+	// Guards everything down to reconnect
+	pthread_mutex_t lock;
+	// Signalled whenever a spectrum is published or the thread stops
+	pthread_cond_t published;
+	bool running;
+	// Set once a replay has run out of samples, the thread stops by itself then
+	bool finished;
+	// Set while the input is silent, nothing is transformed (or published) until it isn't
+	bool idle;
+	// The newest fft_size samples of every hop_blocks'th block are transformed
+	int fft_size;
+	int hop_blocks;
+	// The engine blocks are transformed with, NULL for the sliding DFT (published every sliding_hop samples)
+	const fft_engine_t* engine;
+	int sliding_hop;
+	// Spectra are transformed into the back set and read in place from the front one
+	// sequence counts how many have been published (none while it's 0)
+	triple_buffer_t spectra;
+	unsigned long sequence;
+	// Only used by the analysis thread, blocks are converted into input before they're transformed
+	complex_set_t* input;
+	// Time taken to transform the latest spectrum, for the sliding DFT every block slid since the last transform
+	uint64_t analysis_ns;
+	// A copy of the capture's reconnect state, for display
+	pa_reconnect_t reconnect;
+	capture_t capture;
+	// Only used by the analysis thread
+	silence_gate_t silence;
+	// Only used by the analysis thread, allocated while the sliding DFT is the engine (window is NULL otherwise)
+	sliding_dft_t sliding;
+	// Where else each spectrum goes, only used by the analysis thread (may be NULL)
+	spectrum_outputs_t* outputs;
+} analysis_t;
+
+int start_analysis(analysis_t* analysis, pa_device_t device, replay_source_t* replay, spectrum_outputs_t* outputs, const capture_options_t* capture_options, const silence_options_t* silence_options);
+void stop_analysis(analysis_t* analysis);
+void set_analysis_device(analysis_t* analysis, pa_device_t device);
+void set_analysis_quality(analysis_t* analysis, int fft_size, int hop_blocks);
+int set_analysis_engine(analysis_t* analysis, const char* name, int sliding_hop);
+bool read_latest_spectrum(analysis_t* analysis, unsigned long* sequence, complex_set_t** spectrum, uint64_t* analysis_ns, pa_reconnect_t* reconnect);
+bool analysis_finished(analysis_t* analysis);
+bool analysis_idle(analysis_t* analysis);
+bool wait_for_spectrum(analysis_t* analysis, unsigned long* sequence, complex_set_t** spectrum, uint64_t timeout_ns);
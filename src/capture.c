@@ -0,0 +1,253 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <capture.h>
+#include <log.h>
+#include <trace/trace.h>
+#include <latency.h>
+#include <perf_counters.h>
+
+static const size_t BLOCK_BYTES = sizeof(int16_t) * NUM_SAMPLES;
+
+// Unpinned, at normal priority
+void default_capture_options(capture_options_t* options) {
+	options -> cpu = -1;
+	options -> policy = SCHED_FIFO;
+	options -> priority = 0;
+}
+
+// Page aligned, so locking it doesn't lock anything else in with it
+// Every page is touched up front, so none are faulted in mid-capture even if locking fails
+// Returns the zeroed buffer, or NULL if it couldn't be allocated
+static void* malloc_locked(size_t size) {
+	void* buffer = NULL;
+	if (posix_memalign(&buffer, sysconf(_SC_PAGESIZE), size) != 0) return NULL;
+	memset(buffer, 0, size);
+	if (mlock(buffer, size) != 0) {
+		log_warn("Failed to lock %ld bytes of capture buffer, error: %s (RLIMIT_MEMLOCK may be too low)\n", (long) size, strerror(errno));
+	}
+	return buffer;
+}
+
+static void free_locked(void* buffer, size_t size) {
+	if (buffer == NULL) return;
+	munlock(buffer, size);
+	free(buffer);
+}
+
+// Pins the calling thread and raises its priority as asked, carrying on as it is if it isn't allowed to
+static void apply_capture_options(capture_options_t* options) {
+	if (options -> cpu >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(options -> cpu, &cpus);
+		int affinity_stat = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (affinity_stat != 0) {
+			log_warn("Failed to pin capture to CPU %d, error: %s\n", options -> cpu, strerror(affinity_stat));
+		} else {
+			log_info("Capture pinned to CPU %d\n", options -> cpu);
+		}
+	}
+	if (options -> priority > 0) {
+		const char* policy_name = options -> policy == SCHED_RR ? "SCHED_RR" : "SCHED_FIFO";
+		int min_priority = sched_get_priority_min(options -> policy);
+		int max_priority = sched_get_priority_max(options -> policy);
+		struct sched_param param;
+		param.sched_priority = options -> priority < min_priority ? min_priority : options -> priority > max_priority ? max_priority : options -> priority;
+		int priority_stat = pthread_setschedparam(pthread_self(), options -> policy, &param);
+		if (priority_stat != 0) {
+			// Usually EPERM, without CAP_SYS_NICE or an RLIMIT_RTPRIO
+			log_warn("Failed to set capture to %s priority %d, error: %s, capturing at normal priority\n", policy_name, param.sched_priority, strerror(priority_stat));
+		} else {
+			log_info("Capture running at %s priority %d\n", policy_name, param.sched_priority);
+		}
+	}
+}
+
+// Fills the block from the replay or the device
+// Returns 0 on success, 1 if capture failed (or the replay has finished)
+static int capture_block(capture_t* capture, pa_device_t device, pa_session_t* session, int16_t* block) {
+	if (capture -> replay != NULL) {
+		const int16_t* samples = next_replay_block(capture -> replay, NUM_SAMPLES);
+		if (samples == NULL) return 1;
+		memcpy(block, samples, BLOCK_BYTES);
+		return 0;
+	}
+	int recording_stat = record_device_recovering(device, &session);
+	if (recording_stat != 0 || session -> stream_data == NULL || !session -> stream_data -> buffer_filled) {
+		log_debug("Failed to record samples from device.\n");
+		return 1;
+	}
+	memcpy(block, session -> stream_data -> data, BLOCK_BYTES);
+	return 0;
+}
+
+void* capture_thread(void* userdata) {
+	capture_t* capture = userdata;
+	trace_thread(TRACE_THREAD_CAPTURE);
+	apply_capture_options(&capture -> options);
+	open_thread_perf_counters();
+	// The session is only ever touched by this thread
+	// Its stream data is allocated here rather than on the first read, so it can be locked too
+	pa_session_t session = build_session("visualiser-pcm-recording");
+	session.stream_data = malloc_locked(sizeof(record_stream_data_t));
+	unsigned long int i = 0;
+	bool paced = capture -> replay == NULL || capture -> replay -> realtime;
+
+	while (true) {
+		pthread_mutex_lock(&capture -> lock);
+		while (!paced && capture -> running && capture -> taken != capture -> sequence) {
+			pthread_cond_wait(&capture -> captured, &capture -> lock);
+		}
+		bool running = capture -> running;
+		bool device_changed = capture -> device_changed;
+		pa_device_t device = capture -> device;
+		capture -> device_changed = false;
+		pthread_mutex_unlock(&capture -> lock);
+		if (!running) break;
+
+		if (device_changed && capture -> replay == NULL) {
+			log_info("=== Switching capture to device: %s\n", device.name);
+			rebuild_session(&session);
+		}
+
+		trace_frame(i);
+		uint64_t capture_start_ns = begin_stage();
+		trace_begin(TRACE_CAPTURE);
+		int capture_stat = capture_block(capture, device, &session, triple_buffer_back(&capture -> blocks));
+		trace_end(TRACE_CAPTURE);
+		if (capture_stat == 0) end_stage(LATENCY_CAPTURE, capture_start_ns);
+
+		pthread_mutex_lock(&capture -> lock);
+		if (capture_stat == 0) {
+			publish_triple_buffer(&capture -> blocks);
+			capture -> sequence++;
+			pthread_cond_broadcast(&capture -> captured);
+		}
+		capture -> reconnect = session.reconnect;
+		bool finished = capture_stat != 0 && capture -> replay != NULL;
+		if (finished) {
+			log_info("Replay of %s finished after %ld blocks\n", capture -> replay -> path, i);
+			capture -> finished = true;
+			pthread_cond_broadcast(&capture -> captured);
+		}
+		pthread_mutex_unlock(&capture -> lock);
+		if (finished) break;
+
+		if (capture_stat != 0) {
+			// Wait for the reconnect backoff
+			struct timespec retry_sleep = {0, CAPTURE_RETRY_SLEEP_NS};
+			nanosleep(&retry_sleep, NULL);
+		}
+		i++;
+	}
+
+	close_thread_perf_counters();
+	// destroy_session frees the stream data
+	munlock(session.stream_data, sizeof(record_stream_data_t));
+	destroy_session(session);
+	return NULL;
+}
+
+static void free_blocks(capture_t* capture) {
+	for (int i=0; i < 3; i++) {
+		free_locked(capture -> blocks.buffers[i], BLOCK_BYTES);
+		capture -> blocks.buffers[i] = NULL;
+	}
+}
+
+// Starts capturing from the device (or the replay, if set) on a new thread
+// options - may be NULL for the defaults
+// Returns 0 on success, 1 if the buffers couldn't be allocated or the thread couldn't be started
+int start_capture(capture_t* capture, pa_device_t device, replay_source_t* replay, const capture_options_t* options) {
+	pthread_mutex_init(&capture -> lock, NULL);
+	pthread_cond_init(&capture -> captured, NULL);
+	capture -> running = true;
+	capture -> finished = false;
+	capture -> device = device;
+	capture -> device_changed = false;
+	capture -> sequence = 0;
+	capture -> taken = 0;
+	init_reconnect(&capture -> reconnect);
+	capture -> replay = replay;
+	if (options != NULL) capture -> options = *options;
+	else default_capture_options(&capture -> options);
+	init_triple_buffer(&capture -> blocks, malloc_locked(BLOCK_BYTES), malloc_locked(BLOCK_BYTES), malloc_locked(BLOCK_BYTES));
+	bool allocated = capture -> blocks.buffers[0] != NULL && capture -> blocks.buffers[1] != NULL && capture -> blocks.buffers[2] != NULL;
+
+	int create_stat = allocated ? pthread_create(&capture -> thread, NULL, capture_thread, capture) : ENOMEM;
+	if (create_stat != 0) {
+		log_error("Failed to start the capture thread, error: %d\n", create_stat);
+		free_blocks(capture);
+		pthread_cond_destroy(&capture -> captured);
+		pthread_mutex_destroy(&capture -> lock);
+		return 1;
+	}
+	return 0;
+}
+
+// Stops the capture thread, waiting for the current block to finish
+// Nothing may be waiting for a block by now
+void stop_capture(capture_t* capture) {
+	pthread_mutex_lock(&capture -> lock);
+	capture -> running = false;
+	pthread_cond_broadcast(&capture -> captured);
+	pthread_mutex_unlock(&capture -> lock);
+	pthread_join(capture -> thread, NULL);
+	free_blocks(capture);
+	pthread_cond_destroy(&capture -> captured);
+	pthread_mutex_destroy(&capture -> lock);
+}
+
+// Switches capture to another device from the next block
+void set_capture_device(capture_t* capture, pa_device_t device) {
+	pthread_mutex_lock(&capture -> lock);
+	capture -> device = device;
+	capture -> device_changed = true;
+	pthread_mutex_unlock(&capture -> lock);
+}
+
+// Blocks until there's a block newer than sequence, then takes it from the triple buffer
+// Only one thread may take blocks
+// block - set to the block taken, it's the caller's to read until the next one's taken
+// sequence - the caller's last seen sequence number, updated if a block was taken (any in between were missed)
+// reconnect - always updated with the latest reconnect state
+// Returns 0 if a block was taken, 1 if there wasn't one within timeout_ns, or capture has stopped or finished
+int wait_for_block(capture_t* capture, unsigned long* sequence, const int16_t** block, pa_reconnect_t* reconnect, uint64_t timeout_ns) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	uint64_t deadline_ns = (deadline.tv_nsec + timeout_ns);
+	deadline.tv_sec += deadline_ns / 1000000000;
+	deadline.tv_nsec = deadline_ns % 1000000000;
+
+	pthread_mutex_lock(&capture -> lock);
+	while (capture -> running && !capture -> finished && capture -> sequence == *sequence) {
+		if (pthread_cond_timedwait(&capture -> captured, &capture -> lock, &deadline) != 0) break;
+	}
+	int stat = 1;
+	if (capture -> sequence != *sequence) {
+		acquire_triple_buffer(&capture -> blocks);
+		*block = triple_buffer_front(&capture -> blocks);
+		*sequence = capture -> sequence;
+		capture -> taken = capture -> sequence;
+		pthread_cond_broadcast(&capture -> captured);
+		stat = 0;
+	}
+	*reconnect = capture -> reconnect;
+	pthread_mutex_unlock(&capture -> lock);
+	return stat;
+}
+
+// True once a replay has run out, no more blocks will be captured
+bool capture_finished(capture_t* capture) {
+	pthread_mutex_lock(&capture -> lock);
+	bool finished = capture -> finished;
+	pthread_mutex_unlock(&capture -> lock);
+	return finished;
+}
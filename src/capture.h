@@ -0,0 +1,57 @@
+#pragma once
+// Captures from PulseAudio (or replays a recording) on a thread of its own, so ingestion keeps up whatever the FFT or terminal are doing
+// The thread can be pinned to a CPU and given a real-time priority, its buffers are locked into memory so it never page faults
+// The analysis thread picks up the newest complete block whenever it's ready for one, blocks are handed over in a triple buffer rather than copied
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pulseaudio/pulsehandler.h>
+#include <shared.h>
+#include <replay.h>
+#include <triple_buffer.h>
+
+// How long to back off after a failed capture, so a dead server doesn't spin the thread
+#define CAPTURE_RETRY_SLEEP_NS 10000000
+
+typedef struct capture_options {
+	// The CPU to pin the thread to, -1 to leave it to the scheduler
+	int cpu;
+	// SCHED_FIFO or SCHED_RR
+	int policy;
+	// The real-time priority (1-99), 0 to stay at normal priority
+	int priority;
+} capture_options_t;
+
+typedef struct capture {
+	pthread_t thread;
+	// Guards everything down to the replay
+	pthread_mutex_t lock;
+	// Signalled whenever a block is captured or taken, the replay finishes or the thread stops
+	pthread_cond_t captured;
+	bool running;
+	// Set once a replay has run out of samples, the thread stops by itself then
+	bool finished;
+	// The device to capture, device_changed is set when another one is picked
+	pa_device_t device;
+	bool device_changed;
+	// Blocks of NUM_SAMPLES, filled by the capture thread and read in place by the analysis thread
+	// sequence counts how many have been published
+	triple_buffer_t blocks;
+	unsigned long sequence;
+	// The last block handed out, a replay that isn't paced waits for each block to be taken rather than skipping any
+	unsigned long taken;
+	// A copy of the session's reconnect state, for display
+	pa_reconnect_t reconnect;
+	// Replayed in place of the device when set
+	replay_source_t* replay;
+	capture_options_t options;
+} capture_t;
+
+void default_capture_options(capture_options_t* options);
+int start_capture(capture_t* capture, pa_device_t device, replay_source_t* replay, const capture_options_t* options);
+void stop_capture(capture_t* capture);
+void set_capture_device(capture_t* capture, pa_device_t device);
+int wait_for_block(capture_t* capture, unsigned long* sequence, const int16_t** block, pa_reconnect_t* reconnect, uint64_t timeout_ns);
+bool capture_finished(capture_t* capture);
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <config.h>
+#include <shared.h>
+#include <shm/spectrum_shm.h>
+#include <server/spectrum_server.h>
+#include <log.h>
+#include <latency.h>
+#include <processing.h>
+#include <sliding_dft.h>
+
+static const int TARGET_FPS_CHOICES[] = {30, 60, 120};
+static const int TARGET_FPS_CHOICE_COUNT = sizeof(TARGET_FPS_CHOICES) / sizeof(int);
+
+// Returns true if the variable is set to 1
+bool env_flag(const char* name) {
+	const char* value = getenv(name);
+	return value != NULL && value[0] == '1';
+}
+
+// Returns the variable as an int, or the fallback if unset/invalid
+int env_int(const char* name, int fallback) {
+	const char* value = getenv(name);
+	if (value == NULL) return fallback;
+	char* end = NULL;
+	long parsed = strtol(value, &end, 10);
+	return (end != value && *end == '\0') ? (int) parsed : fallback;
+}
+
+// Picks the closest of the supported frame rates
+int choose_target_fps(int requested) {
+	int chosen = TARGET_FPS_CHOICES[0];
+	for (int i=0; i < TARGET_FPS_CHOICE_COUNT; i++) {
+		if (abs(TARGET_FPS_CHOICES[i] - requested) < abs(chosen - requested)) {
+			chosen = TARGET_FPS_CHOICES[i];
+		}
+	}
+	return chosen;
+}
+
+purses_config_t load_config() {
+	purses_config_t config;
+	config.log_level = parse_log_level(getenv("PURSES_LOG_LEVEL"), DEFAULT_LOG_LEVEL);
+	set_log_level(config.log_level);
+	config.testing_mode = env_flag("PURSES_TEST_MODE");
+	config.target_fps = choose_target_fps(env_int("PURSES_FPS", DEFAULT_TARGET_FPS));
+	config.bar_columns = env_int("PURSES_BAR_COLUMNS", DEFAULT_BAR_COLUMNS);
+	if (config.bar_columns < 1) config.bar_columns = DEFAULT_BAR_COLUMNS;
+	config.headless = env_flag("PURSES_HEADLESS");
+	config.output_path = getenv("PURSES_OUTPUT");
+	config.shm_name = getenv("PURSES_SHM");
+	if (config.shm_name != NULL && strcmp(config.shm_name, "1") == 0) config.shm_name = SPECTRUM_SHM_DEFAULT_NAME;
+	config.record_path = getenv("PURSES_RECORD");
+	config.record_max_mb = env_int("PURSES_RECORD_MAX_MB", 0);
+	config.record_max_seconds = env_int("PURSES_RECORD_MAX_SECONDS", 0);
+	if (config.record_max_mb < 0) config.record_max_mb = 0;
+	if (config.record_max_seconds < 0) config.record_max_seconds = 0;
+	config.replay_path = getenv("PURSES_REPLAY");
+	const char* replay_speed = getenv("PURSES_REPLAY_SPEED");
+	config.replay_realtime = replay_speed == NULL || strcmp(replay_speed, "max") != 0;
+	config.latency_path = getenv("PURSES_LATENCY_FILE");
+	if (config.latency_path == NULL) config.latency_path = LATENCY_DEFAULT_PATH;
+	config.bench_frames = env_int("PURSES_BENCH_FRAMES", 0);
+	default_capture_options(&config.capture);
+	config.capture.cpu = env_int("PURSES_CAPTURE_CPU", config.capture.cpu);
+	config.capture.priority = env_int("PURSES_CAPTURE_PRIORITY", config.capture.priority);
+	const char* capture_policy = getenv("PURSES_CAPTURE_POLICY");
+	if (capture_policy != NULL && strcmp(capture_policy, "rr") == 0) config.capture.policy = SCHED_RR;
+	default_silence_options(&config.silence);
+	config.silence.hold_ms = env_int("PURSES_SILENCE_MS", config.silence.hold_ms);
+	config.silence.threshold = env_int("PURSES_SILENCE_THRESHOLD", config.silence.threshold);
+	config.fft_engine = getenv("PURSES_FFT_ENGINE");
+	if (config.fft_engine == NULL) config.fft_engine = DEFAULT_FFT_ENGINE;
+	if (find_fft_engine(config.fft_engine) == NULL && strcmp(config.fft_engine, SLIDING_DFT_ENGINE) != 0) {
+		log_warn("Unknown FFT engine: %s, using %s\n", config.fft_engine, DEFAULT_FFT_ENGINE);
+		config.fft_engine = DEFAULT_FFT_ENGINE;
+	}
+	config.sliding_hop = env_int("PURSES_SLIDING_HOP", SLIDING_DFT_DEFAULT_HOP);
+	config.governor = env_int("PURSES_GOVERNOR", 1) != 0;
+	config.perf_counters = env_flag("PURSES_PERF_COUNTERS");
+	config.trace_path = getenv("PURSES_TRACE");
+	config.socket_path = getenv("PURSES_SOCKET");
+	if (config.socket_path != NULL && strcmp(config.socket_path, "1") == 0) config.socket_path = SPECTRUM_SERVER_DEFAULT_PATH;
+	log_info("Config - testing mode: %d, target FPS: %d, bar columns: %d, headless: %d, output: %s, shared memory: %s, socket: %s\n", config.testing_mode, config.target_fps, config.bar_columns, config.headless, config.output_path == NULL ? "stdout" : config.output_path, config.shm_name == NULL ? "off" : config.shm_name, config.socket_path == NULL ? "off" : config.socket_path);
+	return config;
+}
+
+// Cycles through the supported frame rates i.e 30 -> 60 -> 120 -> 30
+int next_target_fps(int target_fps) {
+	for (int i=0; i < TARGET_FPS_CHOICE_COUNT; i++) {
+		if (TARGET_FPS_CHOICES[i] == target_fps) {
+			return TARGET_FPS_CHOICES[(i+1) % TARGET_FPS_CHOICE_COUNT];
+		}
+	}
+	return DEFAULT_TARGET_FPS;
+}
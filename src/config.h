@@ -0,0 +1,62 @@
+#pragma once
+// Runtime options, read from PURSES_* environment variables
+
+#include <stdbool.h>
+#include <log.h>
+#include <capture.h>
+#include <silence.h>
+
+#define DEFAULT_TARGET_FPS 60
+// One bar (and a gap) per 2 columns
+#define DEFAULT_BAR_COLUMNS 2
+
+typedef struct purses_config {
+	// PURSES_TEST_MODE=1, waits for a keypress between frames
+	bool testing_mode;
+	// PURSES_FPS, the rate the visualiser is redrawn at (30, 60 or 120)
+	int target_fps;
+	// PURSES_BAR_COLUMNS, columns from the start of one bar to the next (the bar count scales to fit)
+	int bar_columns;
+	// PURSES_HEADLESS=1, skips ncurses and streams spectra as binary records instead
+	bool headless;
+	// PURSES_OUTPUT, where headless records go, stdout if unset or "-"
+	const char* output_path;
+	// PURSES_SHM, publishes spectra to shared memory under this name (1 for the default name)
+	const char* shm_name;
+	// PURSES_SOCKET, serves spectra on a Unix domain socket at this path (1 for the default path)
+	const char* socket_path;
+	// PURSES_RECORD, appends the captured samples to this WAV file
+	const char* record_path;
+	// PURSES_RECORD_MAX_MB/PURSES_RECORD_MAX_SECONDS, start a new numbered file after this much (0 for no limit)
+	int record_max_mb;
+	int record_max_seconds;
+	// PURSES_REPLAY, replays this raw or WAV recording instead of capturing from PulseAudio
+	const char* replay_path;
+	// PURSES_REPLAY_SPEED, "realtime" (the default) to pace the replay as it was recorded, or "max" for as fast as possible
+	bool replay_realtime;
+	// PURSES_LATENCY_FILE, where each stage's latency histogram is written on exit
+	const char* latency_path;
+	// PURSES_BENCH_FRAMES, draws this many spectra of a synthetic signal as fast as possible (offscreen), then reports the costs
+	int bench_frames;
+	// PURSES_CAPTURE_CPU pins the capture thread to a CPU
+	// PURSES_CAPTURE_PRIORITY runs it at this real-time priority (1-99), with PURSES_CAPTURE_POLICY "fifo" (the default) or "rr"
+	capture_options_t capture;
+	// PURSES_SILENCE_MS, how long the input has to be silent before analysis and redraws pause (0 to never pause)
+	// PURSES_SILENCE_THRESHOLD, the loudest sample (of 32767) that still counts as silent
+	silence_options_t silence;
+	// PURSES_FFT_ENGINE, how spectra are computed: dft, ct_fft (the default), iterative, or sliding
+	// sliding updates a sliding DFT with every sample and publishes a spectrum every PURSES_SLIDING_HOP samples
+	const char* fft_engine;
+	int sliding_hop;
+	// PURSES_GOVERNOR=0, keeps full quality rather than dropping the frame rate, FFT size and bar count when frames take too long
+	bool governor;
+	// PURSES_PERF_COUNTERS=1, counts cycles, instructions, cache and branch misses per stage (for the overlay and benchmark)
+	bool perf_counters;
+	// PURSES_TRACE, records per-frame stage timings to this file
+	const char* trace_path;
+	// PURSES_LOG_LEVEL, the most detailed messages written to purses.log (error, warn, info, debug, or trace)
+	log_level_t log_level;
+} purses_config_t;
+
+purses_config_t load_config();
+int next_target_fps(int target_fps);
@@ -0,0 +1,103 @@
+#include <string.h>
+#include <frame_format.h>
+
+static void put_u16(uint8_t* buffer, uint16_t value) {
+	buffer[0] = value & 0xFF;
+	buffer[1] = value >> 8;
+}
+
+static void put_u32(uint8_t* buffer, uint32_t value) {
+	for (int i=0; i < 4; i++) buffer[i] = (value >> (i * 8)) & 0xFF;
+}
+
+static void put_u64(uint8_t* buffer, uint64_t value) {
+	for (int i=0; i < 8; i++) buffer[i] = (value >> (i * 8)) & 0xFF;
+}
+
+static uint16_t get_u16(const uint8_t* buffer) {
+	return buffer[0] | (buffer[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t* buffer) {
+	uint32_t value = 0;
+	for (int i=0; i < 4; i++) value |= (uint32_t) buffer[i] << (i * 8);
+	return value;
+}
+
+static uint64_t get_u64(const uint8_t* buffer) {
+	uint64_t value = 0;
+	for (int i=0; i < 8; i++) value |= (uint64_t) buffer[i] << (i * 8);
+	return value;
+}
+
+// Bytes needed for a record of bin_count magnitudes
+size_t frame_size(uint32_t bin_count) {
+	return FRAME_HEADER_SIZE + (sizeof(float) * bin_count);
+}
+
+static void put_header(uint8_t* buffer, uint64_t timestamp_ns, uint64_t sequence, uint32_t sample_rate, uint32_t count) {
+	memcpy(buffer, FRAME_MAGIC, 4);
+	put_u16(buffer + 4, FRAME_VERSION);
+	put_u16(buffer + 6, FRAME_HEADER_SIZE);
+	put_u64(buffer + 8, timestamp_ns);
+	put_u64(buffer + 16, sequence);
+	put_u32(buffer + 24, sample_rate);
+	put_u32(buffer + 28, count);
+}
+
+static void put_float(uint8_t* buffer, float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	put_u32(buffer, bits);
+}
+
+// Writes a record for the spectrum's magnitudes into buffer
+// Returns the number of bytes written, or 0 if the buffer is too small
+size_t encode_frame(uint8_t* buffer, size_t capacity, uint64_t timestamp_ns, uint64_t sequence, complex_set_t* spectrum) {
+	uint32_t bin_count = spectrum -> data_size;
+	size_t size = frame_size(bin_count);
+	if (size > capacity) return 0;
+
+	put_header(buffer, timestamp_ns, sequence, spectrum -> sample_rate, bin_count);
+	uint8_t* magnitudes = buffer + FRAME_HEADER_SIZE;
+	for (uint32_t i=0; i < bin_count; i++) {
+		put_float(magnitudes + (i * sizeof(float)), (float) spectrum -> complex_numbers[i].magnitude);
+	}
+	return size;
+}
+
+// Writes a record of count values (e.g band levels) in place of the magnitudes
+// Returns the number of bytes written, or 0 if the buffer is too small
+size_t encode_frame_values(uint8_t* buffer, size_t capacity, uint64_t timestamp_ns, uint64_t sequence, uint32_t sample_rate, const float* values, uint32_t count) {
+	size_t size = frame_size(count);
+	if (size > capacity) return 0;
+
+	put_header(buffer, timestamp_ns, sequence, sample_rate, count);
+	for (uint32_t i=0; i < count; i++) {
+		put_float(buffer + FRAME_HEADER_SIZE + (i * sizeof(float)), values[i]);
+	}
+	return size;
+}
+
+// Reads the header at the start of buffer
+// Returns 0 on success, 1 if it isn't a record we understand or the buffer is too short
+int decode_frame_header(const uint8_t* buffer, size_t length, frame_header_t* header) {
+	if (length < FRAME_HEADER_SIZE || memcmp(buffer, FRAME_MAGIC, 4) != 0) return 1;
+	header -> version = get_u16(buffer + 4);
+	header -> header_size = get_u16(buffer + 6);
+	header -> timestamp_ns = get_u64(buffer + 8);
+	header -> sequence = get_u64(buffer + 16);
+	header -> sample_rate = get_u32(buffer + 24);
+	header -> bin_count = get_u32(buffer + 28);
+	if (header -> version != FRAME_VERSION || header -> header_size < FRAME_HEADER_SIZE) return 1;
+	size_t size = header -> header_size + (sizeof(float) * (size_t) header -> bin_count);
+	return length < size ? 1 : 0;
+}
+
+// Reads a single magnitude from a record whose header has been decoded
+float decode_frame_magnitude(const uint8_t* buffer, frame_header_t* header, uint32_t bin) {
+	uint32_t bits = get_u32(buffer + header -> header_size + (bin * sizeof(float)));
+	float magnitude;
+	memcpy(&magnitude, &bits, sizeof(magnitude));
+	return magnitude;
+}
@@ -0,0 +1,34 @@
+#pragma once
+// A compact binary record for each spectrum, used by the headless mode
+// Each record is a fixed header followed by bin_count float32 magnitudes
+// All fields are little-endian and the header is 32 bytes:
+//   0  char[4]  magic "PRSF"
+//   4  uint16   version
+//   6  uint16   header size in bytes, readers should skip to this offset
+//   8  uint64   timestamp, nanoseconds since the unix epoch
+//   16 uint64   sequence number of the spectrum, gaps mean spectra were missed
+//   24 uint32   sample rate in Hz
+//   28 uint32   bin count, each bin covers sample_rate / (2 * bin_count) Hz
+
+#include <stddef.h>
+#include <stdint.h>
+#include <shared.h>
+
+#define FRAME_MAGIC "PRSF"
+#define FRAME_VERSION 1
+#define FRAME_HEADER_SIZE 32
+
+typedef struct frame_header {
+	uint16_t version;
+	uint16_t header_size;
+	uint64_t timestamp_ns;
+	uint64_t sequence;
+	uint32_t sample_rate;
+	uint32_t bin_count;
+} frame_header_t;
+
+size_t frame_size(uint32_t bin_count);
+size_t encode_frame(uint8_t* buffer, size_t capacity, uint64_t timestamp_ns, uint64_t sequence, complex_set_t* spectrum);
+size_t encode_frame_values(uint8_t* buffer, size_t capacity, uint64_t timestamp_ns, uint64_t sequence, uint32_t sample_rate, const float* values, uint32_t count);
+int decode_frame_header(const uint8_t* buffer, size_t length, frame_header_t* header);
+float decode_frame_magnitude(const uint8_t* buffer, frame_header_t* header, uint32_t bin);
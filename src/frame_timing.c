@@ -0,0 +1,47 @@
+#include <time.h>
+#include <errno.h>
+#include <frame_timing.h>
+#include <shared.h>
+
+void init_frame_stats(frame_stats_t* stats, uint64_t now_ns) {
+	*stats = (frame_stats_t) {0};
+	stats -> last_frame_ns = now_ns;
+	stats -> window_start_ns = now_ns;
+}
+
+// Records a frame starting at now_ns, the frame time being the gap since the last frame started
+void record_frame(frame_stats_t* stats, uint64_t now_ns) {
+	uint64_t frame_ns = now_ns - stats -> last_frame_ns;
+	stats -> last_frame_ns = now_ns;
+	stats -> window_frames++;
+	stats -> window_total_ns += frame_ns;
+	if (frame_ns > stats -> window_max_ns) stats -> window_max_ns = frame_ns;
+
+	uint64_t window_ns = now_ns - stats -> window_start_ns;
+	if (window_ns >= FRAME_STATS_WINDOW_NS) {
+		stats -> fps = (stats -> window_frames * 1e9) / window_ns;
+		stats -> avg_frame_ms = (stats -> window_total_ns / 1e6) / stats -> window_frames;
+		stats -> max_frame_ms = stats -> window_max_ns / 1e6;
+		stats -> window_start_ns = now_ns;
+		stats -> window_frames = 0;
+		stats -> window_total_ns = 0;
+		stats -> window_max_ns = 0;
+	}
+}
+
+// Sleeps until the next frame is due, then moves the deadline on by a period
+// Deadlines are absolute so time spent drawing doesn't add to the period
+// If we've fallen more than a frame behind, the schedule restarts from now rather than bursting to catch up
+void pace_frame(uint64_t* next_frame_ns, uint64_t period_ns) {
+	uint64_t now_ns = get_monotonic_ns();
+	if (now_ns > (*next_frame_ns) + period_ns) {
+		*next_frame_ns = now_ns;
+	}
+	struct timespec deadline = {
+		.tv_sec = (*next_frame_ns) / 1000000000,
+		.tv_nsec = (*next_frame_ns) % 1000000000
+	};
+	// Signals (i.e SIGWINCH) interrupt the sleep, so go back to sleep until the deadline
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+	*next_frame_ns += period_ns;
+}
@@ -0,0 +1,24 @@
+#pragma once
+// Frame pacing and frame time statistics for the render loop
+
+#include <stdint.h>
+
+// How often the reported FPS/frame times are updated
+#define FRAME_STATS_WINDOW_NS 500000000
+
+typedef struct frame_stats {
+	uint64_t last_frame_ns;
+	// Frames counted in the current reporting window
+	uint64_t window_start_ns;
+	unsigned long window_frames;
+	uint64_t window_total_ns;
+	uint64_t window_max_ns;
+	// Reported values for the last complete window
+	double fps;
+	double avg_frame_ms;
+	double max_frame_ms;
+} frame_stats_t;
+
+void init_frame_stats(frame_stats_t* stats, uint64_t now_ns);
+void record_frame(frame_stats_t* stats, uint64_t now_ns);
+void pace_frame(uint64_t* next_frame_ns, uint64_t period_ns);
@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <frame_writer.h>
+#include <frame_format.h>
+#include <log.h>
+
+// Opens the writer on path, or stdout if path is NULL or "-"
+// Returns 0 on success, 1 if the file couldn't be opened
+int open_frame_writer(frame_writer_t* writer, const char* path) {
+	memset(writer, 0, sizeof(frame_writer_t));
+	bool use_stdout = path == NULL || strcmp(path, "-") == 0;
+	// A stream of our own on stdout, so we control its buffer and can close it
+	writer -> file = use_stdout ? fdopen(dup(STDOUT_FILENO), "wb") : fopen(path, "wb");
+	if (writer -> file == NULL) {
+		log_error("Failed to open headless output: %s\n", use_stdout ? "stdout" : path);
+		return 1;
+	}
+
+	writer -> record_capacity = frame_size(NUM_SAMPLES);
+	writer -> record = malloc(writer -> record_capacity);
+	writer -> file_buffer = malloc(FRAME_WRITER_BUFFER_SIZE);
+	if (writer -> record == NULL || writer -> file_buffer == NULL) {
+		close_frame_writer(writer);
+		return 1;
+	}
+	// We decide when to flush, not stdio
+	setvbuf(writer -> file, writer -> file_buffer, _IOFBF, FRAME_WRITER_BUFFER_SIZE);
+	return 0;
+}
+
+// Encodes and queues a record for the spectrum
+// Returns 0 on success, 1 if writing failed (e.g the reader went away)
+int write_spectrum_frame(frame_writer_t* writer, complex_set_t* spectrum, uint64_t sequence, uint64_t timestamp_ns) {
+	size_t size = encode_frame(writer -> record, writer -> record_capacity, timestamp_ns, sequence, spectrum);
+	if (size == 0 || fwrite(writer -> record, size, 1, writer -> file) != 1) return 1;
+	if (writer -> pending == 0) writer -> first_pending_ns = get_monotonic_ns();
+	writer -> pending++;
+	writer -> frames_written++;
+	writer -> bytes_written += size;
+	return 0;
+}
+
+// Flushes queued records once a batch is full or has waited long enough
+// Returns 0 on success, 1 if writing failed
+int flush_frame_writer(frame_writer_t* writer, uint64_t now_ns, bool force) {
+	if (writer -> pending == 0) return 0;
+	bool batch_full = writer -> pending >= FRAME_WRITER_BATCH;
+	bool batch_stale = now_ns - writer -> first_pending_ns >= FRAME_WRITER_MAX_DELAY_NS;
+	if (!force && !batch_full && !batch_stale) return 0;
+	writer -> pending = 0;
+	return fflush(writer -> file) == 0 ? 0 : 1;
+}
+
+// Flushes anything left and closes the output
+// Returns 0 on success, 1 if the final write failed
+int close_frame_writer(frame_writer_t* writer) {
+	int stat = 0;
+	if (writer -> file != NULL) {
+		stat = fflush(writer -> file) == 0 ? 0 : 1;
+		if (fclose(writer -> file) != 0) stat = 1;
+		writer -> file = NULL;
+	}
+	free(writer -> record);
+	free(writer -> file_buffer);
+	writer -> record = NULL;
+	writer -> file_buffer = NULL;
+	return stat;
+}
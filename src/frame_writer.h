@@ -0,0 +1,30 @@
+#pragma once
+// Buffers encoded spectrum records and writes them out in batches
+
+#include <stdio.h>
+#include <stdint.h>
+#include <shared.h>
+
+// Flush after this many records, or once the oldest unflushed record is this old
+#define FRAME_WRITER_BATCH 16
+#define FRAME_WRITER_MAX_DELAY_NS 100000000
+// stdio buffer size, large enough for a batch of full spectra
+#define FRAME_WRITER_BUFFER_SIZE (64 * 1024)
+
+typedef struct frame_writer {
+	FILE* file;
+	// stdio's buffer, so whole batches go out in as few writes as possible
+	char* file_buffer;
+	// Space for encoding a single record
+	uint8_t* record;
+	size_t record_capacity;
+	int pending;
+	uint64_t first_pending_ns;
+	unsigned long frames_written;
+	unsigned long bytes_written;
+} frame_writer_t;
+
+int open_frame_writer(frame_writer_t* writer, const char* path);
+int write_spectrum_frame(frame_writer_t* writer, complex_set_t* spectrum, uint64_t sequence, uint64_t timestamp_ns);
+int flush_frame_writer(frame_writer_t* writer, uint64_t now_ns, bool force);
+int close_frame_writer(frame_writer_t* writer);
@@ -0,0 +1,70 @@
+#include <governor.h>
+#include <shared.h>
+
+// Cheapest to lose first: the frame rate, then FFT resolution, then the bars and how often spectra are updated
+const quality_level_t QUALITY_LEVELS[] = {
+	{NUM_SAMPLES, 1, 1, 1},
+	{NUM_SAMPLES, 1, 1, 2},
+	{NUM_SAMPLES / 2, 1, 1, 2},
+	{NUM_SAMPLES / 2, 2, 2, 2},
+	{NUM_SAMPLES / 4, 2, 2, 4}
+};
+const int QUALITY_LEVEL_COUNT = sizeof(QUALITY_LEVELS) / sizeof(quality_level_t);
+
+// Starts at full quality
+void init_governor(quality_governor_t* governor) {
+	governor -> level = 0;
+	governor -> load = 0;
+	governor -> direction = 0;
+	governor -> direction_since_ns = 0;
+	governor -> up_hold_ns = GOVERNOR_UP_NS;
+	governor -> last_step_up = false;
+	governor -> last_step_up_ns = 0;
+}
+
+const quality_level_t* governor_level(quality_governor_t* governor) {
+	return &QUALITY_LEVELS[governor -> level];
+}
+
+// The slowest stage's share of its budget at this level, over 1 when it can't keep up
+// period_ns - the frame period at full quality
+double frame_load(const quality_level_t* level, uint64_t draw_ns, uint64_t analysis_ns, uint64_t period_ns) {
+	double frame_ns = (double) period_ns * level -> fps_divisor;
+	double hop_ns = 1e9 * NUM_SAMPLES * level -> hop_blocks / MAX_SAMPLE_RATE;
+	double draw_load = draw_ns / frame_ns;
+	double analysis_load = analysis_ns / (hop_ns > frame_ns ? hop_ns : frame_ns);
+	return draw_load > analysis_load ? draw_load : analysis_load;
+}
+
+// Adds a frame's load, stepping the level down (or up) once it's been over (or under) budget for long enough
+// Returns true if the level changed
+bool update_governor(quality_governor_t* governor, double load, uint64_t now_ns) {
+	governor -> load += GOVERNOR_SMOOTHING * (load - governor -> load);
+	int direction = governor -> load > 1.0 ? 1 : governor -> load < GOVERNOR_UP_LOAD ? -1 : 0;
+	if (direction != governor -> direction) {
+		governor -> direction = direction;
+		governor -> direction_since_ns = now_ns;
+		return false;
+	}
+	uint64_t held_ns = now_ns - governor -> direction_since_ns;
+	int level = governor -> level;
+	if (direction == 1 && held_ns >= GOVERNOR_DOWN_NS && level + 1 < QUALITY_LEVEL_COUNT) level++;
+	if (direction == -1 && held_ns >= governor -> up_hold_ns && level > 0) level--;
+	if (level == governor -> level) return false;
+
+	bool step_up = level < governor -> level;
+	if (!step_up) {
+		// Only a drop soon after regaining the level means it was regained too early
+		bool bounced = governor -> last_step_up && now_ns - governor -> last_step_up_ns < GOVERNOR_UP_NS;
+		governor -> up_hold_ns = bounced ? governor -> up_hold_ns * 2 : GOVERNOR_UP_NS;
+		if (governor -> up_hold_ns > GOVERNOR_MAX_UP_NS) governor -> up_hold_ns = GOVERNOR_MAX_UP_NS;
+	}
+	governor -> last_step_up = step_up;
+	if (step_up) governor -> last_step_up_ns = now_ns;
+	governor -> level = level;
+	// Until it's measured, assume the load halves (or doubles) with the level
+	governor -> load = step_up ? governor -> load * 2 : governor -> load / 2;
+	governor -> direction = 0;
+	governor -> direction_since_ns = now_ns;
+	return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+// Trades quality for speed when the box is too busy to keep up, and back again once it isn't
+// The load is the slowest stage's time over its budget: drawing against the frame period,
+// and the FFT against the frame period or the hop between transforms, whichever's longer
+// A level is dropped once the load has been over budget for GOVERNOR_DOWN_NS, and regained once it's been under GOVERNOR_UP_LOAD for GOVERNOR_UP_NS
+// Each level roughly halves the load, so the gap between the two keeps it from bouncing between levels
+// Where it doesn't, dropping back within GOVERNOR_UP_NS of regaining a level doubles how long it waits to regain one again
+// Holding a regained level for longer than that resets the wait
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GOVERNOR_DOWN_NS 500000000
+#define GOVERNOR_UP_NS 3000000000
+#define GOVERNOR_MAX_UP_NS 60000000000
+#define GOVERNOR_UP_LOAD 0.4
+// How much each frame moves the smoothed load
+#define GOVERNOR_SMOOTHING 0.1
+
+typedef struct quality_level {
+	// Samples transformed, the newest of each block
+	int fft_size;
+	// Blocks per transform, the others are skipped
+	int hop_blocks;
+	// Multiplies the configured columns per bar, i.e divides the bar count
+	int bar_scale;
+	// Divides the target frame rate
+	int fps_divisor;
+} quality_level_t;
+
+extern const quality_level_t QUALITY_LEVELS[];
+extern const int QUALITY_LEVEL_COUNT;
+
+typedef struct quality_governor {
+	// The index into QUALITY_LEVELS, 0 being full quality
+	int level;
+	double load;
+	// 1 while over budget, -1 while well under it, 0 otherwise, since direction_since_ns
+	int direction;
+	uint64_t direction_since_ns;
+	// How long it has to be under budget to regain a level, and whether (and when) the last change regained one
+	uint64_t up_hold_ns;
+	bool last_step_up;
+	uint64_t last_step_up_ns;
+} quality_governor_t;
+
+void init_governor(quality_governor_t* governor);
+const quality_level_t* governor_level(quality_governor_t* governor);
+double frame_load(const quality_level_t* level, uint64_t draw_ns, uint64_t analysis_ns, uint64_t period_ns);
+bool update_governor(quality_governor_t* governor, double load, uint64_t now_ns);
@@ -0,0 +1,75 @@
+#include <signal.h>
+#include <string.h>
+
+#include <headless.h>
+#include <analysis.h>
+#include <frame_writer.h>
+#include <processing.h>
+#include <log.h>
+
+// Set by SIGINT/SIGTERM, there's no keyboard to quit with
+static volatile sig_atomic_t stop_requested = 0;
+
+void handle_stop_signal(int signal) {
+	stop_requested = 1;
+}
+
+void watch_stop_signals() {
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = handle_stop_signal;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	// A closed pipe shows up as a failed write instead
+	signal(SIGPIPE, SIG_IGN);
+}
+
+// Streams spectra until we're signalled, the output can't be written, or the replay finishes
+// replay - optional, replayed instead of capturing from the device
+// Returns 0 on success, 1 on failure
+int run_headless(purses_config_t config, pa_device_t device, replay_source_t* replay) {
+	frame_writer_t writer;
+	if (open_frame_writer(&writer, config.output_path) != 0) return 1;
+	watch_stop_signals();
+
+	spectrum_outputs_t outputs;
+	if (open_outputs(&outputs, &config) != 0) {
+		close_frame_writer(&writer);
+		return 1;
+	}
+	analysis_t analysis;
+	if (start_analysis(&analysis, device, replay, &outputs, &config.capture, &config.silence) != 0) {
+		close_outputs(&outputs);
+		close_frame_writer(&writer);
+		return 1;
+	}
+	set_analysis_engine(&analysis, config.fft_engine, config.sliding_hop);
+
+	// Written straight from the analysis thread's set, nothing is copied
+	complex_set_t* spectrum = NULL;
+	unsigned long sequence = 0;
+	int stat = 0;
+	while (!stop_requested) {
+		if (wait_for_spectrum(&analysis, &sequence, &spectrum, HEADLESS_WAIT_NS)) {
+			if (write_spectrum_frame(&writer, spectrum, sequence, get_realtime_ns()) != 0) {
+				log_error("Failed to write a headless record, stopping\n");
+				stat = 1;
+				break;
+			}
+		} else if (analysis_finished(&analysis)) {
+			break;
+		}
+		if (flush_frame_writer(&writer, get_monotonic_ns(), false) != 0) {
+			log_error("Failed to flush headless records, stopping\n");
+			stat = 1;
+			break;
+		}
+	}
+
+	stop_analysis(&analysis);
+	close_outputs(&outputs);
+	if (close_frame_writer(&writer) != 0) stat = 1;
+	log_info("Headless run wrote %lu records (%lu bytes)\n", writer.frames_written, writer.bytes_written);
+	return stat;
+}
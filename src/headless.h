@@ -0,0 +1,12 @@
+#pragma once
+// Runs the analysis without ncurses, writing every spectrum out as a binary record
+// See frame_format.h for the record layout
+
+#include <config.h>
+#include <pulseaudio/pulsehandler.h>
+#include <replay.h>
+
+// How long to wait for a spectrum before checking for signals and flushing
+#define HEADLESS_WAIT_NS 50000000
+
+int run_headless(purses_config_t config, pa_device_t device, replay_source_t* replay);
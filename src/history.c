@@ -0,0 +1,50 @@
+#include <stdlib.h>
+#include <history.h>
+
+// Returns 0 on success, 1 if the rows couldn't be allocated
+int init_history(spectrum_history_t* history, int capacity, int bins) {
+	history -> rows = calloc(capacity, bins);
+	history -> capacity = capacity;
+	history -> bins = bins;
+	history -> count = 0;
+	return history -> rows == NULL ? 1 : 0;
+}
+
+void free_history(spectrum_history_t* history) {
+	free(history -> rows);
+	history -> rows = NULL;
+}
+
+uint8_t quantise_decibels(double decibels) {
+	if (decibels <= 0) return 0;
+	double level = decibels * HISTORY_STEPS_PER_DB;
+	return level >= UINT8_MAX ? UINT8_MAX : (uint8_t) level;
+}
+
+double dequantise_decibels(uint8_t level) {
+	return (double) level / HISTORY_STEPS_PER_DB;
+}
+
+// Adds the spectrum as the newest row, overwriting the oldest once full
+// Smaller spectra (i.e from a smaller FFT) are stretched across the row, so every row covers the same frequencies
+void push_history(spectrum_history_t* history, complex_set_t* spectrum) {
+	uint8_t* row = history -> rows + ((history -> count % history -> capacity) * history -> bins);
+	int data_size = spectrum -> data_size;
+	for (int i=0; i < history -> bins; i++) {
+		int bin = data_size < history -> bins ? (int) (((long) i * data_size) / history -> bins) : i;
+		row[i] = data_size > 0 ? quantise_decibels(spectrum -> complex_numbers[bin].decibels) : 0;
+	}
+	history -> count++;
+}
+
+// The number of rows currently held
+int history_size(spectrum_history_t* history) {
+	return history -> count < (unsigned long) history -> capacity ? (int) history -> count : history -> capacity;
+}
+
+// Returns a row by age, 0 being the newest, or NULL if we don't have a row that old
+const uint8_t* history_row(spectrum_history_t* history, int age) {
+	if (age < 0 || age >= history_size(history)) return NULL;
+	unsigned long index = (history -> count - 1 - age) % history -> capacity;
+	return history -> rows + (index * history -> bins);
+}
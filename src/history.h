@@ -0,0 +1,29 @@
+#pragma once
+// A fixed-size ring of past spectra, each quantised to one byte per bin
+// Used to show how the spectrum changes over time i.e the waterfall view
+
+#include <stdint.h>
+#include <shared.h>
+
+// ~17 minutes of history at 1 spectrum per 1024 samples
+#define HISTORY_ROWS 1024
+#define HISTORY_BINS (NUM_SAMPLES/2)
+// Quantisation steps per decibel, a byte covers 0 to 127.5dB
+#define HISTORY_STEPS_PER_DB 2
+
+typedef struct spectrum_history {
+	// capacity rows of bins levels, oldest rows are overwritten
+	uint8_t* rows;
+	int capacity;
+	int bins;
+	// Total number of rows ever pushed, the newest row is at (count-1) % capacity
+	unsigned long count;
+} spectrum_history_t;
+
+int init_history(spectrum_history_t* history, int capacity, int bins);
+void free_history(spectrum_history_t* history);
+uint8_t quantise_decibels(double decibels);
+double dequantise_decibels(uint8_t level);
+void push_history(spectrum_history_t* history, complex_set_t* spectrum);
+int history_size(spectrum_history_t* history);
+const uint8_t* history_row(spectrum_history_t* history, int age);
@@ -0,0 +1,109 @@
+#include <stdio.h>
+
+#include <latency.h>
+#include <perf_counters.h>
+#include <shared.h>
+#include <log.h>
+
+latency_histogram_t latency_histograms[LATENCY_STAGE_COUNT];
+
+// Which bucket a latency falls in, anything beyond the last bucket goes in it
+int latency_bucket(uint64_t ns) {
+	if (ns < (1UL << LATENCY_MIN_SHIFT)) return 0;
+	int highest_bit = 63 - __builtin_clzll(ns);
+	// The 2 bits below the highest pick the quarter of the doubling
+	int quarter = (ns >> (highest_bit - 2)) & (LATENCY_BUCKETS_PER_DOUBLING - 1);
+	int bucket = 1 + ((highest_bit - LATENCY_MIN_SHIFT) * LATENCY_BUCKETS_PER_DOUBLING) + quarter;
+	return bucket < LATENCY_BUCKET_COUNT ? bucket : LATENCY_BUCKET_COUNT - 1;
+}
+
+// The (exclusive) upper limit of a bucket
+uint64_t latency_bucket_limit_ns(int bucket) {
+	if (bucket == 0) return 1UL << LATENCY_MIN_SHIFT;
+	int doubling = (bucket - 1) / LATENCY_BUCKETS_PER_DOUBLING;
+	int quarter = (bucket - 1) % LATENCY_BUCKETS_PER_DOUBLING;
+	return ((1UL << (LATENCY_MIN_SHIFT + doubling)) / LATENCY_BUCKETS_PER_DOUBLING) * (LATENCY_BUCKETS_PER_DOUBLING + quarter + 1);
+}
+
+void record_latency(latency_stage_t stage, uint64_t ns) {
+	latency_histogram_t* histogram = &latency_histograms[stage];
+	atomic_fetch_add_explicit(&histogram -> buckets[latency_bucket(ns)], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&histogram -> count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&histogram -> total_ns, ns, memory_order_relaxed);
+	uint64_t max_ns = atomic_load_explicit(&histogram -> max_ns, memory_order_relaxed);
+	while (ns > max_ns && !atomic_compare_exchange_weak_explicit(&histogram -> max_ns, &max_ns, ns, memory_order_relaxed, memory_order_relaxed));
+}
+
+// Marks the start of a stage on the calling thread
+// Returns the time now, to pass to end_stage
+uint64_t begin_stage() {
+	snapshot_perf_counters();
+	return get_monotonic_ns();
+}
+
+// Records the time since start_ns (and any hardware counters since the stage began) against the stage
+// Returns the time now, to start the next stage from
+uint64_t end_stage(latency_stage_t stage, uint64_t start_ns) {
+	uint64_t now_ns = get_monotonic_ns();
+	record_latency(stage, now_ns - start_ns);
+	record_perf_counters(stage);
+	return now_ns;
+}
+
+// Percentiles are the upper limit of the bucket they fall in, but never beyond the max seen
+void summarise_latency(latency_stage_t stage, latency_summary_t* summary) {
+	latency_histogram_t* histogram = &latency_histograms[stage];
+	uint64_t buckets[LATENCY_BUCKET_COUNT];
+	uint64_t count = 0;
+	for (int i=0; i < LATENCY_BUCKET_COUNT; i++) {
+		buckets[i] = atomic_load_explicit(&histogram -> buckets[i], memory_order_relaxed);
+		count += buckets[i];
+	}
+	summary -> count = count;
+	summary -> mean_ns = count > 0 ? atomic_load_explicit(&histogram -> total_ns, memory_order_relaxed) / count : 0;
+	summary -> max_ns = atomic_load_explicit(&histogram -> max_ns, memory_order_relaxed);
+	uint64_t* percentiles[] = {&summary -> p50_ns, &summary -> p95_ns, &summary -> p99_ns};
+	const double ranks[] = {0.50, 0.95, 0.99};
+	for (int p=0; p < 3; p++) {
+		*percentiles[p] = 0;
+		if (count == 0) continue;
+		// The first bucket holding the ranked sample
+		uint64_t rank = (uint64_t) (ranks[p] * count);
+		if (rank == 0) rank = 1;
+		uint64_t seen = 0;
+		for (int i=0; i < LATENCY_BUCKET_COUNT; i++) {
+			seen += buckets[i];
+			if (seen >= rank) {
+				uint64_t limit_ns = latency_bucket_limit_ns(i);
+				*percentiles[p] = limit_ns < summary -> max_ns ? limit_ns : summary -> max_ns;
+				break;
+			}
+		}
+	}
+}
+
+// Writes each stage's percentiles and the counts in each of its buckets
+// Returns 0 on success, 1 on failure
+int dump_latency(const char* path) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		log_warn("Failed to open latency file: %s\n", path);
+		return 1;
+	}
+	fprintf(file, "%-10s %10s %10s %10s %10s %10s %10s\n", "stage", "count", "mean_ms", "p50_ms", "p95_ms", "p99_ms", "max_ms");
+	for (int stage=0; stage < LATENCY_STAGE_COUNT; stage++) {
+		latency_summary_t summary;
+		summarise_latency(stage, &summary);
+		fprintf(file, "%-10s %10lu %10.3f %10.3f %10.3f %10.3f %10.3f\n", LATENCY_STAGE_NAMES[stage], (unsigned long) summary.count,
+			summary.mean_ns / 1e6, summary.p50_ns / 1e6, summary.p95_ns / 1e6, summary.p99_ns / 1e6, summary.max_ns / 1e6);
+	}
+	fprintf(file, "\n%-10s %10s %10s\n", "stage", "below_ms", "count");
+	for (int stage=0; stage < LATENCY_STAGE_COUNT; stage++) {
+		for (int i=0; i < LATENCY_BUCKET_COUNT; i++) {
+			uint64_t count = atomic_load_explicit(&latency_histograms[stage].buckets[i], memory_order_relaxed);
+			if (count == 0) continue;
+			fprintf(file, "%-10s %10.3f %10lu\n", LATENCY_STAGE_NAMES[stage], latency_bucket_limit_ns(i) / 1e6, (unsigned long) count);
+		}
+	}
+	return fclose(file) == 0 ? 0 : 1;
+}
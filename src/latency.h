@@ -0,0 +1,54 @@
+#pragma once
+// Latency histograms for each stage of getting a spectrum on screen
+// Fixed log-scale buckets, 4 per doubling from 1us up to ~17s, so percentiles are within 25%
+// Recording is a couple of relaxed atomic adds, stages are recorded from both the analysis and render threads
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Bucket 0 is everything under 2^LATENCY_MIN_SHIFT ns
+#define LATENCY_MIN_SHIFT 10
+#define LATENCY_BUCKETS_PER_DOUBLING 4
+#define LATENCY_DOUBLINGS 24
+#define LATENCY_BUCKET_COUNT (1 + (LATENCY_DOUBLINGS * LATENCY_BUCKETS_PER_DOUBLING))
+#define LATENCY_DEFAULT_PATH "latency.txt"
+
+typedef enum latency_stage {
+	// Waiting for PulseAudio (or the replay) to give us a buffer of samples
+	LATENCY_CAPTURE,
+	LATENCY_CONVERT,
+	LATENCY_FFT,
+	// The nyquist filter and magnitudes
+	LATENCY_MAGNITUDE,
+	// Drawing and refreshing the terminal
+	LATENCY_DRAW,
+	LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+typedef struct latency_histogram {
+	_Atomic uint64_t buckets[LATENCY_BUCKET_COUNT];
+	_Atomic uint64_t count;
+	_Atomic uint64_t total_ns;
+	_Atomic uint64_t max_ns;
+} latency_histogram_t;
+
+typedef struct latency_summary {
+	uint64_t count;
+	uint64_t mean_ns;
+	uint64_t p50_ns;
+	uint64_t p95_ns;
+	uint64_t p99_ns;
+	uint64_t max_ns;
+} latency_summary_t;
+
+static const char* const LATENCY_STAGE_NAMES[] = {"capture", "convert", "fft", "magnitude", "draw"};
+
+extern latency_histogram_t latency_histograms[LATENCY_STAGE_COUNT];
+
+int latency_bucket(uint64_t ns);
+uint64_t latency_bucket_limit_ns(int bucket);
+void record_latency(latency_stage_t stage, uint64_t ns);
+uint64_t begin_stage();
+uint64_t end_stage(latency_stage_t stage, uint64_t start_ns);
+void summarise_latency(latency_stage_t stage, latency_summary_t* summary);
+int dump_latency(const char* path);
@@ -0,0 +1,155 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <log.h>
+
+static const char* LOG_LEVEL_NAMES[] = {"ERROR", "WARN", "INFO", "DEBUG", "TRACE"};
+
+log_level_t log_level = DEFAULT_LOG_LEVEL;
+
+// A bounded multi-producer queue, each slot's sequence says whose turn it is:
+// sequence == position, free for the producer claiming position
+// sequence == position + 1, holds a message for the writer
+typedef struct log_slot {
+	_Atomic size_t sequence;
+	log_level_t level;
+	char text[LOG_MESSAGE_MAX];
+} log_slot_t;
+
+static log_slot_t log_queue[LOG_QUEUE_SIZE];
+static _Atomic size_t enqueue_position = 0;
+static size_t dequeue_position = 0;
+static _Atomic unsigned long dropped_messages = 0;
+static _Atomic bool writer_running = false;
+static pthread_t writer_thread;
+
+// Accepts error, warn, info, debug or trace (any case)
+log_level_t parse_log_level(const char* name, log_level_t fallback) {
+	if (name == NULL) return fallback;
+	for (int i=0; i <= LOG_TRACE; i++) {
+		if (strcasecmp(name, LOG_LEVEL_NAMES[i]) == 0) return i;
+	}
+	return fallback;
+}
+
+void set_log_level(log_level_t level) {
+	log_level = level;
+}
+
+// Claims a free slot, returns NULL if the queue is full
+static log_slot_t* claim_slot() {
+	size_t position = atomic_load_explicit(&enqueue_position, memory_order_relaxed);
+	while (true) {
+		log_slot_t* slot = &log_queue[position % LOG_QUEUE_SIZE];
+		size_t sequence = atomic_load_explicit(&slot -> sequence, memory_order_acquire);
+		if (sequence == position) {
+			if (atomic_compare_exchange_weak_explicit(&enqueue_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+				return slot;
+			}
+		} else if (sequence < position) {
+			// The writer hasn't emptied this slot yet
+			return NULL;
+		} else {
+			position = atomic_load_explicit(&enqueue_position, memory_order_relaxed);
+		}
+	}
+}
+
+static void write_message(FILE* logfile, log_level_t level, const char* text) {
+	fprintf(logfile, "[%s] %s", LOG_LEVEL_NAMES[level], text);
+	size_t length = strlen(text);
+	if (length == 0 || text[length - 1] != '\n') fputc('\n', logfile);
+}
+
+// Writes out queued messages, returns how many were written
+static int drain_queue(FILE* logfile) {
+	int written = 0;
+	while (true) {
+		log_slot_t* slot = &log_queue[dequeue_position % LOG_QUEUE_SIZE];
+		size_t sequence = atomic_load_explicit(&slot -> sequence, memory_order_acquire);
+		if (sequence != dequeue_position + 1) break;
+		write_message(logfile, slot -> level, slot -> text);
+		// Free the slot for the producer one lap later
+		atomic_store_explicit(&slot -> sequence, dequeue_position + LOG_QUEUE_SIZE, memory_order_release);
+		dequeue_position++;
+		written++;
+	}
+	unsigned long dropped = atomic_exchange(&dropped_messages, 0);
+	if (dropped > 0) {
+		fprintf(logfile, "[WARN] Log queue was full, dropped %lu messages\n", dropped);
+	}
+	return written;
+}
+
+void* log_writer_thread(void* userdata) {
+	FILE* logfile = get_logfile();
+	struct timespec writer_sleep = {0, LOG_WRITER_SLEEP_NS};
+	while (atomic_load(&writer_running)) {
+		if (drain_queue(logfile) > 0) {
+			fflush(logfile);
+		} else {
+			nanosleep(&writer_sleep, NULL);
+		}
+	}
+	drain_queue(logfile);
+	fflush(logfile);
+	return NULL;
+}
+
+// Starts the writer thread, until then messages are written straight to the logfile
+// Returns 0 on success, 1 if the thread couldn't be started
+int start_logging() {
+	for (size_t i=0; i < LOG_QUEUE_SIZE; i++) {
+		atomic_store(&log_queue[i].sequence, i);
+	}
+	atomic_store(&enqueue_position, 0);
+	dequeue_position = 0;
+	atomic_store(&writer_running, true);
+	if (pthread_create(&writer_thread, NULL, log_writer_thread, NULL) != 0) {
+		atomic_store(&writer_running, false);
+		return 1;
+	}
+	return 0;
+}
+
+// Writes out anything still queued, then stops the writer and closes the logfile
+void stop_logging() {
+	if (atomic_exchange(&writer_running, false)) {
+		pthread_join(writer_thread, NULL);
+	}
+	close_logfile();
+}
+
+void log_message(log_level_t level, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	if (!atomic_load_explicit(&writer_running, memory_order_relaxed)) {
+		// Nothing to hand it to, e.g during startup or in the tests
+		char text[LOG_MESSAGE_MAX];
+		vsnprintf(text, sizeof(text), format, args);
+		write_message(get_logfile(), level, text);
+	} else {
+		log_slot_t* slot = claim_slot();
+		if (slot == NULL) {
+			atomic_fetch_add_explicit(&dropped_messages, 1, memory_order_relaxed);
+		} else {
+			slot -> level = level;
+			vsnprintf(slot -> text, LOG_MESSAGE_MAX, format, args);
+			size_t position = atomic_load_explicit(&slot -> sequence, memory_order_relaxed);
+			atomic_store_explicit(&slot -> sequence, position + 1, memory_order_release);
+		}
+	}
+	va_end(args);
+}
+
+// Logs each value of the set on a line of its own
+void log_data(log_level_t level, complex_set_t* samples) {
+	if (!log_enabled(level)) return;
+	for (int i=0; i < samples -> data_size; i++) {
+		complex_wrapper_t wrapper = samples -> complex_numbers[i];
+		log_message(level, "(%d) Real: %.2f, Imaginary: %+.2fi, Magnitude: %.2f, Decibels: %.2f\n", i, creal(wrapper.complex_number), cimag(wrapper.complex_number), wrapper.magnitude, wrapper.decibels);
+	}
+}
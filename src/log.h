@@ -0,0 +1,45 @@
+#pragma once
+// Levelled logging to purses.log, written out by a background thread
+// Callers only format their message into a lock-free queue, so logging never blocks capture or rendering
+// Messages above the current level cost a comparison, and above LOG_COMPILED_LEVEL they're compiled out
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <shared.h>
+
+typedef enum log_level {
+	LOG_ERROR,
+	LOG_WARN,
+	LOG_INFO,
+	LOG_DEBUG,
+	// Per sample/fragment detail, only built in with -DLOG_COMPILED_LEVEL=LOG_TRACE
+	LOG_TRACE
+} log_level_t;
+
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL LOG_DEBUG
+#endif
+#define DEFAULT_LOG_LEVEL LOG_WARN
+
+// Queued messages, the queue is dropped from rather than waited on when full
+#define LOG_QUEUE_SIZE 1024
+#define LOG_MESSAGE_MAX 240
+// How often the writer checks the queue once it's empty
+#define LOG_WRITER_SLEEP_NS 10000000
+
+extern log_level_t log_level;
+
+#define log_enabled(level) ((level) <= LOG_COMPILED_LEVEL && (level) <= log_level)
+#define log_at(level, ...) do { if (log_enabled(level)) log_message(level, __VA_ARGS__); } while (0)
+#define log_error(...) log_at(LOG_ERROR, __VA_ARGS__)
+#define log_warn(...) log_at(LOG_WARN, __VA_ARGS__)
+#define log_info(...) log_at(LOG_INFO, __VA_ARGS__)
+#define log_debug(...) log_at(LOG_DEBUG, __VA_ARGS__)
+#define log_trace(...) log_at(LOG_TRACE, __VA_ARGS__)
+
+log_level_t parse_log_level(const char* name, log_level_t fallback);
+void set_log_level(log_level_t level);
+int start_logging();
+void stop_logging();
+void log_message(log_level_t level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+void log_data(log_level_t level, complex_set_t* samples);
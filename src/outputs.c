@@ -0,0 +1,60 @@
+#include <outputs.h>
+
+// Opens the outputs enabled in the config
+// Returns 0 on success, 1 if an enabled output couldn't be opened
+int open_outputs(spectrum_outputs_t* outputs, purses_config_t* config) {
+	outputs -> shm_enabled = false;
+	outputs -> server_enabled = false;
+	outputs -> recorder_enabled = false;
+	if (config -> shm_name != NULL) {
+		if (open_shm_publisher(&outputs -> shm, config -> shm_name) != 0) return 1;
+		outputs -> shm_enabled = true;
+	}
+	if (config -> socket_path != NULL) {
+		if (start_spectrum_server(&outputs -> server, config -> socket_path) != 0) {
+			close_outputs(outputs);
+			return 1;
+		}
+		outputs -> server_enabled = true;
+	}
+	if (config -> record_path != NULL) {
+		uint64_t max_bytes = (uint64_t) config -> record_max_mb * 1024 * 1024;
+		if (start_recorder(&outputs -> recorder, config -> record_path, MAX_SAMPLE_RATE, max_bytes, config -> record_max_seconds) != 0) {
+			close_outputs(outputs);
+			return 1;
+		}
+		outputs -> recorder_enabled = true;
+	}
+	return 0;
+}
+
+void publish_outputs(spectrum_outputs_t* outputs, complex_set_t* spectrum, uint64_t sequence) {
+	if (outputs -> shm_enabled) {
+		publish_shm_spectrum(&outputs -> shm, spectrum, sequence, get_realtime_ns());
+	}
+	if (outputs -> server_enabled) {
+		offer_spectrum(&outputs -> server, spectrum, sequence);
+	}
+}
+
+// Passes on the captured samples, e.g to be recorded
+void publish_outputs_pcm(spectrum_outputs_t* outputs, const int16_t* samples, int sample_count) {
+	if (outputs -> recorder_enabled) {
+		record_pcm(&outputs -> recorder, samples, sample_count);
+	}
+}
+
+void close_outputs(spectrum_outputs_t* outputs) {
+	if (outputs -> shm_enabled) {
+		close_shm_publisher(&outputs -> shm);
+		outputs -> shm_enabled = false;
+	}
+	if (outputs -> server_enabled) {
+		stop_spectrum_server(&outputs -> server);
+		outputs -> server_enabled = false;
+	}
+	if (outputs -> recorder_enabled) {
+		stop_recorder(&outputs -> recorder);
+		outputs -> recorder_enabled = false;
+	}
+}
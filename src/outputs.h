@@ -0,0 +1,23 @@
+#pragma once
+// Everywhere outside of purses that each new spectrum (and the samples behind it) is published to
+// Published from the analysis thread, so every spectrum goes out regardless of the frame rate
+
+#include <config.h>
+#include <shared.h>
+#include <shm/shm_publisher.h>
+#include <server/spectrum_server.h>
+#include <recorder.h>
+
+typedef struct spectrum_outputs {
+	bool shm_enabled;
+	shm_publisher_t shm;
+	bool server_enabled;
+	spectrum_server_t server;
+	bool recorder_enabled;
+	pcm_recorder_t recorder;
+} spectrum_outputs_t;
+
+int open_outputs(spectrum_outputs_t* outputs, purses_config_t* config);
+void publish_outputs(spectrum_outputs_t* outputs, complex_set_t* spectrum, uint64_t sequence);
+void publish_outputs_pcm(spectrum_outputs_t* outputs, const int16_t* samples, int sample_count);
+void close_outputs(spectrum_outputs_t* outputs);
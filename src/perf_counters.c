@@ -0,0 +1,131 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <perf_counters.h>
+#include <log.h>
+
+static const uint64_t PERF_EVENT_CONFIGS[] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES
+};
+
+perf_stage_counters_t perf_stage_counters[LATENCY_STAGE_COUNT];
+
+static atomic_bool enabled = false;
+// Set once any thread has opened the counter, so an unsupported one shows as unavailable rather than 0
+static atomic_bool counter_available[PERF_COUNTER_COUNT];
+
+// The calling thread's group, values are read in the order the counters were opened
+static __thread int group_fd = -1;
+static __thread int counter_fds[PERF_COUNTER_COUNT] = {-1, -1, -1, -1};
+static __thread int opened_count = 0;
+static __thread uint64_t last_values[PERF_COUNTER_COUNT];
+
+// Counters are only opened by threads once this has been called (from the config)
+void enable_perf_counters() {
+	atomic_store(&enabled, true);
+}
+
+bool perf_counters_enabled() {
+	return atomic_load(&enabled);
+}
+
+static int open_counter(uint64_t config, int group) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.read_format = PERF_FORMAT_GROUP;
+	// The leader starts disabled, and enables the whole group once it's complete
+	attr.disabled = group == -1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+// Reads the group into values, in perf_counter_t order (unopened counters are left alone)
+// Returns 0 on success, 1 on failure
+static int read_group(uint64_t values[PERF_COUNTER_COUNT]) {
+	uint64_t buffer[1 + PERF_COUNTER_COUNT];
+	ssize_t size = read(group_fd, buffer, sizeof(buffer));
+	if (size < (ssize_t) sizeof(uint64_t) || buffer[0] != (uint64_t) opened_count) return 1;
+	int index = 1;
+	for (int i=0; i < PERF_COUNTER_COUNT; i++) {
+		if (counter_fds[i] != -1) values[i] = buffer[index++];
+	}
+	return 0;
+}
+
+// Opens the counters for the calling thread, a no-op unless they've been enabled
+// Counters the PMU doesn't have are skipped
+// Returns 0 if at least one counter was opened, 1 otherwise
+int open_thread_perf_counters() {
+	if (!perf_counters_enabled() || group_fd != -1) return group_fd != -1 ? 0 : 1;
+	for (int i=0; i < PERF_COUNTER_COUNT; i++) {
+		int fd = open_counter(PERF_EVENT_CONFIGS[i], group_fd);
+		if (fd == -1) {
+			log_info("Hardware counter %s is unavailable, error: %s\n", PERF_COUNTER_NAMES[i], strerror(errno));
+			continue;
+		}
+		if (group_fd == -1) group_fd = fd;
+		counter_fds[i] = fd;
+		opened_count++;
+		atomic_store(&counter_available[i], true);
+	}
+	if (group_fd == -1) {
+		log_warn("No hardware counters could be opened, perf_event_paranoid may need lowering\n");
+		return 1;
+	}
+	ioctl(group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	read_group(last_values);
+	return 0;
+}
+
+void close_thread_perf_counters() {
+	for (int i=0; i < PERF_COUNTER_COUNT; i++) {
+		if (counter_fds[i] != -1) close(counter_fds[i]);
+		counter_fds[i] = -1;
+	}
+	group_fd = -1;
+	opened_count = 0;
+}
+
+// Marks the start of a stage on the calling thread
+void snapshot_perf_counters() {
+	if (group_fd == -1) return;
+	read_group(last_values);
+}
+
+// Adds the counts since the last snapshot (or stage) on the calling thread to the stage
+void record_perf_counters(latency_stage_t stage) {
+	if (group_fd == -1) return;
+	uint64_t values[PERF_COUNTER_COUNT];
+	memcpy(values, last_values, sizeof(values));
+	if (read_group(values) != 0) return;
+	perf_stage_counters_t* counters = &perf_stage_counters[stage];
+	for (int i=0; i < PERF_COUNTER_COUNT; i++) {
+		atomic_fetch_add_explicit(&counters -> totals[i], values[i] - last_values[i], memory_order_relaxed);
+	}
+	atomic_fetch_add_explicit(&counters -> samples, 1, memory_order_relaxed);
+	memcpy(last_values, values, sizeof(values));
+}
+
+void summarise_perf_counters(latency_stage_t stage, perf_summary_t* summary) {
+	perf_stage_counters_t* counters = &perf_stage_counters[stage];
+	summary -> samples = atomic_load_explicit(&counters -> samples, memory_order_relaxed);
+	for (int i=0; i < PERF_COUNTER_COUNT; i++) {
+		summary -> available[i] = atomic_load(&counter_available[i]);
+		uint64_t total = atomic_load_explicit(&counters -> totals[i], memory_order_relaxed);
+		summary -> means[i] = summary -> samples > 0 ? (double) total / summary -> samples : 0;
+	}
+	bool has_ipc = summary -> available[PERF_CYCLES] && summary -> available[PERF_INSTRUCTIONS] && summary -> means[PERF_CYCLES] > 0;
+	summary -> ipc = has_ipc ? summary -> means[PERF_INSTRUCTIONS] / summary -> means[PERF_CYCLES] : 0;
+}
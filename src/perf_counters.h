@@ -0,0 +1,44 @@
+#pragma once
+// Optional hardware counters around each pipeline stage, enabled with PURSES_PERF_COUNTERS=1
+// Each thread that records stages opens its own perf_event_open group, counting user space only so no privileges are needed
+// Threads without a group (or on a box without a PMU, e.g most VMs) record nothing, and the counters show as unavailable
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <latency.h>
+
+typedef enum perf_counter {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_COUNTER_COUNT
+} perf_counter_t;
+
+static const char* const PERF_COUNTER_NAMES[] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+typedef struct perf_stage_counters {
+	_Atomic uint64_t samples;
+	_Atomic uint64_t totals[PERF_COUNTER_COUNT];
+} perf_stage_counters_t;
+
+// Means per time the stage ran, a counter the PMU doesn't have is left at 0 and marked unavailable
+typedef struct perf_summary {
+	uint64_t samples;
+	bool available[PERF_COUNTER_COUNT];
+	double means[PERF_COUNTER_COUNT];
+	// Instructions per cycle, 0 without both counters
+	double ipc;
+} perf_summary_t;
+
+extern perf_stage_counters_t perf_stage_counters[LATENCY_STAGE_COUNT];
+
+void enable_perf_counters();
+bool perf_counters_enabled();
+int open_thread_perf_counters();
+void close_thread_perf_counters();
+void snapshot_perf_counters();
+void record_perf_counters(latency_stage_t stage);
+void summarise_perf_counters(latency_stage_t stage, perf_summary_t* summary);
@@ -1,4 +1,7 @@
+#include <string.h>
+
 #include <processing.h>
+#include <log.h>
 
 /**
  * Due to the Nyquist frequency (half of the sampling rate)
@@ -55,13 +58,13 @@ void dft(complex_set_t* x, complex_set_t* X) {
 	if (N == 1) {
 		double complex x0 = x -> complex_numbers[0].complex_number;
 		X -> complex_numbers[0].complex_number = x0;
-		//fprintf(logfile, "(Output 0/0) Real: %02f, Imaginary: %02f\n", creal(x0), cimag(x0));
+		//log_trace("(Output 0/0) Real: %02f, Imaginary: %02f\n", creal(x0), cimag(x0));
 		return;
 	}
 
 	// Output index (k)
 	for (int k=0; k < N; k++) {
-		//fprintf(logfile, "DFT output (%d)...\n", k);
+		//log_trace("DFT output (%d)...\n", k);
 
 		// Initialise output (X[k])
 		double complex output = CMPLX(0.0,0.0);
@@ -81,12 +84,12 @@ void dft(complex_set_t* x, complex_set_t* X) {
 			double rads = (2*M_PI/N)*k*n;
 			double real_inc = (real_xn * cos(rads)) + (im_xn * sin(rads));
 			double imag_inc = (-real_xn * sin(rads)) + (im_xn * cos(rads));
-			//fprintf(logfile, "(Output %d/%d) Input Rads: %02f Real: %02f, Imaginary: %02f\n", k, n, rads, real_inc, imag_inc);
+			//log_trace("(Output %d/%d) Input Rads: %02f Real: %02f, Imaginary: %02f\n", k, n, rads, real_inc, imag_inc);
 
 			// Increment X[k] value
 			output += CMPLX(real_inc, imag_inc);
 		}
-		//fprintf(logfile, "(Summation Output %d/%d) Real: %02f, Imaginary: %02f\n", k+1, N, creal(output), cimag(output));
+		//log_trace("(Summation Output %d/%d) Real: %02f, Imaginary: %02f\n", k+1, N, creal(output), cimag(output));
 		X -> complex_numbers[k].complex_number = output;
     X -> sample_rate = x -> sample_rate;
 	}
@@ -98,55 +101,94 @@ complex_set_t* malloc_complex_set(complex_set_t** set, int sample_count, int sam
 		(*set)  -> data_size = sample_count;
 		(*set)  -> complex_numbers = (complex_wrapper_t*) malloc(sizeof(complex_wrapper_t) * sample_count);
 		(*set)  -> sample_rate = sample_rate;
+		(*set)  -> frequency = sample_rate;
+		(*set)  -> has_data = false;
 		return (*set);
 }
 
-complex_set_t* build_complex_set(record_stream_data_t* record_data, int sample_count, int sample_rate) {
-		FILE* logfile = get_logfile();
-		complex_set_t* output_set = 0;
-		malloc_complex_set(&output_set, sample_count, sample_rate);
+void free_complex_set(complex_set_t* set) {
+	if (set == NULL) return;
+	free(set -> complex_numbers);
+	free(set);
+}
+
+// Converts samples into an existing set with room for sample_count values, without allocating
+void fill_complex_set(complex_set_t* output_set, const int16_t* samples, int sample_count) {
 		complex_wrapper_t* data = output_set -> complex_numbers;
 		// Convert samples to Complex numbers
     int nozero_samples = 0;
 		for (int i=0; i < sample_count; i++) {
-			int16_t sample = record_data -> data[i];
+			int16_t sample = samples[i];
       data[i].magnitude = 0.00;
       if (sample > 0) {
-        fprintf(logfile, "Read sample (%d) : %d\n", i, sample);
+        log_trace("Read sample (%d) : %d\n", i, sample);
         data[i].complex_number = CMPLX((double) sample, 0.00);
         nozero_samples++;
       } else {
         data[i].complex_number = CMPLX(0.00, 0.00);
       }
 		}
-    if (!output_set -> has_data) output_set -> has_data = nozero_samples > 0;
-		return output_set;
+    output_set -> data_size = sample_count;
+    output_set -> has_data = nozero_samples > 0;
+}
+
+// Converts samples from anywhere (e.g a mapped file) without copying them in to a record_stream_data_t first
+complex_set_t* samples_to_complex_set(const int16_t* samples, int sample_count, int sample_rate) {
+	complex_set_t* output_set = 0;
+	malloc_complex_set(&output_set, sample_count, sample_rate);
+	fill_complex_set(output_set, samples, sample_count);
+	return output_set;
+}
+
+complex_set_t* build_complex_set(record_stream_data_t* record_data, int sample_count, int sample_rate) {
+	return samples_to_complex_set(record_data -> data, sample_count, sample_rate);
 }
 
 /**
  * Initialises output_set from the record_stream
  */
 complex_set_t* record_stream_to_complex_set(record_stream_data_t* record_stream) {
-	FILE* logfile = get_logfile();
 	unsigned int size_n = record_stream -> data_size;
 
 	int power_of_two = (size_n > 1 && (size_n%2) != 0);
 
 	// Check for N power of 2
 	if (size_n == 0 || power_of_two) {
-		fprintf(logfile, "Cannot perform radix-2 processing if input data size if not a power of 2!, received data size: %d\n", size_n);
+		log_error("Cannot perform radix-2 processing if input data size if not a power of 2!, received data size: %d\n", size_n);
 		return NULL;
 	}
 
 	complex_set_t* output_set = 0;
 	output_set = build_complex_set(record_stream, size_n, MAX_SAMPLE_RATE);
-	fprintf(logfile, "Done converting record stream to data set.\n");
-	fprintf(logfile, "Data set size: %d\n", output_set -> data_size);
-	fprintf(logfile, "Data set sample rate: %dHz\n", MAX_SAMPLE_RATE);
+	log_debug("Done converting record stream to data set.\n");
+	log_debug("Data set size: %d\n", output_set -> data_size);
+	log_debug("Data set sample rate: %dHz\n", MAX_SAMPLE_RATE);
 
 	return output_set;
 }
 
+// Scratch space for the half-size sets, kept per thread and only ever grown, so repeated transforms don't allocate
+static __thread complex_wrapper_t* fft_scratch = NULL;
+static __thread int fft_scratch_size = 0;
+
+// Returns room for at least size values, or NULL if the scratch space couldn't be grown
+static complex_wrapper_t* get_fft_scratch(int size) {
+	if (size > fft_scratch_size) {
+		complex_wrapper_t* grown = realloc(fft_scratch, sizeof(complex_wrapper_t) * size);
+		if (grown == NULL) return NULL;
+		fft_scratch = grown;
+		fft_scratch_size = size;
+	}
+	return fft_scratch;
+}
+
+// Frees the calling thread's FFT scratch space, for threads that are done transforming
+void free_fft_scratch() {
+	free(fft_scratch);
+	fft_scratch = NULL;
+	fft_scratch_size = 0;
+}
+
 // Splits data into an N/2 even and odd set
 // Performs a DFT on each set
 // Recombines the outputs into output_data
@@ -156,40 +198,38 @@ void half_size_dfts(complex_set_t* input_data, complex_set_t* output_data, int h
 	if (half_size < 1) {
 		return;
 	}
-	//fprintf(logfile, "=== Performing half-size DFTs of size: %d \n", half_size);
+	//log_trace("=== Performing half-size DFTs of size: %d \n", half_size);
+	complex_wrapper_t* scratch = get_fft_scratch(half_size * 4);
+	if (scratch == NULL) {
+		log_error("Failed to allocate FFT scratch space for %d samples!\n", half_size * 2);
+		return;
+	}
 
 	// 1. Separate input into an N/2 even and odd set
-	complex_set_t* even_set = 0;
-	complex_set_t* odd_set = 0;
-	malloc_complex_set(&even_set, half_size, sample_rate);
-	malloc_complex_set(&odd_set, half_size, sample_rate);
+	complex_set_t even_set = {.complex_numbers = scratch, .data_size = half_size, .sample_rate = sample_rate};
+	complex_set_t odd_set = {.complex_numbers = scratch + half_size, .data_size = half_size, .sample_rate = sample_rate};
 	complex_wrapper_t* input_nums = input_data -> complex_numbers;
 	for (int i=0; i < half_size; i++) {
 		int even_i = i*2;
 		int odd_i = even_i+1;
-		//fprintf(logfile, "Splitting on Odd: %d, Even: %d\n", odd_i, even_i);
-		even_set -> complex_numbers[i] = input_nums[even_i];
-		odd_set -> complex_numbers[i] = input_nums[odd_i];
+		//log_trace("Splitting on Odd: %d, Even: %d\n", odd_i, even_i);
+		even_set.complex_numbers[i] = input_nums[even_i];
+		odd_set.complex_numbers[i] = input_nums[odd_i];
 	}
 
 	// 2. Perform DFT on each (2 DFTs of size half_size)
-	complex_set_t* even_out_set = 0;
-	complex_set_t* odd_out_set = 0;
-	malloc_complex_set(&even_out_set, half_size, sample_rate);
-	malloc_complex_set(&odd_out_set, half_size, sample_rate);
+	complex_set_t even_out_set = {.complex_numbers = scratch + (half_size * 2), .data_size = half_size, .sample_rate = sample_rate};
+	complex_set_t odd_out_set = {.complex_numbers = scratch + (half_size * 3), .data_size = half_size, .sample_rate = sample_rate};
 
-	half_size_dfts(even_set, even_out_set, half_size/2);
-	half_size_dfts(odd_set, odd_out_set, half_size/2);
-
-	//fprintf(logfile, "=== Performing Even-indexed DFT of size: %d\n", half_size);
-	dft (even_set, even_out_set);
-	//fprintf(logfile, "=== Performing Odd-indexed DFT of size: %d\n", half_size);
-	dft (odd_set, odd_out_set);
+	//log_trace("=== Performing Even-indexed DFT of size: %d\n", half_size);
+	dft (&even_set, &even_out_set);
+	//log_trace("=== Performing Odd-indexed DFT of size: %d\n", half_size);
+	dft (&odd_set, &odd_out_set);
 
 	// Recombine the split sets into the output set
 	complex_wrapper_t* output_nums = output_data -> complex_numbers;
 	unsigned int size_n = input_data -> data_size;
-	//fprintf(logfile, "=== Recombining half-size Even/Odd DFTs of size: %d\n", half_size);
+	//log_trace("=== Recombining half-size Even/Odd DFTs of size: %d\n", half_size);
 	for (int k=0; k < half_size; k++) {
 		// Calculate the Twiddle Factor (e(−2πi k/N))
 		// Now for Eueler's formula (for any real number x, given as radians)
@@ -197,8 +237,8 @@ void half_size_dfts(complex_set_t* input_data, complex_set_t* output_data, int h
 		double rads = -2*M_PI*k/size_n;
 		// Twiddle factor: e(−2πi k/N) = cos(x) + i*sin(x)
 		double complex twiddle = CMPLX(cos(rads), sin(rads));
-		double complex even = even_out_set -> complex_numbers[k].complex_number;
-		double complex odd  = odd_out_set -> complex_numbers[k].complex_number;
+		double complex even = even_out_set.complex_numbers[k].complex_number;
+		double complex odd  = odd_out_set.complex_numbers[k].complex_number;
 
 		// Twiddle * Odd = e(−2πi k/N) O[k]
 		double complex t = (twiddle * odd);
@@ -218,7 +258,7 @@ void half_size_dfts(complex_set_t* input_data, complex_set_t* output_data, int h
 // This performs a radix-2 via a Decimation In Time (DIT) approach
 void ct_fft(complex_set_t* input_data, complex_set_t* output_data) {
 	unsigned int size_n = input_data -> data_size;
-	//fprintf(logfile, "=== Performing Radix-2 CT FFT of size: %d \n", size_n);
+	//log_trace("=== Performing Radix-2 CT FFT of size: %d \n", size_n);
 
 	// Trivial size-1 DFT
 	if (size_n == 1) {
@@ -229,3 +269,53 @@ void ct_fft(complex_set_t* input_data, complex_set_t* output_data) {
 	// Split the input into half-size DFTs recursively
 	half_size_dfts(input_data, output_data, size_n/2);
 }
+
+// Iterative radix-2 Cooley-Tukey FFT, input_data -> data_size must be a power of 2
+// Copies the input to output_data in bit reversed order, then combines butterflies in place from spans of 2 upwards
+// O(N log N) and allocation free, input_data and output_data mustn't be the same set
+void iterative_fft(complex_set_t* input_data, complex_set_t* output_data) {
+	int size_n = input_data -> data_size;
+	complex_wrapper_t* input_nums = input_data -> complex_numbers;
+	complex_wrapper_t* output_nums = output_data -> complex_numbers;
+	int bits = 0;
+	while ((1 << bits) < size_n) bits++;
+	for (int i=0; i < size_n; i++) {
+		int reversed = 0;
+		for (int bit=0; bit < bits; bit++) {
+			if (i & (1 << bit)) reversed |= 1 << (bits - 1 - bit);
+		}
+		output_nums[reversed].complex_number = input_nums[i].complex_number;
+	}
+
+	for (int span=2; span <= size_n; span *= 2) {
+		int half_span = span / 2;
+		for (int k=0; k < half_span; k++) {
+			// Twiddle factor: e(−2πi k/span), shared by every butterfly at this offset
+			double rads = -2*M_PI*k/span;
+			double complex twiddle = CMPLX(cos(rads), sin(rads));
+			for (int start=0; start < size_n; start += span) {
+				double complex even = output_nums[start + k].complex_number;
+				double complex t = twiddle * output_nums[start + k + half_span].complex_number;
+				output_nums[start + k].complex_number = even + t;
+				output_nums[start + k + half_span].complex_number = even - t;
+			}
+		}
+	}
+	output_data -> sample_rate = input_data -> sample_rate;
+}
+
+// Every engine that turns samples into a spectrum, dft first as it's the reference the others are checked against
+const fft_engine_t FFT_ENGINES[] = {
+	{"dft", dft},
+	{"ct_fft", ct_fft},
+	{"iterative", iterative_fft}
+};
+const int FFT_ENGINE_COUNT = sizeof(FFT_ENGINES) / sizeof(fft_engine_t);
+
+// Returns the engine with the given name, or NULL if there isn't one
+const fft_engine_t* find_fft_engine(const char* name) {
+	for (int i=0; i < FFT_ENGINE_COUNT; i++) {
+		if (strcmp(FFT_ENGINES[i].name, name) == 0) return &FFT_ENGINES[i];
+	}
+	return NULL;
+}
@@ -1,3 +1,4 @@
+#pragma once
 #include <math.h>
 #include <float.h>
 
@@ -10,5 +11,23 @@ void set_magnitude(complex_set_t* x, int sample_count);
 //void dft(complex_n_t* x, complex_n_t* X);
 void dft(complex_set_t* x, complex_set_t* X);
 complex_set_t* malloc_complex_set(complex_set_t** set, int sample_count, int sample_rate);
+void free_complex_set(complex_set_t* set);
+void fill_complex_set(complex_set_t* output_set, const int16_t* samples, int sample_count);
+complex_set_t* samples_to_complex_set(const int16_t* samples, int sample_count, int sample_rate);
 complex_set_t*  record_stream_to_complex_set(record_stream_data_t* record_stream);
 void ct_fft(complex_set_t* input_data, complex_set_t* output);
+void free_fft_scratch();
+void iterative_fft(complex_set_t* input_data, complex_set_t* output_data);
+
+// A transform from samples to a spectrum, all engines produce the same (unfiltered) output
+typedef struct fft_engine {
+	const char* name;
+	void (*transform)(complex_set_t* input_data, complex_set_t* output_data);
+} fft_engine_t;
+
+// What the analysis uses unless told otherwise
+#define DEFAULT_FFT_ENGINE "ct_fft"
+
+extern const fft_engine_t FFT_ENGINES[];
+extern const int FFT_ENGINE_COUNT;
+const fft_engine_t* find_fft_engine(const char* name);
@@ -0,0 +1,51 @@
+#include <pulseaudio/pa_reconnect.h>
+#include <shared.h>
+#include <log.h>
+
+void init_reconnect(pa_reconnect_t* reconnect) {
+	reconnect -> recovering = false;
+	reconnect -> failed_at_ns = 0;
+	reconnect -> next_attempt_ns = 0;
+	reconnect -> backoff_ms = RECONNECT_INITIAL_BACKOFF_MS;
+	reconnect -> stats = (pa_reconnect_stats_t) {0, 0, 0, 0, 0};
+}
+
+// Returns true if we're recovering and the backoff period has passed
+bool reconnect_due(pa_reconnect_t* reconnect, uint64_t now_ns) {
+	return reconnect -> recovering && now_ns >= reconnect -> next_attempt_ns;
+}
+
+// Schedules the next attempt and doubles the backoff (up to the max)
+void reconnect_attempted(pa_reconnect_t* reconnect, uint64_t now_ns) {
+	reconnect -> stats.reconnect_attempts++;
+	reconnect -> next_attempt_ns = now_ns + (reconnect -> backoff_ms * 1000000);
+	reconnect -> backoff_ms *= 2;
+	if (reconnect -> backoff_ms > RECONNECT_MAX_BACKOFF_MS) {
+		reconnect -> backoff_ms = RECONNECT_MAX_BACKOFF_MS;
+	}
+}
+
+// Records a failed capture, starting a recovery if we aren't already in one
+void reconnect_failed(pa_reconnect_t* reconnect, uint64_t now_ns) {
+	if (reconnect -> recovering) return;
+	log_warn("Capture failed, starting PulseAudio reconnect.\n");
+	reconnect -> recovering = true;
+	reconnect -> failed_at_ns = now_ns;
+	reconnect -> next_attempt_ns = now_ns;
+	reconnect -> backoff_ms = RECONNECT_INITIAL_BACKOFF_MS;
+	reconnect -> stats.failures++;
+}
+
+// Records a good capture, ending any recovery in progress
+void reconnect_succeeded(pa_reconnect_t* reconnect, uint64_t now_ns) {
+	if (!reconnect -> recovering) return;
+	uint64_t recovery_ms = (now_ns - reconnect -> failed_at_ns) / 1000000;
+	reconnect -> recovering = false;
+	reconnect -> backoff_ms = RECONNECT_INITIAL_BACKOFF_MS;
+	reconnect -> stats.reconnect_count++;
+	reconnect -> stats.last_recovery_ms = recovery_ms;
+	if (recovery_ms > reconnect -> stats.max_recovery_ms) {
+		reconnect -> stats.max_recovery_ms = recovery_ms;
+	}
+	log_warn("PulseAudio capture recovered after %lums (%lu attempts so far).\n", (unsigned long) recovery_ms, reconnect -> stats.reconnect_attempts);
+}
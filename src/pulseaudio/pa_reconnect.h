@@ -0,0 +1,40 @@
+#pragma once
+// Tracks recovery of a failed PulseAudio capture (server restart, sink removal, etc)
+// Reconnect attempts are spaced out with an exponential backoff so a missing server
+// doesn't cost us a full context setup every frame
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// First retry happens almost immediately, then doubles each failed attempt
+#define RECONNECT_INITIAL_BACKOFF_MS 50
+// Upper bound on the backoff, this bounds how long we take to resume once the server is back
+#define RECONNECT_MAX_BACKOFF_MS 2000
+
+typedef struct pa_reconnect_stats {
+	// Number of times capture went from working to failed
+	unsigned long failures;
+	// Number of context/stream rebuilds attempted
+	unsigned long reconnect_attempts;
+	// Number of successful recoveries
+	unsigned long reconnect_count;
+	// Time from the initial failure to the first good read, for the last recovery
+	uint64_t last_recovery_ms;
+	uint64_t max_recovery_ms;
+} pa_reconnect_stats_t;
+
+typedef struct pa_reconnect {
+	bool recovering;
+	// Monotonic time of the failure that started this recovery
+	uint64_t failed_at_ns;
+	// Monotonic time we can next attempt a rebuild
+	uint64_t next_attempt_ns;
+	uint64_t backoff_ms;
+	pa_reconnect_stats_t stats;
+} pa_reconnect_t;
+
+void init_reconnect(pa_reconnect_t* reconnect);
+bool reconnect_due(pa_reconnect_t* reconnect, uint64_t now_ns);
+void reconnect_attempted(pa_reconnect_t* reconnect, uint64_t now_ns);
+void reconnect_failed(pa_reconnect_t* reconnect, uint64_t now_ns);
+void reconnect_succeeded(pa_reconnect_t* reconnect, uint64_t now_ns);
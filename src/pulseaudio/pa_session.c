@@ -1,7 +1,11 @@
+#include <stdlib.h>
+
 #include <pulseaudio/pa_session.h>
+#include <log.h>
 
 pa_session_t build_session(char* context_name) {
 	pa_session_t session = {NULL, NULL, NULL, NULL, NULL, PA_STREAM_UNCONNECTED, NULL};
+	init_reconnect(&session.reconnect);
 	// Define our pulse audio loop and connection variables
 	session.name = context_name;
 	session.mainloop = pa_mainloop_new();
@@ -14,37 +18,72 @@ pa_session_t build_session(char* context_name) {
 
 // Disconnect the context and the mainloop from the session
 void destroy_session(pa_session_t session) {
-	FILE* logfile = get_logfile();
-	fprintf(logfile, "Destroying PA Session: %s\n", session.name);
+	log_debug("Destroying PA Session: %s\n", session.name);
+	disconnect_record_stream(&session.record_stream);
 	// Disconnect and set the context to NULL
-	//disconnect_context(&session.context);
+	disconnect_context(&session.context);
 	disconnect_mainloop(&session.mainloop);
 	// If we've unininitialised the mainloop, reset the API property also
 	if (session.mainloop == NULL) {
 		session.mainloop_api = NULL;
 	}
 
+	// Only the caller's copy of the pointer is left, which mustn't be used after this
+	free(session.stream_data);
 	session.stream_data = NULL;
 }
 
+// Drops the record stream from the session, the context must still be alive
+void disconnect_record_stream(pa_stream** stream) {
+	if (stream == NULL || (*stream) == NULL) return;
+	// Our state callbacks point at stack variables of the await_ functions, detach them first
+	pa_stream_set_state_callback(*stream, NULL, NULL);
+	pa_stream_set_read_callback(*stream, NULL, NULL);
+	pa_stream_state_t pa_stream_state = pa_stream_get_state(*stream);
+	if (pa_stream_state != PA_STREAM_FAILED && pa_stream_state != PA_STREAM_TERMINATED && pa_stream_state != PA_STREAM_UNCONNECTED) {
+		pa_stream_disconnect(*stream);
+	}
+	pa_stream_unref(*stream);
+	*stream = NULL;
+}
+
+// Tears down the context and stream of a failed session and starts connecting a fresh context
+// This doesn't wait for the new context, record_device awaits it on the next read
+// The mainloop and the stream data buffer are kept as-is
+// Returns 0 on success, 1 if the context couldn't be created (the session is left without one, to rebuild again)
+int rebuild_session(pa_session_t* session) {
+	log_debug("Rebuilding PA Session: %s\n", session -> name);
+	disconnect_record_stream(&session -> record_stream);
+	disconnect_context(&session -> context);
+	session -> stream_state = PA_STREAM_UNCONNECTED;
+	session -> context = pa_context_new(session -> mainloop_api, session -> name);
+	if (session -> context == NULL) {
+		log_error("Failed to create a PA Context for session: %s\n", session -> name);
+		return 1;
+	}
+	pa_context_connect(session -> context, NULL, 0, NULL);
+	return 0;
+}
+
 void disconnect_context(pa_context** pa_ctx) {
-	FILE* logfile = get_logfile();
 
 	if (pa_ctx != NULL && (*pa_ctx) != NULL) {
+		pa_context_set_state_callback(*pa_ctx, NULL, NULL);
 		pa_context_state_t pa_con_state = pa_context_get_state(*pa_ctx);
-		fprintf(logfile, "Disconnecting PA Context with state: %s\n", PA_CONTEXT_STATE_LOOKUP[pa_con_state]);
+		log_debug("Disconnecting PA Context with state: %s\n", PA_CONTEXT_STATE_LOOKUP[pa_con_state]);
 		if (pa_con_state == PA_CONTEXT_FAILED) {
-			fprintf(logfile, "PA Context was already failed or disconnected.\n");
+			log_warn("PA Context was already failed or disconnected.\n");
 		} else if (pa_con_state == PA_CONTEXT_TERMINATED) {
-			fprintf(logfile, "PA Context was already terminated.\n");
+			log_warn("PA Context was already terminated.\n");
 		} else {
-			fflush(logfile);
 			pa_context_disconnect(*pa_ctx);
-			*pa_ctx = NULL;
-			fprintf(logfile, "Disconnected PA Context!\n");
+			log_debug("Disconnected PA Context!\n");
 		}
+		// Failed and terminated contexts still hold a reference we need to drop
+		pa_context_unref(*pa_ctx);
+		*pa_ctx = NULL;
 	} else {
-		fprintf(logfile, "Cannot disconnect PA Context. PA Context was NULL!\n");
+		log_warn("Cannot disconnect PA Context. PA Context was NULL!\n");
 	}
 }
 
@@ -53,15 +92,13 @@ void quit_mainloop(pa_mainloop* mainloop, int retval) {
 }
 
 void disconnect_mainloop(pa_mainloop** mainloop) {
-	FILE* logfile = get_logfile();
 	if (mainloop != NULL && *mainloop != NULL) {
-		fprintf(logfile, "Disconnecting PA Mainloop...\n");
-		fflush(logfile);
+		log_debug("Disconnecting PA Mainloop...\n");
 		quit_mainloop(*mainloop, 0);
 		pa_mainloop_free(*mainloop);
 		*mainloop = NULL;
-		fprintf(logfile, "Disconnected PA Mainloop!\n");
+		log_debug("Disconnected PA Mainloop!\n");
 	} else {
-		fprintf(logfile, "Cannot dicsonnect. PA Mainloop was NULL!\n");
+		log_warn("Cannot dicsonnect. PA Mainloop was NULL!\n");
 	}
 }
@@ -4,6 +4,7 @@
 #include <pulse/pulseaudio.h>
 
 #include <pulseaudio/pa_shared.h>
+#include <pulseaudio/pa_reconnect.h>
 #include <shared.h>
 
 typedef struct pa_session {
@@ -15,10 +16,14 @@ typedef struct pa_session {
   pa_stream* record_stream;
   pa_stream_state_t stream_state;
   record_stream_data_t* stream_data;
+  // Backoff and metrics for recovering from a failed context/stream
+  pa_reconnect_t reconnect;
 } pa_session_t;
 
 pa_session_t build_session(char* context_name);
+void disconnect_record_stream(pa_stream** stream);
 void disconnect_context(pa_context** pa_ctx);
 void quit_mainloop(pa_mainloop* mainloop, int retval);
 void disconnect_mainloop(pa_mainloop** mainloop);
 void destroy_session(pa_session_t session);
+int rebuild_session(pa_session_t* session);
@@ -1,4 +1,5 @@
 #include <pulseaudio/pa_state.h>
+#include <log.h>
 
 // Handles context state change and sets userdata to our more generic pa_state
 void pa_context_state_cb(struct pa_context* context, void* userdata) {
@@ -55,49 +56,46 @@ enum pa_state check_pa_op( pa_operation* pa_op) {
 }
 
 int await_context_state(pa_session_t* session, pa_state_t expected_state) {
-	FILE* logfile = get_logfile();
 
 	// This hooks up a callback to set pa_ready/keep this int updated
 	int pa_ready = 0;
 	pa_context_set_state_callback(session -> context, pa_context_state_cb, &pa_ready);
 	for (int i=0; i < MAX_ITERATIONS; i++) {
-		//fprintf(logfile, "PA Ready state is: %d\n", pa_ready);
+		//log_trace("PA Ready state is: %d\n", pa_ready);
 		if (pa_ready == expected_state) {
-			fprintf(logfile, "Context reached expected state: %s\n", PA_STATE_LOOKUP[expected_state]);
+			log_debug("Context reached expected state: %s\n", PA_STATE_LOOKUP[expected_state]);
 			return 0;
 		} else {
-			//fprintf(logfile, "Awaiting context state %s. PA context state is: %s\n", PA_STATE_LOOKUP[expected_state], PA_STATE_LOOKUP[pa_ready]);
-			//fflush(logfile);
+			//log_trace("Awaiting context state %s. PA context state is: %s\n", PA_STATE_LOOKUP[expected_state], PA_STATE_LOOKUP[pa_ready]);
 			switch (pa_ready) {
 				case ERROR:
-					fprintf(logfile, "PA context encountered an error: %s!\n", pa_strerror(pa_context_errno(session -> context)));
+					log_warn("PA context encountered an error: %s!\n", pa_strerror(pa_context_errno(session -> context)));
 					return 1;
 				case TERMINATED:
 					// As per docs:
 					// " If the connection has terminated by itself,
 					// then there is no need to explicitly disconnect
 					// the context using pa_context_disconnect()."
-					fprintf(logfile, "PA Context is terminated (no longer available)!\n");
+					log_warn("PA Context is terminated (no longer available)!\n");
 					return 1;
 				case UNKOWN:
-					fprintf(logfile, "Unexpected context state!\n");
+					log_warn("Unexpected context state!\n");
 					return 1;
 			}
 			pa_mainloop_iterate(session -> mainloop, 0, NULL);
 	 	}
 	}
-	fprintf(logfile, "Timed out waiting for PulseAudio context state: %s. Actual state was: %s!\n", PA_STATE_LOOKUP[expected_state], PA_STATE_LOOKUP[pa_ready]);
+	log_warn("Timed out waiting for PulseAudio context state: %s. Actual state was: %s!\n", PA_STATE_LOOKUP[expected_state], PA_STATE_LOOKUP[pa_ready]);
 	return 1;
 }
 
 pa_state_t convert_stream_state(pa_stream_state_t pa_stream_state) {
-	FILE* logfile = get_logfile();
 	switch  (pa_stream_state) {
 		// The stream is not yet connected to any sink or source.
 		case PA_STREAM_UNCONNECTED:
 		// The stream is being created.
 		case PA_STREAM_CREATING:
-			//fprintf(logfile, "Stream unconnected/being created.");
+			//log_trace("Stream unconnected/being created.");
 			return NOT_READY;
 		//The stream is established, you may pass audio data to it now.
 		case PA_STREAM_READY:
@@ -111,7 +109,7 @@ pa_state_t convert_stream_state(pa_stream_state_t pa_stream_state) {
 			break;
 		// Anything else/exceptional
 		default:
-			fprintf(logfile, "Unexpected stream state: %d\n", pa_stream_state);
+			log_warn("Unexpected stream state: %d\n", pa_stream_state);
 			return UNKOWN;
 	}
 }
@@ -125,19 +123,21 @@ void pa_stream_state_cb(struct pa_stream* stream, void* userdata) {
 }
 
 int await_stream_buffer_filled(pa_session_t* session, pa_stream* stream, int* mainloop_retval) {
-	FILE* logfile = get_logfile();
 	// Set a callback for when the state changes
 	for (int i=0; i < MAX_ITERATIONS; i++) {
 		bool buffer_filled = session -> stream_data -> buffer_filled;
 		if (buffer_filled) {
-			fprintf(logfile, "Stream buffer filled.\n");
-			fflush(logfile);
+			log_debug("Stream buffer filled.\n");
 			return 0;
+		} else if (convert_stream_state(pa_stream_get_state(stream)) == ERROR) {
+			// i.e the monitored sink went away, no point waiting out the iterations
+			log_warn("Stream failed while waiting for the buffer to fill: %s!\n", pa_strerror(pa_context_errno(session -> context)));
+			return 1;
 		} else {
 			pa_mainloop_iterate(session -> mainloop, 0, mainloop_retval);
 		}
 	}
-	fprintf(logfile, "Timed out while waiting for stream buffer to fill.\n");
+	log_warn("Timed out while waiting for stream buffer to fill.\n");
 	return 1;
 }
 
@@ -148,7 +148,6 @@ int await_stream_buffer_filled(pa_session_t* session, pa_stream* stream, int* ma
 // mainloop_retval - the value returned by iterating the pa_mainloop on the session
 // Returns 0 on success, 1 in the event of any issues
 int await_stream_state(pa_session_t* session, pa_stream* stream, pa_state_t expected_state, int* mainloop_retval) {
-	FILE* logfile = get_logfile();
 
 	// Get the state
 	pa_stream_state_t pa_stream_state = pa_stream_get_state(stream);
@@ -160,25 +159,25 @@ int await_stream_state(pa_session_t* session, pa_stream* stream, pa_state_t expe
 	for (int i=0; i < MAX_ITERATIONS; i++) {
     session -> stream_state = stream_state;
 		if (stream_state == expected_state) {
-			fprintf(logfile, "Stream reached expected state (%s)\n", expected_state_name);
+			log_debug("Stream reached expected state (%s)\n", expected_state_name);
 			return 0;
 		} else {
 			// Handle any errors / unexpected states
 			bool buffer_filled = session -> stream_data -> buffer_filled;
 			switch (stream_state) {
 				case ERROR:
-					fprintf(logfile, "PA stream encountered an error: %s!\n", pa_strerror(pa_context_errno(session -> context)));
+					log_warn("PA stream encountered an error: %s!\n", pa_strerror(pa_context_errno(session -> context)));
 					return 1;
 				case TERMINATED:
 					if (buffer_filled) {
-						fprintf(logfile, "PA Stream terminated (success)\n");
+						log_debug("PA Stream terminated (success)\n");
 						return 0;
 					} else {
-						fprintf(logfile, "PA Stream terminated (failed to fill byte buffer)\n");
+						log_warn("PA Stream terminated (failed to fill byte buffer)\n");
 						return 1;
 					}
 				case UNKOWN:
-					fprintf(logfile, "Unexpected state! %d\n", stream_state);
+					log_warn("Unexpected state! %d\n", stream_state);
           return 1;
 			   default:
 				  pa_mainloop_iterate(session -> mainloop, 0, mainloop_retval);
@@ -186,34 +185,33 @@ int await_stream_state(pa_session_t* session, pa_stream* stream, pa_state_t expe
 			}
 		}
 	}
-	fprintf(logfile, "Timed out waiting for a PulseAudio stream to reach expected state (%s).\n", expected_state_name);
+	log_warn("Timed out waiting for a PulseAudio stream to reach expected state (%s).\n", expected_state_name);
 	return 1;
 }
 
 int await_operation(pa_mainloop* mainloop, pa_operation* pa_op, pa_context* pa_ctx) {
-	FILE* logfile = get_logfile();
 
-	fprintf(logfile, "Awaiting operation...\n");
+	log_debug("Awaiting operation...\n");
 	enum pa_state pa_op_state = NOT_READY;
 	for (int i=0; i < MAX_ITERATIONS; i++) {
 		pa_op_state = check_pa_op(pa_op);
 		switch (pa_op_state) {
 			case NOT_READY:
-				//fprintf(logfile, "Operation in progress... (%d)\n", i);
+				//log_trace("Operation in progress... (%d)\n", i);
 				// Block until we get something useful
 				pa_mainloop_iterate(mainloop, 1, NULL);
 				break;
 			case ERROR:
-				fprintf(logfile, "Operation failed: %s!\n", pa_strerror(pa_context_errno(pa_ctx)));
+				log_warn("Operation failed: %s!\n", pa_strerror(pa_context_errno(pa_ctx)));
 				return 1;
 			case TERMINATED:
-				fprintf(logfile, "Operation success.\n");
+				log_debug("Operation success.\n");
 				return 0;
 			default:
-				fprintf(logfile, "Unexpected operation state code: %d!\n", pa_op_state);
+				log_warn("Unexpected operation state code: %d!\n", pa_op_state);
 				return 1;
 		}
 	}
-	fprintf(logfile, "Timed out waiting for a PulseAudio operation to complete.\n");
+	log_warn("Timed out waiting for a PulseAudio operation to complete.\n");
 	return 1;
 }
@@ -1,4 +1,5 @@
 #include <pulseaudio/pulsehandler.h>
+#include <log.h>
 
 /*
 // Unsigned 8 Bit PCM for simple byte mapping on read
@@ -12,7 +13,6 @@ static bool STREAM_READ_LOCK = false;
 static int buffer_nbytes = 0;
 
 void pa_sinklist_cb(pa_context* c, const pa_sink_info* sink_info, int eol, void* userdata) {
-	FILE* logfile = get_logfile();
     pa_device_t* pa_devicelist = userdata;
 
     // If eol is set to a positive number, you're at the end of the list
@@ -32,8 +32,8 @@ void pa_sinklist_cb(pa_context* c, const pa_sink_info* sink_info, int eol, void*
 					strncpy(device.monitor_source_name, sink_info -> monitor_source_name, 511);
 					strncpy(device.description, sink_info -> description, 255);
 					device.initialized = 1;
-					fprintf(logfile, "Found device %d, Index %d, Name: %s\n", i, device.index, device.name);
-					if (device.initialized)	fprintf(logfile, "Initialized device %d\n", i);
+					log_debug("Found device %d, Index %d, Name: %s\n", i, device.index, device.name);
+					if (device.initialized)	log_debug("Initialized device %d\n", i);
 					pa_devicelist[i] = device;
 					return;
 				}
@@ -47,11 +47,10 @@ pa_operation* get_sink_list(pa_context* pa_ctx, void* userdata) {
 
 // callback is our implementation function returning pa_operation
 int perform_operation(pa_session_t* session, pa_operation* (*callback) (pa_context* pa_ctx, void* cb_userdata), void* userdata) {
-	FILE* logfile = get_logfile();
 
 	int await_stat = await_context_state(session, READY);
 	if (await_stat != 0) {
-		fprintf(logfile, "Awaiting PA Context Ready returned failure code: %d\n", await_stat);
+		log_warn("Awaiting PA Context Ready returned failure code: %d\n", await_stat);
 		return 1;
 	}
 
@@ -59,7 +58,7 @@ int perform_operation(pa_session_t* session, pa_operation* (*callback) (pa_conte
 	pa_operation* pa_op = NULL;
 	for (int i=0; i < MAX_ITERATIONS; i++) {
 		if (!context_set) {
-			fprintf(logfile, "Performing operation...\n");
+			log_debug("Performing operation...\n");
 			pa_op = (*callback)(session -> context, userdata);
 			context_set = true;
 		}
@@ -69,40 +68,41 @@ int perform_operation(pa_session_t* session, pa_operation* (*callback) (pa_conte
 
 			// I'd like to call pa_unref here, but it seems to always be 0 ref?
 			if (await_op_stat != 0) {
-				fprintf(logfile, "Awaiting PA Operation returned failure code: %d\n", await_stat);
+				log_warn("Awaiting PA Operation returned failure code: %d\n", await_stat);
 				return 1;
 			}
 			return await_op_stat;
 		}
 	}
-	fprintf(logfile, "Timed out while performing an operation!\n");
+	log_warn("Timed out while performing an operation!\n");
 	return 1;
 }
 
-int read_data(const void* data, record_stream_data_t* data_output, long int buffer_size, size_t* read_bytes) {
-	for (long int i=0; i < buffer_size; i++, (*read_bytes)++) {
-		const int16_t* data_p = data;
+// Appends sample_count samples after those already in data_output
+int read_data(const void* data, record_stream_data_t* data_output, long int sample_count, size_t* read_samples) {
+	const int16_t* data_p = data;
+	int16_t* output_p = data_output -> data + data_output -> data_size;
+	for (long int i=0; i < sample_count; i++, (*read_samples)++) {
 		// Our format should correspond to signed int of minimum 16 bits
 		// Set the variable in our output data to match
-		data_output -> data[i] = (int16_t) data_p[i];
+		output_p[i] = (int16_t) data_p[i];
 	}
 	return 0;
 }
 
 int disconnect_stream(pa_stream* stream) {
-	FILE* logfile = get_logfile();
 	pa_stream_state_t pa_stream_state = pa_stream_get_state(stream);
 
 	// We should only really disconnect a stream if it's not failed or disconnected
   if (pa_stream_state == PA_STREAM_FAILED || pa_stream_state == PA_STREAM_TERMINATED) {
-		fprintf(logfile, "Will not disconnect stream, stream is already failed/terminated with state code: %d!\n", pa_stream_state);
+		log_warn("Will not disconnect stream, stream is already failed/terminated with state code: %d!\n", pa_stream_state);
 		return 1;
 	} else {
 		int disconnect_stat = pa_stream_disconnect(stream);
 		if (disconnect_stat == 0) {
-			fprintf(logfile, "Stream disconnected!\n");
+			log_debug("Stream disconnected!\n");
 		} else {
-			fprintf(logfile, "Error while disconnecting stream, disconnect failed with code: %d!\n", disconnect_stat);
+			log_warn("Error while disconnecting stream, disconnect failed with code: %d!\n", disconnect_stat);
 		}
 		return disconnect_stat;
 	}
@@ -119,100 +119,99 @@ void read_stream_cb(pa_stream* p, size_t nbytes, void* userdata) {
       return;
   }
     
-  FILE* logfile = get_logfile();
 	if (nbytes > 0) {
 		if (STREAM_READ_LOCK) {
-		   fprintf(logfile, "Stream already being read. Cancelling stream read callback.\n");
+		   log_trace("Stream already being read. Cancelling stream read callback.\n");
 		   return;
 		} else if (session -> stream_data -> buffer_filled) {
-       fprintf(logfile, "Buffer already filled. Cancelling stream read callback.\n");
+       log_trace("Buffer already filled. Cancelling stream read callback.\n");
 		   return;
     } else {
-				fprintf(logfile, "Stream read locked.\n");
+				log_trace("Stream read locked.\n");
 				STREAM_READ_LOCK = true;
-        fprintf(logfile, "Initial buffer size: %d / %ld\n", session -> stream_data -> data_size, BUFFER_BYTE_COUNT);
+        log_trace("Initial buffer size: %d / %ld\n", session -> stream_data -> data_size, BUFFER_BYTE_COUNT);
         long int stream_byte_size = nbytes;
-				fprintf(logfile, "Reading stream of %ld bytes\n", stream_byte_size);
+				log_trace("Reading stream of %ld bytes\n", stream_byte_size);
 				size_t total_read_bytes = 0;
 				while (total_read_bytes < stream_byte_size) {
 					// Peek to read each fragment from the buffer, sets nbytes
 					const void* data = 0;
 					pa_stream_peek(p, &data, &nbytes);
 
-          //fprintf(logfile, "Stream peek returned fragment of %ld bytes\n", nbytes);
-          int buffer_size = session -> stream_data -> data_size;
-          int remaining_buffer_bytes = BUFFER_BYTE_COUNT - buffer_size;
-          size_t read_bytes = 0;
-          if (remaining_buffer_bytes > 0 && data != NULL && !session -> stream_data -> buffer_filled) {
-            // If we have enough bytes (nbytes) to fill what's remaining, read that
+          //log_trace("Stream peek returned fragment of %ld bytes\n", nbytes);
+          // data_size and BUFFER_BYTE_COUNT are in samples, nbytes is in bytes
+          int remaining_buffer_samples = BUFFER_BYTE_COUNT - session -> stream_data -> data_size;
+          size_t read_samples = 0;
+          if (remaining_buffer_samples > 0 && data != NULL && !session -> stream_data -> buffer_filled) {
+            // If we have enough samples to fill what's remaining, read that
             // Otherwise read whatever is available 
-            int bytes_to_read =  (nbytes >= remaining_buffer_bytes) ? remaining_buffer_bytes : nbytes;
-            //fprintf(logfile, "Reading %d out of peeked fragment of %ld bytes\n", bytes_to_read, nbytes);
-            read_data(data, session -> stream_data, bytes_to_read, &read_bytes);
-            fprintf(logfile, "Read %ld bytes from the stream buffer\n", read_bytes);
-            session -> stream_data -> data_size += read_bytes;
-            total_read_bytes += read_bytes;
+            long int available_samples = nbytes / sizeof(int16_t);
+            long int samples_to_read = (available_samples >= remaining_buffer_samples) ? remaining_buffer_samples : available_samples;
+            //log_trace("Reading %ld out of peeked fragment of %ld bytes\n", samples_to_read, nbytes);
+            read_data(data, session -> stream_data, samples_to_read, &read_samples);
+            log_trace("Read %ld samples from the stream buffer\n", read_samples);
+            session -> stream_data -> data_size += read_samples;
+            // We're done with this fragment, anything past a full buffer is dropped with it
+            pa_stream_drop(p);
+            total_read_bytes += nbytes;
           } else if (data != NULL && session -> stream_data -> buffer_filled) {
-            fprintf(logfile, "Further stream data beyond buffer capacity, dropping fragment of %ld bytes\n", nbytes);
+            log_trace("Further stream data beyond buffer capacity, dropping fragment of %ld bytes\n", nbytes);
             pa_stream_drop(p);
             total_read_bytes += nbytes;
           } else if (data == NULL){
             // Data hole, call drop to pull it from the buffer
             // and move the read index forward
-            fprintf(logfile, "Read stream data hole, dropping fragment of %ld bytes\n", nbytes);
+            log_warn("Read stream data hole, dropping fragment of %ld bytes\n", nbytes);
             pa_stream_drop(p);
             total_read_bytes += nbytes;
           } 
 
           // Set the buffer filled flag if we need to
-          if (buffer_size == BUFFER_BYTE_COUNT && !session -> stream_data -> buffer_filled ) {
-            fprintf(logfile, "DONE filling stream read buffer.\n");
+          if (session -> stream_data -> data_size == BUFFER_BYTE_COUNT && !session -> stream_data -> buffer_filled ) {
+            log_debug("DONE filling stream read buffer.\n");
             session -> stream_data -> buffer_filled  = true;
           } 
         }
-        fprintf(logfile, "DONE reading a total of %ld / %ld bytes from the stream.\n", total_read_bytes, stream_byte_size);
-        fprintf(logfile, "Final buffer size: %d / %ld\n", session -> stream_data -> data_size, BUFFER_BYTE_COUNT);
-				fprintf(logfile, "Stream read unlocked.\n");
+        log_trace("DONE reading a total of %ld / %ld bytes from the stream.\n", total_read_bytes, stream_byte_size);
+        log_trace("Final buffer size: %d / %ld\n", session -> stream_data -> data_size, BUFFER_BYTE_COUNT);
+				log_trace("Stream read unlocked.\n");
         STREAM_READ_LOCK = false;
 		}
 	} else {
-		fprintf(logfile, "No data to read from stream!\n");
+		log_warn("No data to read from stream!\n");
 	}
 }
 
 void pa_stream_success_cb(pa_stream *stream, int success, void *userdata) {
   char* descriptor = (char*) userdata;
-	FILE* logfile = get_logfile();
 	if (success) {
-		fprintf(logfile, "Stream operation '%s' was a success! retval: %d\n", descriptor, success);
+		log_debug("Stream operation '%s' was a success! retval: %d\n", descriptor, success);
 	} else {
-		fprintf(logfile, "Stream operation '%s' failed! retval: %d\n", descriptor, success);
+		log_warn("Stream operation '%s' failed! retval: %d\n", descriptor, success);
 	}
 }
 
 int connect_record_stream(pa_stream** record_stream, const char* device_name) {
-	FILE* logfile = get_logfile();
-	fprintf(logfile, "Connecting stream for device: %s\n", device_name);
+	log_debug("Connecting stream for device: %s\n", device_name);
 	int connect_stat = pa_stream_connect_record(*record_stream, device_name, &buffer_attribs, PA_STREAM_START_CORKED);
 	if (connect_stat == 0) {
-		fprintf(logfile, "Opened recording stream for device: %s\n", device_name);
+		log_debug("Opened recording stream for device: %s\n", device_name);
 	} else {
 		const char* error = pa_strerror(connect_stat);
-		fprintf(logfile, "Failed to connect recording stream for device: %s, status: %d, error: %s\n", device_name, connect_stat, error);
+		log_warn("Failed to connect recording stream for device: %s, status: %d, error: %s\n", device_name, connect_stat, error);
 		return 1;
 	}
 	return 0;
 }
 
 pa_stream* setup_record_stream(pa_session_t* session) {
-	FILE* logfile = get_logfile();
 	const pa_sample_spec * ss = &mono_ss;
 	pa_channel_map map;
-	fprintf(logfile, "Initialising record stream, sample spec: %d channel(s) @ %dHz\n", ss -> channels, ss -> rate);
+	log_debug("Initialising record stream, sample spec: %d channel(s) @ %dHz\n", ss -> channels, ss -> rate);
 	pa_channel_map_init_mono(&map);
 
 	// pa_stream_new for PCM
-	fprintf(logfile, "Initialising PA recording Stream.\n");
+	log_debug("Initialising PA recording Stream.\n");
 	pa_stream* record_stream = pa_stream_new(session -> context, "purses record stream", ss, &map);
 	return record_stream;
 }
@@ -238,7 +237,6 @@ int uncork_stream(pa_stream* stream, pa_session_t* session, int* mainloop_retval
 }
 
 int perform_read(const char* device_name, int sink_idx, pa_session_t** s) {
-	FILE* logfile = get_logfile();
 	int mainloop_retval = 0;
 	
   pa_session_t* session = *s;
@@ -252,24 +250,28 @@ int perform_read(const char* device_name, int sink_idx, pa_session_t** s) {
   if (stream_state == PA_STREAM_UNCONNECTED) {
     int connection_state = connect_record_stream(&record_stream, device_name);
     if (connection_state == 0) {
-      fprintf(logfile, "Record stream connected.\n");
+      log_debug("Record stream connected.\n");
     } else {
-      fprintf(logfile, "Record stream connection failed with return code: %d\n", connection_state);
+      log_warn("Record stream connection failed with return code: %d\n", connection_state);
       return 1;
     }
   }
 
-	await_stream_state(session, record_stream, READY, &mainloop_retval);
+	int stream_stat = await_stream_state(session, record_stream, READY, &mainloop_retval);
+	if (stream_stat != 0) {
+		log_warn("Record stream for %s did not become ready!\n", device_name);
+		return 1;
+	}
 	// Reset the byte count for the buffer
 	buffer_nbytes = 0;
 
-	fprintf(logfile, "Awaiting filled data buffer from stream: %s\n", device_name);
+	log_debug("Awaiting filled data buffer from stream: %s\n", device_name);
 	// Set the data read callback now
 	pa_stream_set_read_callback(record_stream, read_stream_cb, session);
 	uncork_stream(record_stream, session, &mainloop_retval);
 	int await_stat = await_stream_buffer_filled(session, record_stream, &mainloop_retval);
 	if (await_stat != 0) {
-		fprintf(logfile, "Something went wrong while waiting for a stream to terminate!\n");
+		log_warn("Something went wrong while waiting for a stream to terminate!\n");
 	  return 1;
 	}
 
@@ -282,17 +284,16 @@ int perform_read(const char* device_name, int sink_idx, pa_session_t** s) {
   *s = session;
 	// Success / Failure states
 	if (mainloop_retval >= 0) {
-		fprintf(logfile, "Mainloop exited sucessfully with value: %d\n", mainloop_retval);
+		log_debug("Mainloop exited sucessfully with value: %d\n", mainloop_retval);
 		return 0;
 	} else {
-		fprintf(logfile, "Mainloop failed with value: %d\n", mainloop_retval);
+		log_warn("Mainloop failed with value: %d\n", mainloop_retval);
 		return 1;
 	}
 }
 
 int get_sinklist(pa_device_t* output_devices, int* count) {
-	FILE* logfile = get_logfile();
-	fprintf(logfile, "Retrieving PulseAudio Sinks...\n");
+	log_debug("Retrieving PulseAudio Sinks...\n");
 
   // Make space for 16 devices in our list
   memset(output_devices, 0, sizeof(pa_device_t) * DEVICE_MAX);
@@ -310,20 +311,20 @@ int get_sinklist(pa_device_t* output_devices, int* count) {
 			dev_count++;
 		}
 	}
-	fprintf(logfile, "Retrieved %d Sink Devices...\n", dev_count);
+	log_debug("Retrieved %d Sink Devices...\n", dev_count);
 	(*count) = dev_count;
 	return 0;
 }
 
 // Either initialise or empty the record data object for use
 void clean_stream_data(record_stream_data_t** stream_data) {
-    FILE *logfile = get_logfile();
     // Temporary pointer value
     record_stream_data_t* record_data = (*stream_data);
 
 		if (record_data == NULL) {
-      fprintf(logfile, "Allocating record stream data\n");
+      log_debug("Allocating record stream data\n");
       record_data = malloc(sizeof(record_stream_data_t));
+      record_data -> data_size = 0;
 		}
     for (int i=0; i < record_data -> data_size; i++) {
       record_data -> data[i] = 0;
@@ -331,18 +332,21 @@ void clean_stream_data(record_stream_data_t** stream_data) {
     record_data -> data_size = 0;
     record_data -> buffer_filled = false;
     (*stream_data) = record_data;
-    fprintf(logfile, "Cleaned record stream data of %d bytes\n", record_data -> data_size);
+    log_debug("Cleaned record stream data of %d bytes\n", record_data -> data_size);
 }
 
 int record_device(pa_device_t device, pa_session_t** s) {
-    FILE *logfile = get_logfile();
-    fprintf(logfile, "Recording device: %s\n", device.name);
-		fflush(logfile);
+    log_debug("Recording device: %s\n", device.name);
 
     pa_session_t* session = *s;
 
     clean_stream_data(&session -> stream_data);
 
+		// A rebuild that couldn't create a context fails the read, so recovery rebuilds it again
+		if (session -> context == NULL) {
+			log_warn("Cannot record without a PA Context\n");
+			return 1;
+		}
 		pa_context_state_t pa_con_state = pa_context_get_state(session -> context);
 		if (PA_CONTEXT_UNCONNECTED == pa_con_state) {
     	pa_context_connect(session -> context, NULL, 0, NULL);
@@ -351,17 +355,43 @@ int record_device(pa_device_t device, pa_session_t** s) {
 		if (PA_CONTEXT_READY != pa_con_state) {
 			int await_stat = await_context_state(session, READY);
 			if (await_stat != 0) {
-				fprintf(logfile, "Awaiting PA Context Ready returned failure code: %d\n", await_stat);
+				log_warn("Awaiting PA Context Ready returned failure code: %d\n", await_stat);
 				return 1;
 			}
 		}
 
     int read_stat = perform_read(device.monitor_source_name, device.index, &session);
     if (read_stat == 0) {
-        fprintf(logfile, "Recording complete. Recorded %d samples\n", session -> stream_data -> data_size);
+        log_debug("Recording complete. Recorded %d samples\n", session -> stream_data -> data_size);
     } else {
-        fprintf(logfile, "Recording failed!\n");
+        log_warn("Recording failed!\n");
     }
     *s = session;
 		return read_stat;
 }
+
+// Records from the device as record_device does, but recovers the session if capture fails
+// While recovering, rebuilds of the context/stream are spaced out by the session's reconnect backoff
+// Returns 0 on a successful read, 1 if the read failed or we're still waiting to reconnect
+int record_device_recovering(pa_device_t device, pa_session_t** s) {
+	pa_session_t* session = *s;
+	pa_reconnect_t* reconnect = &session -> reconnect;
+	uint64_t now_ns = get_monotonic_ns();
+
+	if (reconnect -> recovering) {
+		if (!reconnect_due(reconnect, now_ns)) {
+			return 1;
+		}
+		reconnect_attempted(reconnect, now_ns);
+		// Still recovering, the next attempt after the backoff rebuilds it again
+		if (rebuild_session(session) != 0) return 1;
+	}
+
+	int read_stat = record_device(device, s);
+	if (read_stat == 0) {
+		reconnect_succeeded(reconnect, get_monotonic_ns());
+	} else {
+		reconnect_failed(reconnect, now_ns);
+	}
+	return read_stat;
+}
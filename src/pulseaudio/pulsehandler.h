@@ -51,3 +51,4 @@ int perform_read(const char* device_name, int sink_idx, pa_session_t** session);
 int get_sinklist(pa_device_t* output_devices, int* count);
 
 int record_device(pa_device_t device, pa_session_t** session);
+int record_device_recovering(pa_device_t device, pa_session_t** session);
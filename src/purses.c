@@ -5,28 +5,51 @@
 #include <pulse/pulseaudio.h>
 #include <ncurses.h>
 #include <time.h>
+#include <locale.h>
+#include <langinfo.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
 
 #include <pulseaudio/pulsehandler.h>
 #include <shared.h>
 #include <processing.h>
 #include <visualiser.h>
 #include <settings.h>
+#include <config.h>
+#include <analysis.h>
+#include <frame_timing.h>
+#include <headless.h>
+#include <governor.h>
+#include <replay.h>
+#include <outputs.h>
+#include <trace/trace.h>
+#include <log.h>
+#include <latency.h>
+#include <perf_counters.h>
+#include <alloc_stats.h>
+
+// The offscreen terminal the benchmark draws to
+#define BENCH_TERM "xterm-256color"
+#define BENCH_LINES 50
+#define BENCH_COLS 200
+#define BENCH_SYNTHETIC_SECONDS 4
+// How long to wait for each spectrum before giving up on the benchmark
+#define BENCH_WAIT_NS 5000000000UL
 
 // Prints a PulseAudio device to the logfile
 void print_device(pa_device_t device, int device_index) {
-	FILE* logfile = get_logfile();
-	fprintf(logfile, "=== Device %d, %d ===\n", device_index, device.index);
-	fprintf(logfile, "Initialised: %d\n", device.initialized);
-	fprintf(logfile, "Input Device: %d\n", device_index + 1);
-	fprintf(logfile, "Description: %s\n", device.description);
-	fprintf(logfile, "Name: %s\n", device.name);
-	fprintf(logfile, "\n");
+	log_debug("=== Device %d, %d ===\n", device_index, device.index);
+	log_debug("Initialised: %d\n", device.initialized);
+	log_debug("Input Device: %d\n", device_index + 1);
+	log_debug("Description: %s\n", device.description);
+	log_debug("Name: %s\n", device.name);
+	log_debug("\n");
 }
 
 // Loops through the provided devices (using size to iterate)
 // Printing each initialised device to the logfile
 void print_devicelist(pa_device_t* devices, int size) {
-	FILE* logfile = get_logfile();
 	int found=0;
 	for (int i=0; i < size; i++) {
 		pa_device_t device = devices[i];
@@ -35,7 +58,7 @@ void print_devicelist(pa_device_t* devices, int size) {
 			found = 1;
 		}
 	}
-	if (!found) fprintf(logfile,"No initialised devices found\n");
+	if (!found) log_debug("No initialised devices found\n");
 }
 
 
@@ -52,66 +75,91 @@ record_stream_data_t* read_stream_from_file() {
 	return file_read_data;
 }
 
-// Records a set amount of data from the device
-// Returns a record_stream_data_t filled from the device on successful
-// Returns NULL in the event of a failure
-record_stream_data_t* record_samples_from_device(pa_device_t device, pa_session_t* session) {
-	int recording_stat = record_device(device, &session);
-	if (recording_stat == 0) {
-		return session -> stream_data;
-	} else {
+// Draws the latest spectrum from the analysis thread, if there's a new one
+// Drawn in place from the render's own buffer, while capture fills the next block and analysis transforms the one before
+// spectrum - set to that buffer, it holds the last good results, these are shown again if recording fails
+// latency_win - the latency overlay, drawn over everything else if it's showing (may be NULL)
+// idle - marks the frame as the last until the input's no longer silent
+// quality_level - the governor's level, shown in the footer
+// Returns how long the latest spectrum took to transform
+uint64_t perform_visualisation(analysis_t* analysis, WINDOW* vis_win, WINDOW* latency_win, visualiser_state_t* vis_state, complex_set_t** spectrum, unsigned long* sequence, frame_stats_t* frame_stats, int target_fps, bool idle, int quality_level) {
+	uint64_t analysis_ns = 0;
+	pa_reconnect_t reconnect;
+	bool new_spectrum = read_latest_spectrum(analysis, sequence, spectrum, &analysis_ns, &reconnect);
+	if (new_spectrum) {
+		push_history(vis_state -> history, *spectrum);
+	}
+	draw_visualiser(vis_win, vis_state, *spectrum, new_spectrum, frame_stats, analysis_ns, target_fps, quality_level);
+	draw_reconnect_status(vis_win, &reconnect);
+	draw_idle_status(vis_win, idle);
+	// Update the screen once, so the overlay doesn't flicker
+	wnoutrefresh(vis_win);
+	if (latency_win != NULL) {
+		draw_latency_overlay(latency_win);
+		wnoutrefresh(latency_win);
+	}
+	doupdate();
+	return analysis_ns;
+}
+
+// Applies the governor's level to the analysis and the bars, the frame rate is applied by the render loop
+void apply_quality_level(const quality_level_t* level, analysis_t* analysis, visualiser_state_t* vis_state, int bar_columns) {
+	set_analysis_quality(analysis, level -> fft_size, level -> hop_blocks);
+	set_visualiser_bar_columns(vis_state, bar_columns * level -> bar_scale);
+}
+
+// Set by the SIGWINCH handler, the render loop resizes the windows when it sees this
+static volatile sig_atomic_t terminal_resized = 0;
+
+void handle_sigwinch(int signal) {
+	terminal_resized = 1;
+}
+
+// Replaces the ncurses SIGWINCH handler with our own
+void watch_terminal_size() {
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = handle_sigwinch;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGWINCH, &action, NULL);
+}
+
+// Shows the latency overlay in the top right, or hides it if it's showing
+// Returns the overlay window, or NULL if it's now hidden
+WINDOW* toggle_latency_overlay(WINDOW* latency_win, WINDOW* vis_win) {
+	if (latency_win != NULL) {
+		delwin(latency_win);
+		// Uncover what was under it
+		touchwin(vis_win);
 		return NULL;
 	}
+	int height = perf_counters_enabled() ? PERF_OVERLAY_HEIGHT : LATENCY_OVERLAY_HEIGHT;
+	return newwin(height, LATENCY_OVERLAY_WIDTH, 2, COLS - LATENCY_OVERLAY_WIDTH - 2);
 }
 
-// Records some samples from the provided device
-// Performing a Cooley-Tukey FFT on the recording
-// Then drawing the visualiser graph for the results
-void perform_visualisation(pa_device_t* device, pa_session_t* session, WINDOW* vis_win) {
-	FILE* logfile = get_logfile();
-	struct timeval before, after, elapsed;
-	gettimeofday(&before, NULL);
-
-	record_stream_data_t* stream_data = record_samples_from_device(*device, session);
-	complex_set_t* output_set = NULL;
-	if (stream_data != NULL) {
-		int streamed_data_size = stream_data -> data_size;
-    if (stream_data -> buffer_filled) {
-      complex_set_t* input_set = NULL;
-      input_set = record_stream_to_complex_set(stream_data);
-      // And free the struct when we're done
-      free(stream_data);
-      //fflush(logfile);
-      //refresh();
-      malloc_complex_set(&output_set, streamed_data_size, MAX_SAMPLE_RATE);
-      fprintf(logfile, "=== Recorded Data ===\n");
-      fprint_data(logfile, input_set);
-
-      ct_fft(input_set, output_set);
-      nyquist_filter(output_set);
-      set_magnitude(output_set, streamed_data_size);
-      fprintf(logfile, "=== Result Data ===\n");
-      fprint_data(logfile, output_set);
-    }
-	} else {
-		// Zero the output set so we can display nothing
-		malloc_complex_set(&output_set, 0, MAX_SAMPLE_RATE);
-		fprintf(logfile, "Failed to record samples from device.\n");
-	}
-
-	gettimeofday(&after, NULL);
-	// Set the subtracted elapsed time
-	timersub(&after, &before, &elapsed);
-	draw_visualiser(vis_win, output_set, elapsed);
-	mvwprintw(vis_win, VIS_HEIGHT-1, 1, "q - Quit, s - Choose device");
-	wrefresh(vis_win);
-	refresh();
+// Resizes ncurses and the visualiser window to the new terminal size
+void resize_windows(WINDOW* vis_win, WINDOW* latency_win, visualiser_state_t* vis_state) {
+	struct winsize size;
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) != 0) {
+		log_warn("Failed to read the terminal size!\n");
+		return;
+	}
+	resizeterm(size.ws_row, size.ws_col);
+	// Leave the top line free, as at startup
+	wresize(vis_win, LINES-1, COLS);
+	resize_visualiser(vis_state, COLS, LINES-1);
+	if (latency_win != NULL) mvwin(latency_win, 2, COLS - LATENCY_OVERLAY_WIDTH - 2);
+	log_debug("Terminal resized to %dx%d\n", COLS, LINES);
+	clearok(curscr, true);
 }
 
 // Gets a single character of input from the provided window
 // Returning an integer of 0 if nothing is matched
 // 1 for quit
 // 2 for settings menu
+// 3 to cycle the target frame rate
+// 4 to toggle the waterfall view
+// 5 to toggle the latency overlay
 int handle_input(WINDOW* window) {
 	int keypress = wgetch(window);
 	if (ERR != keypress) {
@@ -121,57 +169,326 @@ int handle_input(WINDOW* window) {
         return 1;
       case 's':
         return 2;
+      case 'f':
+        return 3;
+      case 'w':
+        return 4;
+      case 'l':
+        return 5;
     } 
 	}
 	return 0;
 }
 
+// Prints the mean hardware counts for each stage, "-" for counters the PMU doesn't have
+static void print_perf_counters() {
+	printf("%-10s %14s %14s %6s %12s %13s\n", "stage", PERF_COUNTER_NAMES[PERF_CYCLES], PERF_COUNTER_NAMES[PERF_INSTRUCTIONS], "ipc",
+		PERF_COUNTER_NAMES[PERF_CACHE_MISSES], PERF_COUNTER_NAMES[PERF_BRANCH_MISSES]);
+	const int widths[] = {14, 14, 12, 13};
+	for (int stage=0; stage < LATENCY_STAGE_COUNT; stage++) {
+		perf_summary_t summary;
+		summarise_perf_counters(stage, &summary);
+		printf("%-10s", LATENCY_STAGE_NAMES[stage]);
+		for (int i=0; i < PERF_COUNTER_COUNT; i++) {
+			if (summary.available[i]) printf(" %*.0f", widths[i], summary.means[i]);
+			else printf(" %*s", widths[i], "-");
+			if (i == PERF_INSTRUCTIONS) {
+				if (summary.ipc > 0) printf(" %6.2f", summary.ipc);
+				else printf(" %6s", "-");
+			}
+		}
+		printf("\n");
+	}
+}
+
+// How many spectra the analysis has published so far
+static unsigned long published_spectra(analysis_t* analysis) {
+	pthread_mutex_lock(&analysis -> lock);
+	unsigned long sequence = analysis -> sequence;
+	pthread_mutex_unlock(&analysis -> lock);
+	return sequence;
+}
+
+// Prints the allocations made between before and after, per drawn frame and per published spectrum
+// The analysis can publish more spectra than are drawn (the sliding DFT does), so both are shown
+static void print_alloc_stats(const alloc_stats_t* before, const alloc_stats_t* after, int frames, unsigned long spectra) {
+	if (!alloc_stats_enabled()) {
+		printf("Allocations: not counted, build with make compile-counted\n");
+		return;
+	}
+	uint64_t allocations = after -> allocations - before -> allocations;
+	double kb = (after -> bytes - before -> bytes) / 1024.0;
+	printf("Allocations: %.1f per frame, %.1fKB per frame (%d frames)\n", (double) allocations / frames, kb / frames, frames);
+	if (spectra > 0) printf("Allocations: %.1f per spectrum, %.1fKB per spectrum (%lu spectra)\n", (double) allocations / spectra, kb / spectra, spectra);
+}
+
+// Draws bench_frames spectra as fast as they can be produced, to a terminal that goes nowhere
+// Captures from a synthetic signal, or loops the replay if there is one
+// Then reports the frame rate, what each stage cost (and its hardware counts if enabled), allocations per frame and per spectrum and the peak RSS
+// Returns 0 on success, 1 on failure
+int run_benchmark(purses_config_t config, replay_source_t* replay) {
+	replay_source_t synthetic;
+	if (replay == NULL) {
+		if (open_synthetic_replay(&synthetic, BENCH_SYNTHETIC_SECONDS) != 0) return 1;
+		replay = &synthetic;
+	}
+	replay -> loop = true;
+	replay -> realtime = false;
+
+	FILE* null_output = fopen("/dev/null", "w");
+	FILE* null_input = fopen("/dev/null", "r");
+	SCREEN* screen = null_output != NULL && null_input != NULL ? newterm(BENCH_TERM, null_output, null_input) : NULL;
+	if (screen == NULL) {
+		fprintf(stderr, "Couldn't create the offscreen %s terminal for the benchmark\n", BENCH_TERM);
+		if (null_output != NULL) fclose(null_output);
+		if (null_input != NULL) fclose(null_input);
+		if (replay == &synthetic) close_replay(&synthetic);
+		return 1;
+	}
+	set_term(screen);
+	resizeterm(BENCH_LINES, BENCH_COLS);
+	start_color();
+	use_default_colors();
+	WINDOW* vis_win = newwin(LINES-1, COLS, 1, 0);
+
+	spectrum_history_t history;
+	init_history(&history, HISTORY_ROWS, HISTORY_BINS);
+	visualiser_state_t vis_state;
+	init_visualiser_state(&vis_state, true, config.bar_columns, COLS, LINES-1, &history);
+	// Owned by the analysis, see perform_visualisation
+	complex_set_t* spectrum = NULL;
+	unsigned long sequence = 0;
+	frame_stats_t frame_stats;
+	init_frame_stats(&frame_stats, get_monotonic_ns());
+
+	pa_device_t device = {0};
+	analysis_t analysis;
+	int stat = start_analysis(&analysis, device, replay, NULL, &config.capture, &config.silence);
+	if (stat == 0) set_analysis_engine(&analysis, config.fft_engine, config.sliding_hop);
+	alloc_stats_t allocs_before;
+	read_alloc_stats(&allocs_before);
+	unsigned long spectra_before = stat == 0 ? published_spectra(&analysis) : 0;
+	uint64_t start_ns = get_monotonic_ns();
+	int frames = 0;
+	while (stat == 0 && frames < config.bench_frames) {
+		if (!wait_for_spectrum(&analysis, &sequence, NULL, BENCH_WAIT_NS)) {
+			log_error("Benchmark timed out waiting for a spectrum\n");
+			stat = 1;
+			break;
+		}
+		uint64_t frame_start_ns = begin_stage();
+		record_frame(&frame_stats, frame_start_ns);
+		perform_visualisation(&analysis, vis_win, NULL, &vis_state, &spectrum, &sequence, &frame_stats, config.target_fps, false, 0);
+		end_stage(LATENCY_DRAW, frame_start_ns);
+		frames++;
+	}
+	uint64_t elapsed_ns = get_monotonic_ns() - start_ns;
+	alloc_stats_t allocs_after;
+	read_alloc_stats(&allocs_after);
+	unsigned long spectra = stat == 0 ? published_spectra(&analysis) - spectra_before : 0;
+
+	stop_analysis(&analysis);
+	free_visualiser_state(&vis_state);
+	free_history(&history);
+	delwin(vis_win);
+	endwin();
+	delscreen(screen);
+	fclose(null_output);
+	fclose(null_input);
+	if (replay == &synthetic) close_replay(&synthetic);
+	if (stat != 0) return stat;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	printf("Benchmark: %d frames of %d samples in %.2fs, %.1f frames/s\n", frames, NUM_SAMPLES, elapsed_ns / 1e9, frames / (elapsed_ns / 1e9));
+	printf("%-10s %10s %10s %10s %10s\n", "stage", "mean_ms", "p50_ms", "p99_ms", "max_ms");
+	for (int stage=0; stage < LATENCY_STAGE_COUNT; stage++) {
+		latency_summary_t summary;
+		summarise_latency(stage, &summary);
+		printf("%-10s %10.3f %10.3f %10.3f %10.3f\n", LATENCY_STAGE_NAMES[stage], summary.mean_ns / 1e6, summary.p50_ns / 1e6, summary.p99_ns / 1e6, summary.max_ns / 1e6);
+	}
+	if (perf_counters_enabled()) print_perf_counters();
+	print_alloc_stats(&allocs_before, &allocs_after, frames, spectra);
+	printf("Peak RSS: %.1fMB\n", usage.ru_maxrss / 1024.0);
+	return 0;
+}
+
 int main(void) {
-	FILE* logfile = get_logfile();
-  const char* TESTING_MODE_ENV = getenv("PURSES_TEST_MODE");
-  const bool TESTING_MODE = TESTING_MODE_ENV != NULL && TESTING_MODE_ENV[0] == '1';
+	purses_config_t config = load_config();
+	start_logging();
+	// Carry on without the trace if it can't be opened
+	if (config.trace_path != NULL) open_trace(config.trace_path, TRACE_DEFAULT_CAPACITY);
+	// The analysis thread opens its own counters, these are for drawing (closed on every exit below)
+	if (config.perf_counters) {
+		enable_perf_counters();
+		open_thread_perf_counters();
+	}
+	replay_source_t replay = {0};
+	if (config.replay_path != NULL && open_replay(&replay, config.replay_path, config.replay_realtime) != 0) {
+		close_thread_perf_counters();
+		close_trace();
+		stop_logging();
+		return 1;
+	}
+	replay_source_t* replay_source = config.replay_path != NULL ? &replay : NULL;
+	if (config.bench_frames > 0) {
+		int bench_stat = run_benchmark(config, replay_source);
+		close_replay(&replay);
+		close_thread_perf_counters();
+		close_trace();
+		stop_logging();
+		return bench_stat;
+	}
+	if (config.headless) {
+		int headless_stat = run_headless(config, get_main_device(), replay_source);
+		log_info("purses headless run exited with status: %d\n", headless_stat);
+		dump_latency(config.latency_path);
+		close_replay(&replay);
+		close_thread_perf_counters();
+		close_trace();
+		stop_logging();
+		return headless_stat;
+	}
+	// Use the user's locale so ncurses can write UTF-8
+	setlocale(LC_ALL, "");
+	bool unicode = strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
 	// init curses
 	initscr();
 	start_color();
+	use_default_colors();
 	refresh();
   // Don't write input characters to the display
   noecho();
 
-	WINDOW* visusaliser_win = newwin(VIS_HEIGHT, VIS_WIDTH, 1, 0);
+	watch_terminal_size();
+
+	// Fill the terminal below the top line
+	WINDOW* visusaliser_win = newwin(LINES-1, COLS, 1, 0);
 	WINDOW* settings_win = newwin(SETTINGS_HEIGHT, SETTINGS_WIDTH, 2, 5);
 
-  // The delay for reading from a window (use a large value to step through each iteration)
-  const int READ_TIMEOUT_MILIS = TESTING_MODE ? 60000 : 100;
+  // Input is polled once per frame, unless we're stepping through each frame
+  const int READ_TIMEOUT_MILIS = config.testing_mode ? 60000 : 0;
 	wtimeout(visusaliser_win, READ_TIMEOUT_MILIS);
 	wtimeout(settings_win, 500);
 	pa_device_t device = get_main_device();
   int device_index = 0;
-	pa_session_t session = build_session("visualiser-pcm-recording");
+
+	spectrum_outputs_t outputs;
+	analysis_t analysis;
+	if (open_outputs(&outputs, &config) != 0) {
+		endwin();
+		close_replay(&replay);
+		close_thread_perf_counters();
+		close_trace();
+		stop_logging();
+		return 1;
+	}
+	if (start_analysis(&analysis, device, replay_source, &outputs, &config.capture, &config.silence) != 0) {
+		close_outputs(&outputs);
+		endwin();
+		close_replay(&replay);
+		close_thread_perf_counters();
+		close_trace();
+		stop_logging();
+		return 1;
+	}
+	set_analysis_engine(&analysis, config.fft_engine, config.sliding_hop);
+
+  // Nothing recorded yet, so the analysis's empty set is displayed
+  complex_set_t* spectrum = NULL;
+  unsigned long sequence = 0;
+  visualiser_state_t vis_state;
+  spectrum_history_t history;
+  init_history(&history, HISTORY_ROWS, HISTORY_BINS);
+  init_visualiser_state(&vis_state, unicode, config.bar_columns, COLS, LINES-1, &history);
+
+  uint64_t period_ns = 1000000000 / config.target_fps;
+  uint64_t next_frame_ns = get_monotonic_ns();
+  frame_stats_t frame_stats;
+  init_frame_stats(&frame_stats, next_frame_ns);
+  WINDOW* latency_win = NULL;
+  // Set once the last frame before the input went silent is up, nothing's redrawn while it's still silent
+  bool idle_drawn = false;
+  quality_governor_t governor;
+  init_governor(&governor);
+  // Stepping through frames by hand would always look over budget
+  bool governed = config.governor && !config.testing_mode;
   unsigned long int i = 0;
 	while (true) {
-		fprintf(logfile, "=== Performing visualisation frame no: %ld\n", i);
-		perform_visualisation(&device, &session, visusaliser_win);
+		if (terminal_resized) {
+			terminal_resized = 0;
+			resize_windows(visusaliser_win, latency_win, &vis_state);
+			idle_drawn = false;
+		}
+		bool idle = !config.testing_mode && analysis_idle(&analysis);
+		if (!idle || !idle_drawn) {
+			uint64_t frame_start_ns = begin_stage();
+			record_frame(&frame_stats, frame_start_ns);
+			trace_frame(i);
+			trace_begin(TRACE_RENDER);
+			const quality_level_t* level = governor_level(&governor);
+			uint64_t analysis_ns = perform_visualisation(&analysis, visusaliser_win, latency_win, &vis_state, &spectrum, &sequence, &frame_stats, config.target_fps / level -> fps_divisor, idle, governor.level);
+			trace_end(TRACE_RENDER);
+			uint64_t frame_end_ns = end_stage(LATENCY_DRAW, frame_start_ns);
+			double load = frame_load(level, frame_end_ns - frame_start_ns, analysis_ns, period_ns);
+			if (governed && update_governor(&governor, load, frame_end_ns)) {
+				level = governor_level(&governor);
+				log_info("=== Quality level %d: %d sample FFT every %d blocks, %d columns per bar, %d FPS\n", governor.level,
+					level -> fft_size, level -> hop_blocks, config.bar_columns * level -> bar_scale, config.target_fps / level -> fps_divisor);
+				apply_quality_level(level, &analysis, &vis_state, config.bar_columns);
+			}
+		}
+		idle_drawn = idle;
 		// Print the current iteration count
-    if(TESTING_MODE) mvwprintw(visusaliser_win, 0, 0, "%ld", i);
-		fflush(logfile);
+    if(config.testing_mode) mvwprintw(visusaliser_win, 0, 0, "%ld", i);
 		int command_code = handle_input(visusaliser_win);
 		if (command_code == 1) break;
+		// Whatever the command changed is drawn next time round
+		if (command_code != 0) idle_drawn = false;
 		if (command_code == 2) {
       device = show_device_choice_window(settings_win, &device_index);
-  		fprintf(logfile, "=== Chosen device: %d. %s\n", device_index, device.name);
-      werase(visusaliser_win);
-      wrefresh(visusaliser_win);
+  		log_info("=== Chosen device: %d. %s\n", device_index, device.name);
+      set_analysis_device(&analysis, device);
+      // The settings window drew over us, so redraw everything
+      invalidate_visualiser(&vis_state);
+      touchwin(visusaliser_win);
+      next_frame_ns = get_monotonic_ns();
+    }
+		if (command_code == 3) {
+      config.target_fps = next_target_fps(config.target_fps);
+      period_ns = 1000000000 / config.target_fps;
+  		log_info("=== Target FPS: %d\n", config.target_fps);
+    }
+		if (command_code == 4) {
+      set_visualiser_view(&vis_state, vis_state.view == VIEW_BARS ? VIEW_WATERFALL : VIEW_BARS);
+    }
+		if (command_code == 5) {
+      latency_win = toggle_latency_overlay(latency_win, visusaliser_win);
+    }
+    if (idle) {
+      // Only woken early by a new spectrum, i.e as soon as the input isn't silent
+      wait_for_spectrum(&analysis, &sequence, NULL, SILENCE_POLL_NS);
+      next_frame_ns = get_monotonic_ns();
+    } else if (!config.testing_mode) {
+      pace_frame(&next_frame_ns, period_ns * governor_level(&governor) -> fps_divisor);
     }
     i++;
 	}
 
-  destroy_session(session);
-	fflush(logfile);
+  stop_analysis(&analysis);
+  close_outputs(&outputs);
+  free_visualiser_state(&vis_state);
+  free_history(&history);
+  if (latency_win != NULL) delwin(latency_win);
 	delwin(settings_win);
 	delwin(visusaliser_win);
 	endwin();
-	close_logfile();
-  fprintf(logfile, "purses exited successfully!\n");
+  dump_latency(config.latency_path);
+  log_info("purses exited successfully!\n");
+	close_replay(&replay);
+	close_thread_perf_counters();
+	close_trace();
+	stop_logging();
 	// exit with success status code
 	return 0;
 }
@@ -0,0 +1,238 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <recorder.h>
+#include <wav.h>
+#include <log.h>
+
+// Builds the name of the next file, only numbered when we're rotating
+static void recording_path(pcm_recorder_t* recorder, char* path, size_t size) {
+	if (recorder -> max_bytes == 0 && recorder -> max_seconds == 0) {
+		snprintf(path, size, "%s", recorder -> path);
+		return;
+	}
+	const char* extension = strrchr(recorder -> path, '.');
+	int base_length = extension != NULL ? (int) (extension - recorder -> path) : (int) strlen(recorder -> path);
+	snprintf(path, size, "%.*s-%04d%s", base_length, recorder -> path, recorder -> file_number, extension != NULL ? extension : ".wav");
+}
+
+// Rewrites the header with the real sizes and closes the current file
+static void finish_file(pcm_recorder_t* recorder) {
+	if (recorder -> fd < 0) return;
+	uint8_t header[WAV_HEADER_SIZE];
+	build_wav_header(header, recorder -> sample_rate, 1, recorder -> file_bytes);
+	if (pwrite(recorder -> fd, header, WAV_HEADER_SIZE, 0) != WAV_HEADER_SIZE) {
+		log_error("Failed to finalise the WAV header of recording %d\n", recorder -> file_number);
+	}
+	close(recorder -> fd);
+	recorder -> fd = -1;
+	recorder -> files_written++;
+}
+
+// Opens the next file with a placeholder header
+// Returns 0 on success, 1 on failure
+static int next_file(pcm_recorder_t* recorder) {
+	finish_file(recorder);
+	recorder -> file_number++;
+	char path[300];
+	recording_path(recorder, path, sizeof(path));
+	recorder -> fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (recorder -> fd < 0) {
+		log_error("Failed to open recording: %s, error: %d\n", path, errno);
+		return 1;
+	}
+	uint8_t header[WAV_HEADER_SIZE];
+	build_wav_header(header, recorder -> sample_rate, 1, 0);
+	if (write(recorder -> fd, header, WAV_HEADER_SIZE) != WAV_HEADER_SIZE) {
+		log_error("Failed to write the WAV header to: %s\n", path);
+		return 1;
+	}
+	recorder -> file_bytes = 0;
+	log_info("Recording to: %s\n", path);
+	return 0;
+}
+
+// The most data bytes the current file can take before rotating
+static uint64_t file_limit(pcm_recorder_t* recorder) {
+	uint64_t limit = WAV_MAX_DATA_BYTES - (WAV_MAX_DATA_BYTES % sizeof(int16_t));
+	if (recorder -> max_bytes > 0 && recorder -> max_bytes < limit) limit = recorder -> max_bytes;
+	uint64_t seconds_bytes = recorder -> max_seconds * recorder -> sample_rate * sizeof(int16_t);
+	if (seconds_bytes > 0 && seconds_bytes < limit) limit = seconds_bytes;
+	return limit;
+}
+
+// Writes the chunks out, splitting them across files where a limit falls mid-chunk
+// Returns 0 on success, 1 if the recording can't continue
+static int write_chunks(pcm_recorder_t* recorder, int* indexes, int count) {
+	struct iovec vectors[RECORDER_BATCH_CHUNKS];
+	int chunk = 0;
+	size_t chunk_offset = 0;
+	while (chunk < count) {
+		if (recorder -> fd < 0 || recorder -> file_bytes >= file_limit(recorder)) {
+			if (next_file(recorder) != 0) return 1;
+		}
+		// As much as fits in the current file, in one call
+		uint64_t room = file_limit(recorder) - recorder -> file_bytes;
+		int vector_count = 0;
+		size_t batch_bytes = 0;
+		for (int i=chunk; i < count && room > 0; i++) {
+			pcm_chunk_t* source = &recorder -> chunks[indexes[i]];
+			size_t offset = i == chunk ? chunk_offset : 0;
+			size_t length = (source -> count * sizeof(int16_t)) - offset;
+			if (length > room) length = room;
+			vectors[vector_count].iov_base = (uint8_t*) source -> samples + offset;
+			vectors[vector_count].iov_len = length;
+			vector_count++;
+			batch_bytes += length;
+			room -= length;
+		}
+
+		ssize_t written = writev(recorder -> fd, vectors, vector_count);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			log_error("Failed to write to the recording, error: %d\n", errno);
+			return 1;
+		}
+		recorder -> file_bytes += written;
+		recorder -> total_bytes += written;
+		// Move past whatever was written, short writes included
+		size_t remaining = written;
+		while (remaining > 0 && chunk < count) {
+			size_t chunk_left = (recorder -> chunks[indexes[chunk]].count * sizeof(int16_t)) - chunk_offset;
+			if (remaining < chunk_left) {
+				chunk_offset += remaining;
+				remaining = 0;
+			} else {
+				remaining -= chunk_left;
+				chunk++;
+				chunk_offset = 0;
+			}
+		}
+	}
+	return 0;
+}
+
+void* recorder_thread(void* userdata) {
+	pcm_recorder_t* recorder = userdata;
+	int batch[RECORDER_BATCH_CHUNKS];
+	bool failed = false;
+	while (true) {
+		pthread_mutex_lock(&recorder -> lock);
+		while (recorder -> running && recorder -> full_count == 0) {
+			pthread_cond_wait(&recorder -> filled, &recorder -> lock);
+		}
+		int count = 0;
+		while (count < RECORDER_BATCH_CHUNKS && recorder -> full_count > 0) {
+			batch[count++] = recorder -> full_chunks[recorder -> full_head];
+			recorder -> full_head = (recorder -> full_head + 1) % RECORDER_CHUNK_COUNT;
+			recorder -> full_count--;
+		}
+		bool running = recorder -> running;
+		pthread_mutex_unlock(&recorder -> lock);
+
+		// Once writing has failed, keep emptying the queue so capture can carry on
+		if (count > 0 && !failed) failed = write_chunks(recorder, batch, count) != 0;
+
+		pthread_mutex_lock(&recorder -> lock);
+		for (int i=0; i < count; i++) {
+			recorder -> chunks[batch[i]].count = 0;
+			recorder -> free_chunks[recorder -> free_count++] = batch[i];
+		}
+		pthread_mutex_unlock(&recorder -> lock);
+		if (!running && count == 0) break;
+	}
+	finish_file(recorder);
+	return NULL;
+}
+
+// Starts the writer thread, the first file isn't created until there's something to write
+// max_bytes/max_seconds - rotate to a new file after this much, 0 for no limit
+// Returns 0 on success, 1 on failure
+int start_recorder(pcm_recorder_t* recorder, const char* path, int sample_rate, uint64_t max_bytes, uint64_t max_seconds) {
+	memset(recorder, 0, sizeof(pcm_recorder_t));
+	snprintf(recorder -> path, sizeof(recorder -> path), "%s", path);
+	recorder -> sample_rate = sample_rate;
+	recorder -> max_bytes = max_bytes - (max_bytes % sizeof(int16_t));
+	recorder -> max_seconds = max_seconds;
+	recorder -> fd = -1;
+	recorder -> filling = -1;
+	recorder -> chunks = malloc(sizeof(pcm_chunk_t) * RECORDER_CHUNK_COUNT);
+	if (recorder -> chunks == NULL) return 1;
+	for (int i=0; i < RECORDER_CHUNK_COUNT; i++) {
+		recorder -> chunks[i].count = 0;
+		recorder -> free_chunks[i] = i;
+	}
+	recorder -> free_count = RECORDER_CHUNK_COUNT;
+
+	pthread_mutex_init(&recorder -> lock, NULL);
+	pthread_cond_init(&recorder -> filled, NULL);
+	recorder -> running = true;
+	int create_stat = pthread_create(&recorder -> thread, NULL, recorder_thread, recorder);
+	if (create_stat != 0) {
+		log_error("Failed to start the recorder thread, error: %d\n", create_stat);
+		pthread_cond_destroy(&recorder -> filled);
+		pthread_mutex_destroy(&recorder -> lock);
+		free(recorder -> chunks);
+		recorder -> chunks = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+// Queues the filling chunk for writing and takes a free one, the lock must be held
+static void swap_filling(pcm_recorder_t* recorder) {
+	if (recorder -> filling >= 0 && recorder -> chunks[recorder -> filling].count > 0) {
+		int tail = (recorder -> full_head + recorder -> full_count) % RECORDER_CHUNK_COUNT;
+		recorder -> full_chunks[tail] = recorder -> filling;
+		recorder -> full_count++;
+		recorder -> filling = -1;
+		pthread_cond_signal(&recorder -> filled);
+	}
+	if (recorder -> filling < 0 && recorder -> free_count > 0) {
+		recorder -> filling = recorder -> free_chunks[--recorder -> free_count];
+	}
+}
+
+// Copies captured samples in to be written, called from the analysis thread
+// Never waits on the disk, samples are dropped if there's no free chunk to put them in
+void record_pcm(pcm_recorder_t* recorder, const int16_t* samples, int count) {
+	pthread_mutex_lock(&recorder -> lock);
+	int copied = 0;
+	while (copied < count) {
+		if (recorder -> filling < 0 || recorder -> chunks[recorder -> filling].count == RECORDER_CHUNK_SAMPLES) {
+			swap_filling(recorder);
+		}
+		if (recorder -> filling < 0) {
+			if (recorder -> dropped_samples == 0) log_warn("Recording can't keep up, dropping samples\n");
+			recorder -> dropped_samples += count - copied;
+			break;
+		}
+		pcm_chunk_t* chunk = &recorder -> chunks[recorder -> filling];
+		int space = RECORDER_CHUNK_SAMPLES - chunk -> count;
+		int length = count - copied < space ? count - copied : space;
+		memcpy(chunk -> samples + chunk -> count, samples + copied, sizeof(int16_t) * length);
+		chunk -> count += length;
+		copied += length;
+	}
+	pthread_mutex_unlock(&recorder -> lock);
+}
+
+// Writes out everything captured so far, finalises the last file and stops the writer
+void stop_recorder(pcm_recorder_t* recorder) {
+	if (recorder -> chunks == NULL) return;
+	pthread_mutex_lock(&recorder -> lock);
+	swap_filling(recorder);
+	recorder -> running = false;
+	pthread_cond_signal(&recorder -> filled);
+	pthread_mutex_unlock(&recorder -> lock);
+	pthread_join(recorder -> thread, NULL);
+
+	log_info("Recorded %lu bytes over %lu files, dropped %lu samples\n", (unsigned long) recorder -> total_bytes, recorder -> files_written, recorder -> dropped_samples);
+	pthread_cond_destroy(&recorder -> filled);
+	pthread_mutex_destroy(&recorder -> lock);
+	free(recorder -> chunks);
+	recorder -> chunks = NULL;
+}
@@ -0,0 +1,56 @@
+#pragma once
+// Appends captured PCM to WAV files on a writer thread of its own
+// Capture only copies samples into a fixed pool of chunks, so disk stalls never hold it up.
+// If the disk falls behind until the pool is used up, samples are dropped (and counted) instead of using more memory
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <shared.h>
+
+// 64 chunks of 32K samples, 4MB or ~47s of audio buffered at most
+#define RECORDER_CHUNK_SAMPLES 32768
+#define RECORDER_CHUNK_COUNT 64
+// Up to this many full chunks go out in one writev
+#define RECORDER_BATCH_CHUNKS 16
+
+typedef struct pcm_chunk {
+	int16_t samples[RECORDER_CHUNK_SAMPLES];
+	int count;
+} pcm_chunk_t;
+
+typedef struct pcm_recorder {
+	// e.g capture.wav, numbered as capture-0001.wav etc when rotating
+	char path[256];
+	int sample_rate;
+	// Start a new file after this many data bytes or seconds of audio, 0 for no limit
+	uint64_t max_bytes;
+	uint64_t max_seconds;
+
+	pcm_chunk_t* chunks;
+	// Guards the queues and running, never held during I/O
+	pthread_mutex_t lock;
+	pthread_cond_t filled;
+	bool running;
+	// Chunk indexes, free ones waiting to be filled and full ones waiting to be written
+	int free_chunks[RECORDER_CHUNK_COUNT];
+	int free_count;
+	int full_chunks[RECORDER_CHUNK_COUNT];
+	int full_head;
+	int full_count;
+	// The chunk capture is filling, -1 if it couldn't get one
+	int filling;
+	unsigned long dropped_samples;
+
+	// Only touched by the writer thread
+	pthread_t thread;
+	int fd;
+	int file_number;
+	uint64_t file_bytes;
+	unsigned long files_written;
+	uint64_t total_bytes;
+} pcm_recorder_t;
+
+int start_recorder(pcm_recorder_t* recorder, const char* path, int sample_rate, uint64_t max_bytes, uint64_t max_seconds);
+void record_pcm(pcm_recorder_t* recorder, const int16_t* samples, int count);
+void stop_recorder(pcm_recorder_t* recorder);
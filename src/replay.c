@@ -0,0 +1,135 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <replay.h>
+#include <shared.h>
+#include <wav.h>
+#include <log.h>
+
+// Maps a 16-bit mono WAV, or failing that treats the file as raw samples (e.g record.bin)
+// realtime - hand blocks out at the rate they were recorded
+// Returns 0 on success, 1 on failure
+int open_replay(replay_source_t* replay, const char* path, bool realtime) {
+	replay -> path = path;
+	replay -> map = NULL;
+	replay -> synthetic = false;
+	replay -> realtime = realtime;
+	replay -> loop = false;
+	replay -> position = 0;
+	replay -> start_ns = 0;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		log_error("Failed to open replay file: %s\n", path);
+		return 1;
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+		log_error("Replay file is empty or unreadable: %s\n", path);
+		close(fd);
+		return 1;
+	}
+	replay -> map_length = file_stat.st_size;
+	replay -> map = mmap(NULL, replay -> map_length, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping holds its own reference to the file
+	close(fd);
+	if (replay -> map == MAP_FAILED) {
+		log_error("Failed to map replay file: %s\n", path);
+		replay -> map = NULL;
+		return 1;
+	}
+	// We only ever read forwards, so have the kernel read ahead and drop pages behind us
+	madvise(replay -> map, replay -> map_length, MADV_SEQUENTIAL);
+
+	wav_info_t info;
+	size_t data_offset = 0;
+	size_t data_bytes = replay -> map_length;
+	replay -> sample_rate = MAX_SAMPLE_RATE;
+	if (parse_wav(replay -> map, replay -> map_length, &info) == 0) {
+		if (info.channels != 1 || info.bits_per_sample != 16) {
+			log_error("Can only replay 16-bit mono WAVs, %s has %d channels of %d-bit\n", path, info.channels, info.bits_per_sample);
+			close_replay(replay);
+			return 1;
+		}
+		if (info.sample_rate != MAX_SAMPLE_RATE) {
+			log_warn("%s was recorded at %dHz, spectra will be labelled as %dHz\n", path, info.sample_rate, MAX_SAMPLE_RATE);
+		}
+		replay -> sample_rate = info.sample_rate;
+		data_offset = info.data_offset;
+		data_bytes = info.data_bytes;
+	}
+	// Chunks are padded to an even size, so the samples are always aligned
+	replay -> samples = (const int16_t*) ((const uint8_t*) replay -> map + data_offset);
+	replay -> sample_count = data_bytes / sizeof(int16_t);
+	log_info("Replaying %lu samples (%.1fs) from %s%s\n", replay -> sample_count, (double) replay -> sample_count / replay -> sample_rate, path, realtime ? "" : " at full speed");
+	return 0;
+}
+
+// Generates seconds of a sweeping tone over a second, quieter tone, then loops it as fast as it's asked for
+// Returns 0 on success, 1 on failure
+int open_synthetic_replay(replay_source_t* replay, int seconds) {
+	replay -> path = "synthetic";
+	replay -> synthetic = true;
+	replay -> realtime = false;
+	replay -> loop = true;
+	replay -> position = 0;
+	replay -> start_ns = 0;
+	replay -> sample_rate = MAX_SAMPLE_RATE;
+	replay -> sample_count = (size_t) seconds * MAX_SAMPLE_RATE;
+	replay -> map_length = replay -> sample_count * sizeof(int16_t);
+	int16_t* samples = malloc(replay -> map_length);
+	replay -> map = samples;
+	replay -> samples = samples;
+	if (samples == NULL) return 1;
+	double phase = 0;
+	for (size_t i=0; i < replay -> sample_count; i++) {
+		double t = (double) i / MAX_SAMPLE_RATE;
+		// 100Hz up to 10kHz each second
+		double frequency = 100 * pow(100, fmod(t, 1.0));
+		phase += 2 * M_PI * frequency / MAX_SAMPLE_RATE;
+		samples[i] = (int16_t) (12000 * sin(phase) + 3000 * sin(2 * M_PI * 440 * t));
+	}
+	return 0;
+}
+
+// True once there isn't a whole block left
+bool replay_finished(replay_source_t* replay, int block_samples) {
+	return replay -> sample_count - replay -> position < (size_t) block_samples;
+}
+
+// Returns the next block_samples samples, pointing into the mapping
+// When replaying in real time this waits until the block would have been captured
+// Returns NULL once there isn't a whole block left
+const int16_t* next_replay_block(replay_source_t* replay, int block_samples) {
+	if (replay -> map == NULL) return NULL;
+	if (replay -> loop && replay_finished(replay, block_samples)) {
+		replay -> position = 0;
+	}
+	if (replay_finished(replay, block_samples)) return NULL;
+	if (replay -> realtime) {
+		if (replay -> position == 0) replay -> start_ns = get_monotonic_ns();
+		// Hand a block out once all of its samples would have arrived
+		uint64_t due_ns = replay -> start_ns + (uint64_t) ((double) (replay -> position + block_samples) * 1000000000 / replay -> sample_rate);
+		struct timespec due = {due_ns / 1000000000, due_ns % 1000000000};
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR);
+	}
+	const int16_t* block = replay -> samples + replay -> position;
+	replay -> position += block_samples;
+	return block;
+}
+
+void close_replay(replay_source_t* replay) {
+	if (replay -> map != NULL && replay -> synthetic) {
+		free(replay -> map);
+		replay -> map = NULL;
+	} else if (replay -> map != NULL) {
+		munmap(replay -> map, replay -> map_length);
+		replay -> map = NULL;
+	}
+}
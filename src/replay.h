@@ -0,0 +1,33 @@
+#pragma once
+// Replays a recording in place of a PulseAudio capture
+// The file is mapped rather than read, each block is transformed straight from the mapping
+// Can also be a generated signal, looped forever, for benchmarking without a device
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct replay_source {
+	const char* path;
+	// The whole file, samples points into it
+	// Or the generated samples when synthetic
+	void* map;
+	bool synthetic;
+	size_t map_length;
+	const int16_t* samples;
+	size_t sample_count;
+	int sample_rate;
+	// Paced to the sample rate when set, otherwise blocks are handed out as fast as they're asked for
+	bool realtime;
+	// Starts again from the beginning instead of finishing
+	bool loop;
+	// The next sample to hand out and when the first block was handed out
+	size_t position;
+	uint64_t start_ns;
+} replay_source_t;
+
+int open_replay(replay_source_t* replay, const char* path, bool realtime);
+int open_synthetic_replay(replay_source_t* replay, int seconds);
+const int16_t* next_replay_block(replay_source_t* replay, int block_samples);
+bool replay_finished(replay_source_t* replay, int block_samples);
+void close_replay(replay_source_t* replay);
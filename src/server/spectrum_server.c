@@ -0,0 +1,298 @@
+// accept4
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <server/spectrum_server.h>
+#include <frame_format.h>
+#include <processing.h>
+#include <log.h>
+
+// epoll tags, clients are tagged with their index offset by CLIENT_TAG
+#define LISTEN_TAG 0
+#define EVENT_TAG 1
+#define CLIENT_TAG 2
+#define MAX_EVENTS 64
+
+static size_t record_capacity() {
+	return frame_size(SUBSCRIPTION_MAX_VALUES);
+}
+
+static void watch_fd(spectrum_server_t* server, int op, int fd, uint32_t events, uint64_t tag) {
+	struct epoll_event event;
+	event.events = events;
+	event.data.u64 = tag;
+	epoll_ctl(server -> epoll_fd, op, fd, &event);
+}
+
+// Bumps the eventfd, this only fails if the counter is about to overflow i.e the server is already awake
+static void wake_server(spectrum_server_t* server) {
+	uint64_t wakeup = 1;
+	ssize_t written = write(server -> event_fd, &wakeup, sizeof(wakeup));
+	(void) written;
+}
+
+static void close_client(spectrum_server_t* server, spectrum_client_t* client) {
+	log_info("Socket client %d disconnected, sent: %lu, dropped: %lu\n", client -> fd, client -> records_sent, client -> records_dropped);
+	epoll_ctl(server -> epoll_fd, EPOLL_CTL_DEL, client -> fd, NULL);
+	close(client -> fd);
+	client -> fd = -1;
+	client -> subscribed = false;
+}
+
+static void accept_clients(spectrum_server_t* server) {
+	while (true) {
+		int fd = accept4(server -> listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) return;
+
+		spectrum_client_t* client = NULL;
+		int index = 0;
+		for (; index < SPECTRUM_SERVER_MAX_CLIENTS; index++) {
+			if (server -> clients[index].fd < 0) {
+				client = &server -> clients[index];
+				break;
+			}
+		}
+		if (client == NULL) {
+			log_warn("Too many socket clients, refusing another\n");
+			close(fd);
+			continue;
+		}
+		client -> fd = fd;
+		client -> subscribed = false;
+		client -> line_length = 0;
+		client -> record_length = 0;
+		client -> record_sent = 0;
+		client -> spectra_seen = 0;
+		client -> last_sent_ns = 0;
+		client -> records_sent = 0;
+		client -> records_dropped = 0;
+		watch_fd(server, EPOLL_CTL_ADD, fd, EPOLLIN, CLIENT_TAG + index);
+		log_info("Socket client %d connected\n", fd);
+	}
+}
+
+// Reads subscription lines from the client
+// Returns 0 while the client is fine, 1 if it should be disconnected
+static int read_client(spectrum_client_t* client) {
+	char buffer[SPECTRUM_SERVER_LINE_MAX];
+	ssize_t length = read(client -> fd, buffer, sizeof(buffer));
+	if (length == 0) return 1;
+	if (length < 0) return errno == EAGAIN || errno == EINTR ? 0 : 1;
+
+	for (ssize_t i=0; i < length; i++) {
+		if (buffer[i] != '\n') {
+			if (client -> line_length >= SPECTRUM_SERVER_LINE_MAX - 1) return 1;
+			client -> line[client -> line_length++] = buffer[i];
+			continue;
+		}
+		client -> line[client -> line_length] = '\0';
+		client -> line_length = 0;
+		if (parse_subscription(client -> line, &client -> subscription) != 0) {
+			log_warn("Invalid subscription from socket client %d: %s\n", client -> fd, client -> line);
+			return 1;
+		}
+		client -> subscribed = true;
+		client -> spectra_seen = 0;
+		log_info("Socket client %d subscribed: %s\n", client -> fd, client -> line);
+	}
+	return 0;
+}
+
+// Writes as much of the client's record as the socket will take
+// Returns 0 while the client is fine, 1 if it should be disconnected
+static int flush_client(spectrum_server_t* server, spectrum_client_t* client, int index) {
+	while (client -> record_sent < client -> record_length) {
+		ssize_t sent = send(client -> fd, client -> record + client -> record_sent, client -> record_length - client -> record_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (sent < 0) {
+			if (errno == EINTR) continue;
+			if (errno != EAGAIN) return 1;
+			// Come back when the socket drains
+			watch_fd(server, EPOLL_CTL_MOD, client -> fd, EPOLLIN | EPOLLOUT, CLIENT_TAG + index);
+			return 0;
+		}
+		client -> record_sent += sent;
+	}
+	watch_fd(server, EPOLL_CTL_MOD, client -> fd, EPOLLIN, CLIENT_TAG + index);
+	return 0;
+}
+
+// Queues the spectrum to each subscribed client that wants it
+static void send_spectrum(spectrum_server_t* server, uint64_t sequence) {
+	uint64_t now_ns = get_monotonic_ns();
+	uint64_t timestamp_ns = get_realtime_ns();
+	for (int index=0; index < SPECTRUM_SERVER_MAX_CLIENTS; index++) {
+		spectrum_client_t* client = &server -> clients[index];
+		if (client -> fd < 0 || !client -> subscribed) continue;
+		subscription_t* subscription = &client -> subscription;
+		client -> spectra_seen++;
+		if (client -> spectra_seen % subscription -> decimate != 0) continue;
+		if (subscription -> rate > 0 && client -> last_sent_ns != 0 && now_ns - client -> last_sent_ns < 1000000000 / subscription -> rate) continue;
+		// Still writing the last one, this client is falling behind
+		if (client -> record_sent < client -> record_length) {
+			client -> records_dropped++;
+			continue;
+		}
+
+		int count = subscription_values(subscription, server -> current, server -> values, SUBSCRIPTION_MAX_VALUES);
+		client -> record_length = encode_frame_values(client -> record, record_capacity(), timestamp_ns, sequence, server -> current -> sample_rate, server -> values, count);
+		client -> record_sent = 0;
+		client -> last_sent_ns = now_ns;
+		client -> records_sent++;
+		if (flush_client(server, client, index) != 0) close_client(server, client);
+	}
+}
+
+void* spectrum_server_thread(void* userdata) {
+	spectrum_server_t* server = userdata;
+	struct epoll_event events[MAX_EVENTS];
+	while (true) {
+		int count = epoll_wait(server -> epoll_fd, events, MAX_EVENTS, -1);
+		if (count < 0 && errno != EINTR) break;
+
+		for (int i=0; i < count; i++) {
+			uint64_t tag = events[i].data.u64;
+			if (tag == LISTEN_TAG) {
+				accept_clients(server);
+			} else if (tag == EVENT_TAG) {
+				uint64_t wakeups;
+				if (read(server -> event_fd, &wakeups, sizeof(wakeups)) < 0) continue;
+				pthread_mutex_lock(&server -> lock);
+				bool running = server -> running;
+				bool has_pending = server -> has_pending;
+				uint64_t sequence = server -> pending_sequence;
+				if (has_pending) {
+					// Take the pending spectrum, the analysis thread fills the old one next time
+					complex_set_t* taken = server -> pending;
+					server -> pending = server -> current;
+					server -> current = taken;
+					server -> has_pending = false;
+				}
+				pthread_mutex_unlock(&server -> lock);
+				if (!running) return NULL;
+				if (has_pending) send_spectrum(server, sequence);
+			} else {
+				int index = tag - CLIENT_TAG;
+				spectrum_client_t* client = &server -> clients[index];
+				if (client -> fd < 0) continue;
+				bool failed = (events[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+				if (!failed && (events[i].events & EPOLLIN)) failed = read_client(client) != 0;
+				if (!failed && (events[i].events & EPOLLOUT)) failed = flush_client(server, client, index) != 0;
+				if (failed) close_client(server, client);
+			}
+		}
+	}
+	return NULL;
+}
+
+// Listens on path and starts the server thread
+// Returns 0 on success, 1 on failure
+int start_spectrum_server(spectrum_server_t* server, const char* path) {
+	memset(server, 0, sizeof(spectrum_server_t));
+	server -> listen_fd = server -> epoll_fd = server -> event_fd = -1;
+	for (int i=0; i < SPECTRUM_SERVER_MAX_CLIENTS; i++) {
+		server -> clients[i].fd = -1;
+	}
+	if (strlen(path) >= sizeof(server -> path)) {
+		log_error("Socket path is too long: %s\n", path);
+		return 1;
+	}
+	strcpy(server -> path, path);
+
+	// Clear out a socket left behind by a previous run, but nothing else
+	struct stat existing;
+	if (lstat(path, &existing) == 0 && S_ISSOCK(existing.st_mode)) unlink(path);
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	server -> listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (server -> listen_fd < 0
+			|| bind(server -> listen_fd, (struct sockaddr*) &address, sizeof(address)) != 0
+			|| listen(server -> listen_fd, SPECTRUM_SERVER_MAX_CLIENTS) != 0) {
+		log_error("Failed to listen on socket: %s, error: %d\n", path, errno);
+		if (server -> listen_fd >= 0) close(server -> listen_fd);
+		return 1;
+	}
+
+	server -> epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	server -> event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (server -> epoll_fd < 0 || server -> event_fd < 0) {
+		log_error("Failed to set up epoll for the socket server\n");
+		stop_spectrum_server(server);
+		return 1;
+	}
+	watch_fd(server, EPOLL_CTL_ADD, server -> listen_fd, EPOLLIN, LISTEN_TAG);
+	watch_fd(server, EPOLL_CTL_ADD, server -> event_fd, EPOLLIN, EVENT_TAG);
+
+	malloc_complex_set(&server -> pending, NUM_SAMPLES, MAX_SAMPLE_RATE);
+	malloc_complex_set(&server -> current, NUM_SAMPLES, MAX_SAMPLE_RATE);
+	server -> values = malloc(sizeof(float) * SUBSCRIPTION_MAX_VALUES);
+	for (int i=0; i < SPECTRUM_SERVER_MAX_CLIENTS; i++) {
+		server -> clients[i].record = malloc(record_capacity());
+	}
+
+	pthread_mutex_init(&server -> lock, NULL);
+	server -> running = true;
+	int create_stat = pthread_create(&server -> thread, NULL, spectrum_server_thread, server);
+	if (create_stat != 0) {
+		log_error("Failed to start the socket server thread, error: %d\n", create_stat);
+		server -> running = false;
+		// stop_spectrum_server only destroys the lock along with a running thread
+		pthread_mutex_destroy(&server -> lock);
+		stop_spectrum_server(server);
+		return 1;
+	}
+	log_info("Serving spectra on socket: %s\n", path);
+	return 0;
+}
+
+// Hands the server a new spectrum, called from the analysis thread
+// Only copies and wakes the server, the server thread does the sending
+void offer_spectrum(spectrum_server_t* server, complex_set_t* spectrum, uint64_t sequence) {
+	pthread_mutex_lock(&server -> lock);
+	complex_set_t* pending = server -> pending;
+	pending -> data_size = spectrum -> data_size;
+	pending -> sample_rate = spectrum -> sample_rate;
+	pending -> frequency = spectrum -> frequency;
+	memcpy(pending -> complex_numbers, spectrum -> complex_numbers, sizeof(complex_wrapper_t) * spectrum -> data_size);
+	server -> pending_sequence = sequence;
+	server -> has_pending = true;
+	pthread_mutex_unlock(&server -> lock);
+	wake_server(server);
+}
+
+// Stops the server thread, disconnects everyone and removes the socket
+void stop_spectrum_server(spectrum_server_t* server) {
+	if (server -> running) {
+		pthread_mutex_lock(&server -> lock);
+		server -> running = false;
+		pthread_mutex_unlock(&server -> lock);
+		wake_server(server);
+		pthread_join(server -> thread, NULL);
+		pthread_mutex_destroy(&server -> lock);
+	}
+	for (int i=0; i < SPECTRUM_SERVER_MAX_CLIENTS; i++) {
+		if (server -> clients[i].fd >= 0) close_client(server, &server -> clients[i]);
+		free(server -> clients[i].record);
+		server -> clients[i].record = NULL;
+	}
+	if (server -> listen_fd >= 0) {
+		close(server -> listen_fd);
+		unlink(server -> path);
+	}
+	if (server -> epoll_fd >= 0) close(server -> epoll_fd);
+	if (server -> event_fd >= 0) close(server -> event_fd);
+	server -> listen_fd = server -> epoll_fd = server -> event_fd = -1;
+	free_complex_set(server -> pending);
+	free_complex_set(server -> current);
+	free(server -> values);
+	server -> pending = server -> current = NULL;
+	server -> values = NULL;
+}
@@ -0,0 +1,58 @@
+#pragma once
+// Serves spectra to local clients over a Unix domain socket
+// Runs an epoll loop on a thread of its own, capture only ever hands it the latest spectrum
+// Writes never block, a client that hasn't taken its last record yet misses the next one
+// See subscription.h for the protocol
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/un.h>
+
+#include <shared.h>
+#include <server/subscription.h>
+
+#define SPECTRUM_SERVER_DEFAULT_PATH "/tmp/purses.sock"
+#define SPECTRUM_SERVER_MAX_CLIENTS 32
+#define SPECTRUM_SERVER_LINE_MAX 128
+
+typedef struct spectrum_client {
+	int fd;
+	bool subscribed;
+	subscription_t subscription;
+	// Partial command line
+	char line[SPECTRUM_SERVER_LINE_MAX];
+	int line_length;
+	// The record being written, at most one at a time
+	uint8_t* record;
+	size_t record_length;
+	size_t record_sent;
+	// For decimation and rate limiting
+	unsigned long spectra_seen;
+	uint64_t last_sent_ns;
+	unsigned long records_sent;
+	unsigned long records_dropped;
+} spectrum_client_t;
+
+typedef struct spectrum_server {
+	char path[sizeof(((struct sockaddr_un*) 0) -> sun_path)];
+	int listen_fd;
+	int epoll_fd;
+	// Wakes the server thread for a new spectrum or to stop
+	int event_fd;
+	pthread_t thread;
+	// Guards pending/pending_sequence/running, the hand-off from the analysis thread
+	pthread_mutex_t lock;
+	bool running;
+	complex_set_t* pending;
+	uint64_t pending_sequence;
+	bool has_pending;
+	// Only touched by the server thread
+	complex_set_t* current;
+	spectrum_client_t clients[SPECTRUM_SERVER_MAX_CLIENTS];
+	float* values;
+} spectrum_server_t;
+
+int start_spectrum_server(spectrum_server_t* server, const char* path);
+void offer_spectrum(spectrum_server_t* server, complex_set_t* spectrum, uint64_t sequence);
+void stop_spectrum_server(spectrum_server_t* server);
@@ -0,0 +1,97 @@
+#include <math.h>
+#include <stdlib.h>
+#include <server/subscription.h>
+
+// Parses a SUBSCRIBE line into subscription
+// Returns 0 on success, 1 if the line isn't a valid subscription
+int parse_subscription(const char* line, subscription_t* subscription) {
+	char kind[16];
+	int consumed = 0;
+	if (sscanf(line, "SUBSCRIBE %15s%n", kind, &consumed) != 1) return 1;
+
+	if (strcmp(kind, "spectrum") == 0) {
+		subscription -> kind = SUBSCRIBE_SPECTRUM;
+	} else if (strcmp(kind, "bands") == 0) {
+		subscription -> kind = SUBSCRIBE_BANDS;
+	} else if (strcmp(kind, "levels") == 0) {
+		subscription -> kind = SUBSCRIBE_LEVELS;
+	} else {
+		return 1;
+	}
+	subscription -> rate = 0;
+	subscription -> decimate = 1;
+	subscription -> bands = SUBSCRIPTION_DEFAULT_BANDS;
+
+	const char* options = line + consumed;
+	char option[32];
+	int option_length = 0;
+	while (sscanf(options, " %31s%n", option, &option_length) == 1) {
+		options += option_length;
+		int value = 0;
+		if (sscanf(option, "rate=%d", &value) == 1 && value >= 0) {
+			subscription -> rate = value;
+		} else if (sscanf(option, "decimate=%d", &value) == 1 && value >= 1) {
+			subscription -> decimate = value;
+		} else if (sscanf(option, "bands=%d", &value) == 1 && value >= 1 && value <= SUBSCRIPTION_MAX_BANDS) {
+			subscription -> bands = value;
+		} else {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Averages the magnitudes into log-spaced bands, skipping the DC bin
+static int band_values(int bands, complex_set_t* spectrum, float* values) {
+	int bins = spectrum -> data_size;
+	if (bins < 2) return 0;
+	if (bands > bins - 1) bands = bins - 1;
+	double ratio = pow(bins, 1.0 / bands);
+	int start = 1;
+	for (int band=0; band < bands; band++) {
+		int end = (int) pow(ratio, band + 1);
+		// Low bands can be narrower than a bin, so always take at least one
+		if (end <= start) end = start + 1;
+		if (end > bins || band == bands - 1) end = bins;
+		double sum = 0;
+		for (int i=start; i < end; i++) {
+			sum += spectrum -> complex_numbers[i].magnitude;
+		}
+		values[band] = end > start ? sum / (end - start) : 0;
+		start = end < bins ? end : bins - 1;
+	}
+	return bands;
+}
+
+// The overall level from the total power, and the loudest bin
+static int level_values(complex_set_t* spectrum, float* values) {
+	double power = 0;
+	double peak = 0;
+	for (int i=1; i < spectrum -> data_size; i++) {
+		double magnitude = spectrum -> complex_numbers[i].magnitude;
+		power += magnitude * magnitude;
+		if (magnitude > peak) peak = magnitude;
+	}
+	values[0] = power > 0 ? 10 * log10(power) : 0;
+	values[1] = peak > 0 ? 20 * log10(peak) : 0;
+	return 2;
+}
+
+// Fills values with what the subscriber wants from the spectrum
+// Returns the number of values, at most capacity
+int subscription_values(subscription_t* subscription, complex_set_t* spectrum, float* values, int capacity) {
+	switch (subscription -> kind) {
+		case SUBSCRIBE_BANDS:
+			return band_values(subscription -> bands < capacity ? subscription -> bands : capacity, spectrum, values);
+		case SUBSCRIBE_LEVELS:
+			return capacity >= 2 ? level_values(spectrum, values) : 0;
+		case SUBSCRIBE_SPECTRUM:
+		default: {
+			int count = spectrum -> data_size < capacity ? spectrum -> data_size : capacity;
+			for (int i=0; i < count; i++) {
+				values[i] = (float) spectrum -> complex_numbers[i].magnitude;
+			}
+			return count;
+		}
+	}
+}
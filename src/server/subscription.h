@@ -0,0 +1,36 @@
+#pragma once
+// What a socket client has asked for, and building the values it's sent
+//
+// Clients send a single line to subscribe (and can send another to change it):
+//   SUBSCRIBE <spectrum|bands|levels> [rate=<max Hz>] [decimate=<n>] [bands=<n>]
+// rate=0 (the default) sends every spectrum, decimate=n sends every nth spectrum
+// Every message back is a frame_format.h record, the values depend on the kind:
+//   spectrum - one magnitude per bin
+//   bands    - the mean magnitude of n log-spaced bands (32 by default)
+//   levels   - two values, the overall level and the peak bin level in dB
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <shared.h>
+
+#define SUBSCRIPTION_DEFAULT_BANDS 32
+#define SUBSCRIPTION_MAX_BANDS 256
+#define SUBSCRIPTION_MAX_VALUES (NUM_SAMPLES/2)
+
+typedef enum subscription_kind {
+	SUBSCRIBE_SPECTRUM,
+	SUBSCRIBE_BANDS,
+	SUBSCRIBE_LEVELS
+} subscription_kind_t;
+
+typedef struct subscription {
+	subscription_kind_t kind;
+	// Max records per second, 0 for no limit
+	int rate;
+	// Only every nth spectrum is considered
+	int decimate;
+	int bands;
+} subscription_t;
+
+int parse_subscription(const char* line, subscription_t* subscription);
+int subscription_values(subscription_t* subscription, complex_set_t* spectrum, float* values, int capacity);
@@ -14,11 +14,10 @@ pa_device_t get_main_device() {
   pa_device_t* sink_list = malloc(sizeof(pa_device_t) * DEVICE_MAX);
   get_sinks(sink_list, &count);
   print_devicelist(sink_list, DEVICE_MAX);
-  pa_device_t* chosen_device = malloc(sizeof(pa_device_t));
   // Copy the device we want
-  chosen_device = &sink_list[0];
+  pa_device_t chosen_device = sink_list[0];
   free(sink_list);
-  return (*chosen_device);
+  return chosen_device;
 }
 
 // Gets a single character of input from the provided window
@@ -103,9 +102,9 @@ pa_device_t show_device_choice_window(WINDOW* settings_window, int* device_index
     }
   }
     
-  return sink_list[chosen_device_index];
-
+  pa_device_t chosen_device = sink_list[chosen_device_index];
   free(sink_list);
+  return chosen_device;
 }
 
 
@@ -1,22 +1,28 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <time.h>
 #include <shared.h>
+#include <log.h>
 
 const char* LOGFILE_NAME = "purses.log";
 
 FILE* logfile = 0;
+// Only the first open of a run starts a fresh log, anything logged after closing it is appended
+static bool logfile_opened = false;
 
 FILE* get_logfile() {
 	if (logfile == 0) {
-		logfile = fopen(LOGFILE_NAME, "w");
+		logfile = fopen(LOGFILE_NAME, logfile_opened ? "a" : "w");
+		logfile_opened = true;
 	}
 	return logfile;
 }
 
 int close_logfile() {
 	if (logfile != 0) {
-		//fflush(logfile);
-		return fclose(logfile);
+		int close_stat = fclose(logfile);
+		logfile = 0;
+		return close_stat;
 	} else {
 		return 0;
 	}
@@ -56,10 +62,10 @@ void print_data(complex_set_t* samples) {
 void fprintln (char* format) {
 	int current_len = strlen(format);
 
-	// Add space for the newline char
-	char expanded[current_len+1];
+	// Add space for the newline and terminating chars
+	char expanded[current_len+2];
 	// Copy and append the newline
-	strcat(expanded, format);
+	strcpy(expanded, format);
 	strcat(expanded, "\n");
 
   printf(expanded);	
@@ -72,14 +78,13 @@ void printlncol( char* ansi_code, char* format) {
 }
 
 long seek_file_size(FILE* file) {
-	FILE* logfile = get_logfile();
 
-	fprintf(logfile, "Capturing initial file pos... \n");
+	log_debug("Capturing initial file pos... \n");
 
 	fpos_t original_file_pos;
 	fgetpos(file, &original_file_pos);
 
-	fprintf(logfile, "Seeking end of file... \n");
+	log_debug("Seeking end of file... \n");
 
 	//Set position indicator to 0 from the end of the FILE*
 	fseek(file, 0, SEEK_END);
@@ -92,13 +97,12 @@ long seek_file_size(FILE* file) {
 }
 
 void write_to_file(record_stream_data_t* stream_read_data, char* filename) {
-	FILE* logfile = get_logfile();
 	FILE* outfile = fopen(filename, "w");
 
 	int16_t* record_samples = stream_read_data -> data;
 	int sample_count = stream_read_data -> data_size;
 	if (sample_count > 0) {
-		fprintf(logfile, "Writing record stream of %d samples to file: %s...\n", sample_count, filename);
+		log_debug("Writing record stream of %d samples to file: %s...\n", sample_count, filename);
 		fwrite(record_samples, sizeof(int16_t), sample_count, outfile);
 	} else {
 		printf("Given record_stream_data_t has a data_size of 0!\n");
@@ -111,22 +115,35 @@ void write_to_file(record_stream_data_t* stream_read_data, char* filename) {
 // Fills in the record_stream_data_t from the file named
 // Reads up to data_size (count) samples
 void read_from_file(record_stream_data_t* stream_read_data, char* filename) {
-	FILE* logfile = get_logfile();
 
 	int count = stream_read_data -> data_size;
-	fprintf(logfile, "Reading record stream of %d samples from file: %s...\n", count, filename);
+	log_debug("Reading record stream of %d samples from file: %s...\n", count, filename);
 
 	FILE* outfile = fopen(filename, "r");
 	long file_size = seek_file_size(outfile);
-	fprintf(logfile, "File is %ld bytes long.\n", file_size);
+	log_debug("File is %ld bytes long.\n", file_size);
 
 	int16_t* record_data = stream_read_data -> data;
 	void* read_buff = record_data;
 	fread(read_buff, sizeof(int16_t), count, outfile);
 	for (int i=0; i<count; i++) {
 		int16_t sample_data = record_data[i];
-		fprintf(logfile, "index: %d, data: %d\n", i , (signed int) sample_data);
+		log_debug("index: %d, data: %d\n", i , (signed int) sample_data);
 	}
 
 	fclose(outfile);
 }
+
+// Nanoseconds from the monotonic clock, for timing that shouldn't jump with the wall clock
+uint64_t get_monotonic_ns() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t) now.tv_sec * 1000000000) + now.tv_nsec;
+}
+
+// Nanoseconds since the unix epoch, for timestamps other processes will read
+uint64_t get_realtime_ns() {
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return ((uint64_t) now.tv_sec * 1000000000) + now.tv_nsec;
+}
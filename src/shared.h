@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <complex.h>
@@ -58,3 +59,5 @@ void printlncol(char* ansi_code, char* format);
 long seek_file_size(FILE* file);
 void write_to_file(record_stream_data_t* stream_read_data, char* filename);
 void read_from_file(record_stream_data_t* stream_read_data, char* filename);
+uint64_t get_monotonic_ns();
+uint64_t get_realtime_ns();
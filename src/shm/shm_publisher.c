@@ -0,0 +1,72 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <shm/shm_publisher.h>
+#include <log.h>
+
+// Creates (or takes over) the named shared memory object and maps it
+// Returns 0 on success, 1 on failure
+int open_shm_publisher(shm_publisher_t* publisher, const char* name) {
+	publisher -> shm = NULL;
+	snprintf(publisher -> name, sizeof(publisher -> name), "%s", name);
+
+	int fd = shm_open(publisher -> name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		log_error("Failed to open shared memory: %s\n", publisher -> name);
+		return 1;
+	}
+	int truncate_stat = ftruncate(fd, sizeof(spectrum_shm_t));
+	void* mapped = truncate_stat == 0 ? mmap(NULL, sizeof(spectrum_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	// The mapping keeps the object alive
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		log_error("Failed to map shared memory: %s\n", publisher -> name);
+		shm_unlink(publisher -> name);
+		return 1;
+	}
+
+	spectrum_shm_t* shm = mapped;
+	memset(shm, 0, sizeof(spectrum_shm_t));
+	shm -> version = SPECTRUM_SHM_VERSION;
+	shm -> slot_count = SPECTRUM_SHM_SLOTS;
+	shm -> max_bins = SPECTRUM_SHM_MAX_BINS;
+	// Readers check the magic last, so it goes in once the rest is ready
+	atomic_thread_fence(memory_order_release);
+	shm -> magic = SPECTRUM_SHM_MAGIC;
+	publisher -> shm = shm;
+	log_info("Publishing spectra to shared memory: %s\n", publisher -> name);
+	return 0;
+}
+
+// Writes the spectrum's magnitudes into its slot, then marks it as the latest
+void publish_shm_spectrum(shm_publisher_t* publisher, complex_set_t* spectrum, uint64_t sequence, uint64_t timestamp_ns) {
+	spectrum_shm_t* shm = publisher -> shm;
+	if (shm == NULL) return;
+	spectrum_shm_slot_t* slot = &shm -> slots[sequence % SPECTRUM_SHM_SLOTS];
+	int bin_count = spectrum -> data_size < SPECTRUM_SHM_MAX_BINS ? spectrum -> data_size : SPECTRUM_SHM_MAX_BINS;
+
+	uint32_t lock = atomic_load_explicit(&slot -> lock, memory_order_relaxed);
+	atomic_store_explicit(&slot -> lock, lock + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	slot -> bin_count = bin_count;
+	slot -> sequence = sequence;
+	slot -> timestamp_ns = timestamp_ns;
+	slot -> sample_rate = spectrum -> sample_rate;
+	for (int i=0; i < bin_count; i++) {
+		slot -> magnitudes[i] = (float) spectrum -> complex_numbers[i].magnitude;
+	}
+
+	atomic_store_explicit(&slot -> lock, lock + 2, memory_order_release);
+	atomic_store_explicit(&shm -> latest_sequence, sequence, memory_order_release);
+}
+
+// Unmaps and removes the shared memory, readers that still have it mapped keep their view
+void close_shm_publisher(shm_publisher_t* publisher) {
+	if (publisher -> shm == NULL) return;
+	munmap(publisher -> shm, sizeof(spectrum_shm_t));
+	shm_unlink(publisher -> name);
+	publisher -> shm = NULL;
+}
@@ -0,0 +1,15 @@
+#pragma once
+// Publishes each spectrum into a POSIX shared memory ring for local readers
+// See spectrum_shm.h for the layout
+
+#include <shm/spectrum_shm.h>
+#include <shared.h>
+
+typedef struct shm_publisher {
+	char name[64];
+	spectrum_shm_t* shm;
+} shm_publisher_t;
+
+int open_shm_publisher(shm_publisher_t* publisher, const char* name);
+void publish_shm_spectrum(shm_publisher_t* publisher, complex_set_t* spectrum, uint64_t sequence, uint64_t timestamp_ns);
+void close_shm_publisher(shm_publisher_t* publisher);
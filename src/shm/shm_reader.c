@@ -0,0 +1,81 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <shm/shm_reader.h>
+
+// Maps the named shared memory read-only
+// Returns 0 on success, 1 if it doesn't exist (yet) or isn't a layout we understand
+int open_shm_reader(shm_reader_t* reader, const char* name) {
+	reader -> shm = NULL;
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) return 1;
+	struct stat info;
+	bool big_enough = fstat(fd, &info) == 0 && info.st_size >= (off_t) sizeof(spectrum_shm_t);
+	void* mapped = big_enough ? mmap(NULL, sizeof(spectrum_shm_t), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (mapped == MAP_FAILED) return 1;
+
+	const spectrum_shm_t* shm = mapped;
+	bool valid = shm -> magic == SPECTRUM_SHM_MAGIC;
+	atomic_thread_fence(memory_order_acquire);
+	if (!valid || shm -> version != SPECTRUM_SHM_VERSION || shm -> slot_count != SPECTRUM_SHM_SLOTS) {
+		munmap(mapped, sizeof(spectrum_shm_t));
+		return 1;
+	}
+	reader -> shm = shm;
+	return 0;
+}
+
+void close_shm_reader(shm_reader_t* reader) {
+	if (reader -> shm == NULL) return;
+	munmap((void*) reader -> shm, sizeof(spectrum_shm_t));
+	reader -> shm = NULL;
+}
+
+// The newest published sequence number, 0 if nothing has been published yet
+uint64_t shm_latest_sequence(shm_reader_t* reader) {
+	return atomic_load_explicit((_Atomic uint64_t*) &reader -> shm -> latest_sequence, memory_order_acquire);
+}
+
+// Starts a read of the slot holding sequence
+// Returns the slot, or NULL if it's being written or no longer (or not yet) holds that sequence
+// The slot can change under us, so nothing read from it is valid until shm_end_read agrees
+const spectrum_shm_slot_t* shm_begin_read(shm_reader_t* reader, uint64_t sequence, uint32_t* token) {
+	const spectrum_shm_slot_t* slot = &reader -> shm -> slots[sequence % SPECTRUM_SHM_SLOTS];
+	*token = atomic_load_explicit((_Atomic uint32_t*) &slot -> lock, memory_order_acquire);
+	if ((*token & 1) != 0 || slot -> sequence != sequence) return NULL;
+	return slot;
+}
+
+// Returns true if the slot wasn't written to since shm_begin_read
+bool shm_end_read(const spectrum_shm_slot_t* slot, uint32_t token) {
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit((_Atomic uint32_t*) &slot -> lock, memory_order_relaxed) == token;
+}
+
+// Copies up to max_bins magnitudes for sequence, and optionally the slot's header fields into info
+// Returns 0 on success, 1 if that sequence isn't available (overwritten or not published yet)
+int shm_read_spectrum(shm_reader_t* reader, uint64_t sequence, float* magnitudes, int max_bins, shm_frame_info_t* info) {
+	// The writer only holds a slot for a moment, so a few retries is plenty
+	for (int attempt=0; attempt < 16; attempt++) {
+		uint32_t token;
+		const spectrum_shm_slot_t* slot = shm_begin_read(reader, sequence, &token);
+		if (slot == NULL) {
+			if ((token & 1) != 0) continue;
+			return 1;
+		}
+		int bin_count = slot -> bin_count < (uint32_t) max_bins ? (int) slot -> bin_count : max_bins;
+		memcpy(magnitudes, slot -> magnitudes, sizeof(float) * bin_count);
+		if (info != NULL) {
+			info -> bin_count = bin_count;
+			info -> sequence = slot -> sequence;
+			info -> timestamp_ns = slot -> timestamp_ns;
+			info -> sample_rate = slot -> sample_rate;
+		}
+		if (shm_end_read(slot, token)) return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,32 @@
+#pragma once
+// A small library for reading the spectra purses publishes to shared memory
+// Doesn't depend on the rest of purses, so consumers only need this and spectrum_shm.h
+//
+// Zero copy reads work on the slot in place:
+//   uint32_t token;
+//   const spectrum_shm_slot_t* slot = shm_begin_read(&reader, sequence, &token);
+//   if (slot != NULL) { ...use slot -> magnitudes... }
+//   if (slot != NULL && shm_end_read(slot, token)) { ...the results are good... }
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <shm/spectrum_shm.h>
+
+// The header fields of a slot, as copied by shm_read_spectrum
+typedef struct shm_frame_info {
+	uint64_t sequence;
+	uint64_t timestamp_ns;
+	uint32_t sample_rate;
+	uint32_t bin_count;
+} shm_frame_info_t;
+
+typedef struct shm_reader {
+	const spectrum_shm_t* shm;
+} shm_reader_t;
+
+int open_shm_reader(shm_reader_t* reader, const char* name);
+void close_shm_reader(shm_reader_t* reader);
+uint64_t shm_latest_sequence(shm_reader_t* reader);
+const spectrum_shm_slot_t* shm_begin_read(shm_reader_t* reader, uint64_t sequence, uint32_t* token);
+bool shm_end_read(const spectrum_shm_slot_t* slot, uint32_t token);
+int shm_read_spectrum(shm_reader_t* reader, uint64_t sequence, float* magnitudes, int max_bins, shm_frame_info_t* info);
@@ -0,0 +1,43 @@
+#pragma once
+// The layout of the shared memory ring that purses publishes spectra into
+// Shared between the publisher (purses) and readers, so it only uses fixed-size types
+//
+// One writer, any number of readers. Each slot is guarded by a seqlock:
+// the writer makes lock odd, writes the slot, then makes lock even again.
+// Readers note lock before reading and check it's unchanged (and even) afterwards,
+// so they never block the writer and never make a syscall per frame.
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define SPECTRUM_SHM_MAGIC 0x50525353 // "PRSS"
+#define SPECTRUM_SHM_VERSION 1
+#define SPECTRUM_SHM_DEFAULT_NAME "/purses-spectrum"
+// Enough slots that a reader can fall a few frames behind without losing any
+#define SPECTRUM_SHM_SLOTS 16
+// NUM_SAMPLES/2, the bins left after the nyquist filter
+#define SPECTRUM_SHM_MAX_BINS 512
+
+typedef struct spectrum_shm_slot {
+	// Odd while the writer is part way through the slot
+	_Atomic uint32_t lock;
+	uint32_t bin_count;
+	uint64_t sequence;
+	// Nanoseconds since the unix epoch
+	uint64_t timestamp_ns;
+	uint32_t sample_rate;
+	uint32_t reserved[9];
+	float magnitudes[SPECTRUM_SHM_MAX_BINS];
+} spectrum_shm_slot_t;
+
+typedef struct spectrum_shm {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slot_count;
+	uint32_t max_bins;
+	// The sequence number of the newest complete slot, 0 before the first spectrum
+	_Atomic uint64_t latest_sequence;
+	uint64_t reserved[5];
+	// Sequence n lives in slots[n % slot_count]
+	spectrum_shm_slot_t slots[SPECTRUM_SHM_SLOTS];
+} spectrum_shm_t;
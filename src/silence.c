@@ -0,0 +1,85 @@
+#include <stddef.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <silence.h>
+
+void default_silence_options(silence_options_t* options) {
+	options -> threshold = SILENCE_DEFAULT_THRESHOLD;
+	options -> hold_ms = SILENCE_DEFAULT_HOLD_MS;
+}
+
+// options - may be NULL for the defaults
+void init_silence_gate(silence_gate_t* gate, const silence_options_t* options) {
+	if (options != NULL) gate -> options = *options;
+	else default_silence_options(&gate -> options);
+	gate -> quiet = false;
+	gate -> quiet_since_ns = 0;
+	gate -> closed = false;
+}
+
+// The largest absolute sample value
+// Tracks the block's max and min rather than abs, which can't hold -INT16_MIN in an int16_t
+// SSE2/NEON compare 8 samples at a time even unoptimised, the build has no -O for the compiler to vectorise the scalar loop
+int block_peak(const int16_t* samples, int sample_count) {
+	int i = 0;
+	int high = 0;
+	int low = 0;
+#if defined(__SSE2__)
+	__m128i highs = _mm_setzero_si128();
+	__m128i lows = _mm_setzero_si128();
+	for (; i + 8 <= sample_count; i += 8) {
+		__m128i block = _mm_loadu_si128((const __m128i*) (samples + i));
+		highs = _mm_max_epi16(highs, block);
+		lows = _mm_min_epi16(lows, block);
+	}
+	int16_t lanes[2][8];
+	_mm_storeu_si128((__m128i*) lanes[0], highs);
+	_mm_storeu_si128((__m128i*) lanes[1], lows);
+	for (int lane=0; lane < 8; lane++) {
+		if (lanes[0][lane] > high) high = lanes[0][lane];
+		if (lanes[1][lane] < low) low = lanes[1][lane];
+	}
+#elif defined(__ARM_NEON)
+	int16x8_t highs = vdupq_n_s16(0);
+	int16x8_t lows = vdupq_n_s16(0);
+	for (; i + 8 <= sample_count; i += 8) {
+		int16x8_t block = vld1q_s16(samples + i);
+		highs = vmaxq_s16(highs, block);
+		lows = vminq_s16(lows, block);
+	}
+	int16_t lanes[2][8];
+	vst1q_s16(lanes[0], highs);
+	vst1q_s16(lanes[1], lows);
+	for (int lane=0; lane < 8; lane++) {
+		if (lanes[0][lane] > high) high = lanes[0][lane];
+		if (lanes[1][lane] < low) low = lanes[1][lane];
+	}
+#endif
+	// The tail, or the whole block without SIMD
+	for (; i < sample_count; i++) {
+		if (samples[i] > high) high = samples[i];
+		if (samples[i] < low) low = samples[i];
+	}
+	return high > -low ? high : -low;
+}
+
+// Checks the next block, a single loud one opens the gate straight away
+// Returns true if the gate's closed, i.e the block needn't be transformed
+bool update_silence_gate(silence_gate_t* gate, const int16_t* samples, int sample_count, uint64_t now_ns) {
+	if (gate -> options.hold_ms <= 0) return false;
+	if (block_peak(samples, sample_count) > gate -> options.threshold) {
+		gate -> quiet = false;
+		gate -> closed = false;
+		return false;
+	}
+	if (!gate -> quiet) {
+		gate -> quiet = true;
+		gate -> quiet_since_ns = now_ns;
+	}
+	if (now_ns - gate -> quiet_since_ns >= (uint64_t) gate -> options.hold_ms * 1000000) gate -> closed = true;
+	return gate -> closed;
+}
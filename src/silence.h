@@ -0,0 +1,34 @@
+#pragma once
+// Notices when the input has gone quiet, so the FFT and redraws can stop until it isn't
+// A block is quiet when no sample is louder than the threshold
+// The gate closes once the input has been quiet for the hold time, and opens again on the first loud block
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// About -66dBFS, below anything audible but above a noisy idle sink's dither
+#define SILENCE_DEFAULT_THRESHOLD 16
+#define SILENCE_DEFAULT_HOLD_MS 2000
+// How long the render loop waits for a new spectrum while the gate's closed, so keys are still answered
+#define SILENCE_POLL_NS 100000000
+
+typedef struct silence_options {
+	// The loudest sample (absolute) a quiet block may have
+	int threshold;
+	// How long the input has to be quiet before the gate closes, 0 to never close it
+	int hold_ms;
+} silence_options_t;
+
+typedef struct silence_gate {
+	silence_options_t options;
+	// Set while every block since quiet_since_ns has been quiet
+	bool quiet;
+	uint64_t quiet_since_ns;
+	// Set once it's been quiet for the hold time
+	bool closed;
+} silence_gate_t;
+
+void default_silence_options(silence_options_t* options);
+void init_silence_gate(silence_gate_t* gate, const silence_options_t* options);
+int block_peak(const int16_t* samples, int sample_count);
+bool update_silence_gate(silence_gate_t* gate, const int16_t* samples, int sample_count, uint64_t now_ns);
@@ -0,0 +1,97 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sliding_dft.h>
+#include <processing.h>
+
+// size - a power of 2, the window is empty (all zeros) to start with
+// Returns 0 on success, 1 if it couldn't be allocated
+int init_sliding_dft(sliding_dft_t* sliding, int size) {
+	sliding -> size = size;
+	sliding -> bins = size / 2;
+	sliding -> window = malloc(sizeof(double) * size);
+	sliding -> values = malloc(sizeof(double complex) * sliding -> bins);
+	sliding -> twiddles = malloc(sizeof(double complex) * sliding -> bins);
+	sliding -> anchor_input = NULL;
+	sliding -> anchor_output = NULL;
+	malloc_complex_set(&sliding -> anchor_input, size, MAX_SAMPLE_RATE);
+	malloc_complex_set(&sliding -> anchor_output, size, MAX_SAMPLE_RATE);
+	if (sliding -> window == NULL || sliding -> values == NULL || sliding -> twiddles == NULL
+		|| sliding -> anchor_input -> complex_numbers == NULL || sliding -> anchor_output -> complex_numbers == NULL) {
+		free_sliding_dft(sliding);
+		return 1;
+	}
+	for (int k=0; k < sliding -> bins; k++) {
+		sliding -> twiddles[k] = cexp(I * 2 * M_PI * k / size);
+	}
+	reset_sliding_dft(sliding);
+	return 0;
+}
+
+void free_sliding_dft(sliding_dft_t* sliding) {
+	free(sliding -> window);
+	free(sliding -> values);
+	free(sliding -> twiddles);
+	free_complex_set(sliding -> anchor_input);
+	free_complex_set(sliding -> anchor_output);
+	sliding -> window = NULL;
+	sliding -> values = NULL;
+	sliding -> twiddles = NULL;
+	sliding -> anchor_input = NULL;
+	sliding -> anchor_output = NULL;
+}
+
+// Empties the window, the spectrum of silence is exactly zero so there's nothing to anchor
+void reset_sliding_dft(sliding_dft_t* sliding) {
+	memset(sliding -> window, 0, sizeof(double) * sliding -> size);
+	memset(sliding -> values, 0, sizeof(double complex) * sliding -> bins);
+	sliding -> position = 0;
+	sliding -> since_anchor = 0;
+}
+
+// Slides the window on by each sample, re-anchoring whenever it's due
+void slide_dft(sliding_dft_t* sliding, const int16_t* samples, int sample_count) {
+	double complex* values = sliding -> values;
+	const double complex* twiddles = sliding -> twiddles;
+	for (int i=0; i < sample_count; i++) {
+		double newest = samples[i];
+		double delta = newest - sliding -> window[sliding -> position];
+		sliding -> window[sliding -> position] = newest;
+		sliding -> position = (sliding -> position + 1) & (sliding -> size - 1);
+		for (int k=0; k < sliding -> bins; k++) {
+			values[k] = (values[k] + delta) * twiddles[k];
+		}
+		if (++sliding -> since_anchor >= SLIDING_DFT_ANCHOR_SAMPLES) anchor_sliding_dft(sliding);
+	}
+}
+
+// Recomputes the bins from the window, throwing away any drift
+void anchor_sliding_dft(sliding_dft_t* sliding) {
+	complex_wrapper_t* input = sliding -> anchor_input -> complex_numbers;
+	// Oldest first, so the FFT's bins line up with the sliding ones
+	for (int i=0; i < sliding -> size; i++) {
+		input[i].complex_number = CMPLX(sliding -> window[(sliding -> position + i) & (sliding -> size - 1)], 0.0);
+	}
+	sliding -> anchor_input -> data_size = sliding -> size;
+	iterative_fft(sliding -> anchor_input, sliding -> anchor_output);
+	for (int k=0; k < sliding -> bins; k++) {
+		sliding -> values[k] = sliding -> anchor_output -> complex_numbers[k].complex_number;
+	}
+	sliding -> since_anchor = 0;
+}
+
+// Writes the bins out as the FFT path would leave them, i.e after the nyquist filter and set_magnitude
+// output_set - must have space for size/2 values
+void sliding_dft_spectrum(sliding_dft_t* sliding, complex_set_t* output_set, int sample_rate) {
+	complex_wrapper_t* output = output_set -> complex_numbers;
+	// Every displayed bin is below the nyquist frequency, so they're all doubled
+	for (int k=0; k < sliding -> bins; k++) {
+		output[k].complex_number = sliding -> values[k] * 2;
+	}
+	output_set -> data_size = sliding -> bins;
+	output_set -> sample_rate = sample_rate;
+	output_set -> frequency = sample_rate / 2;
+	output_set -> has_data = true;
+	set_magnitude(output_set, sliding -> size);
+}
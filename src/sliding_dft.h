@@ -0,0 +1,38 @@
+#pragma once
+// A sliding DFT, the spectrum of the newest size samples, brought up to date after every sample
+// Each displayed bin (0 to size/2) costs O(1) per sample: X_k <- (X_k - oldest + newest) * e^(2πik/size)
+// So a spectrum can be had every few samples, rather than an FFT's worth of samples
+// Rounding errors build up with every update, so every SLIDING_DFT_ANCHOR_SAMPLES the bins are recomputed from the window with an FFT
+
+#include <complex.h>
+#include <stdint.h>
+
+#include <shared.h>
+
+// The name it's chosen by, beside the FFT_ENGINES
+#define SLIDING_DFT_ENGINE "sliding"
+#define SLIDING_DFT_DEFAULT_HOP 64
+// ~0.37s at 44.1kHz, drift stays well under 1e-9 of the peak between anchors
+#define SLIDING_DFT_ANCHOR_SAMPLES (16 * NUM_SAMPLES)
+
+typedef struct sliding_dft {
+	int size;
+	int bins;
+	// The newest size samples, the oldest being at position
+	double* window;
+	int position;
+	// The displayed bins, and e^(2πik/size) for each
+	double complex* values;
+	double complex* twiddles;
+	unsigned long since_anchor;
+	// Only used to re-anchor
+	complex_set_t* anchor_input;
+	complex_set_t* anchor_output;
+} sliding_dft_t;
+
+int init_sliding_dft(sliding_dft_t* sliding, int size);
+void free_sliding_dft(sliding_dft_t* sliding);
+void reset_sliding_dft(sliding_dft_t* sliding);
+void slide_dft(sliding_dft_t* sliding, const int16_t* samples, int sample_count);
+void anchor_sliding_dft(sliding_dft_t* sliding);
+void sliding_dft_spectrum(sliding_dft_t* sliding, complex_set_t* output_set, int sample_rate);
@@ -0,0 +1,243 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <spectrogram.h>
+#include <processing.h>
+#include <history.h>
+#include <frame_format.h>
+#include <log.h>
+
+typedef struct analyze_job {
+	const int16_t* samples;
+	int fft_size;
+	int step;
+	int bins;
+	int sample_rate;
+	const double* window;
+	const fft_engine_t* engine;
+	// The batch being transformed, frames are numbered from the start of the recording
+	unsigned long batch_first;
+	int batch_count;
+	float* results;
+	atomic_int next_task;
+	bool stopping;
+	// Workers hold off until the barriers are sized for however many of them were started
+	pthread_mutex_t lock;
+	pthread_cond_t ready_changed;
+	bool ready;
+	// Workers wait at start for a batch, and at done once it's transformed
+	pthread_barrier_t start;
+	pthread_barrier_t done;
+} analyze_job_t;
+
+// Each worker owns its FFT buffers, nothing is shared but the job
+typedef struct analyze_worker {
+	pthread_t thread;
+	analyze_job_t* job;
+	complex_set_t* input;
+	complex_set_t* output;
+} analyze_worker_t;
+
+// Transforms one frame into bins magnitudes
+static void transform_frame(analyze_worker_t* worker, unsigned long frame, float* magnitudes) {
+	analyze_job_t* job = worker -> job;
+	const int16_t* samples = job -> samples + (frame * job -> step);
+	complex_wrapper_t* input = worker -> input -> complex_numbers;
+	for (int i=0; i < job -> fft_size; i++) {
+		input[i].complex_number = CMPLX(samples[i] * job -> window[i], 0.0);
+	}
+	// The nyquist filter halves data_size each time
+	worker -> output -> data_size = job -> fft_size;
+	job -> engine -> transform(worker -> input, worker -> output);
+	nyquist_filter(worker -> output);
+	set_magnitude(worker -> output, job -> fft_size);
+	for (int i=0; i < job -> bins; i++) {
+		magnitudes[i] = worker -> output -> complex_numbers[i].magnitude;
+	}
+}
+
+static void* analyze_worker_thread(void* userdata) {
+	analyze_worker_t* worker = userdata;
+	analyze_job_t* job = worker -> job;
+	pthread_mutex_lock(&job -> lock);
+	while (!job -> ready) pthread_cond_wait(&job -> ready_changed, &job -> lock);
+	// Stopping before the first batch means the barriers were never set up
+	bool stopping = job -> stopping;
+	pthread_mutex_unlock(&job -> lock);
+	while (!stopping) {
+		pthread_barrier_wait(&job -> start);
+		if (job -> stopping) break;
+		int task;
+		while ((task = atomic_fetch_add(&job -> next_task, SPECTROGRAM_TASK_FRAMES)) < job -> batch_count) {
+			int end = task + SPECTROGRAM_TASK_FRAMES < job -> batch_count ? task + SPECTROGRAM_TASK_FRAMES : job -> batch_count;
+			for (int i=task; i < end; i++) {
+				transform_frame(worker, job -> batch_first + i, job -> results + ((size_t) i * job -> bins));
+			}
+		}
+		pthread_barrier_wait(&job -> done);
+	}
+	free_fft_scratch();
+	return NULL;
+}
+
+// Lets the started workers go, stopping set if they're to exit straight away
+static void release_workers(analyze_job_t* job, bool stopping) {
+	pthread_mutex_lock(&job -> lock);
+	job -> stopping = stopping;
+	job -> ready = true;
+	pthread_cond_broadcast(&job -> ready_changed);
+	pthread_mutex_unlock(&job -> lock);
+}
+
+// Writes a batch of results in frame order
+// Returns 0 on success, 1 if the output couldn't be written
+static int write_batch(analyze_job_t* job, const float* results, unsigned long first, int count, spectrogram_format_t format, FILE* output, FILE* image, uint8_t* scratch) {
+	for (int i=0; i < count; i++) {
+		const float* magnitudes = results + ((size_t) i * job -> bins);
+		unsigned long frame = first + i;
+		double seconds = (double) (frame * job -> step) / job -> sample_rate;
+		if (output != NULL && format == SPECTROGRAM_BINARY) {
+			size_t size = encode_frame_values(scratch, frame_size(job -> bins), (uint64_t) (seconds * 1000000000), frame, job -> sample_rate, magnitudes, job -> bins);
+			if (fwrite(scratch, 1, size, output) != size) return 1;
+		} else if (output != NULL) {
+			fprintf(output, "%.6f", seconds);
+			for (int bin=0; bin < job -> bins; bin++) fprintf(output, ",%g", magnitudes[bin]);
+			if (fprintf(output, "\n") < 0) return 1;
+		}
+		if (image != NULL) {
+			for (int bin=0; bin < job -> bins; bin++) {
+				scratch[bin] = quantise_decibels(20 * log10(magnitudes[bin]));
+			}
+			if (fwrite(scratch, 1, job -> bins, image) != (size_t) job -> bins) return 1;
+		}
+	}
+	return 0;
+}
+
+// Transforms the batches in turn, writing each out while the next is transformed
+// Returns 0 on success, 1 if the output couldn't be written
+static int run_batches(analyze_job_t* job, unsigned long frames, int batch_frames, float** results, spectrogram_format_t format, FILE* output, FILE* image, uint8_t* scratch) {
+	int stat = 0;
+	unsigned long written = 0;
+	unsigned long batch_first = 0;
+	int buffer = 0;
+	while (stat == 0 && batch_first < frames) {
+		job -> batch_first = batch_first;
+		job -> batch_count = frames - batch_first < (unsigned long) batch_frames ? frames - batch_first : batch_frames;
+		job -> results = results[buffer];
+		atomic_store(&job -> next_task, 0);
+		pthread_barrier_wait(&job -> start);
+		// Write the previous batch out while this one's transformed
+		if (batch_first > written) {
+			stat = write_batch(job, results[!buffer], written, batch_first - written, format, output, image, scratch);
+		}
+		pthread_barrier_wait(&job -> done);
+		written = batch_first;
+		batch_first += job -> batch_count;
+		buffer = !buffer;
+	}
+	if (stat == 0 && batch_first > written) {
+		stat = write_batch(job, results[!buffer], written, batch_first - written, format, output, image, scratch);
+	}
+	return stat;
+}
+
+// How many whole frames of fft_size samples, step apart, the recording holds
+unsigned long spectrogram_frames(size_t sample_count, int fft_size, int step) {
+	return sample_count < (size_t) fft_size ? 0 : (sample_count - fft_size) / step + 1;
+}
+
+// Writes the spectrogram of the samples to output and/or image (either may be NULL)
+// threads_used - set to how many workers were started
+// Returns 0 on success, 1 if it couldn't be set up or the output couldn't be written
+int write_spectrogram(const int16_t* samples, size_t sample_count, int sample_rate, const spectrogram_options_t* options, FILE* output, FILE* image, int* threads_used) {
+	int fft_size = options -> fft_size;
+	unsigned long frames = spectrogram_frames(sample_count, fft_size, options -> step);
+	analyze_job_t job;
+	job.samples = samples;
+	job.fft_size = fft_size;
+	job.step = options -> step;
+	job.bins = fft_size / 2;
+	job.sample_rate = sample_rate;
+	job.engine = options -> engine;
+	job.stopping = false;
+	job.ready = false;
+	*threads_used = 0;
+
+	double* window = malloc(sizeof(double) * fft_size);
+	// Results are double buffered, so one batch can be written while the next is transformed
+	size_t batch_values = (size_t) options -> batch_frames * job.bins;
+	float* results[2] = {malloc(sizeof(float) * batch_values), malloc(sizeof(float) * batch_values)};
+	uint8_t* scratch = malloc(frame_size(job.bins));
+	analyze_worker_t* workers = calloc(options -> threads, sizeof(analyze_worker_t));
+	bool allocated = window != NULL && results[0] != NULL && results[1] != NULL && scratch != NULL && workers != NULL;
+	for (int i=0; allocated && i < options -> threads; i++) {
+		workers[i].job = &job;
+		malloc_complex_set(&workers[i].input, fft_size, sample_rate);
+		malloc_complex_set(&workers[i].output, fft_size, sample_rate);
+		allocated = workers[i].input -> complex_numbers != NULL && workers[i].output -> complex_numbers != NULL;
+	}
+	if (!allocated) {
+		log_error("Failed to allocate the spectrogram buffers for %d threads\n", options -> threads);
+	} else {
+		for (int i=0; i < fft_size; i++) {
+			window[i] = 0.5 * (1 - cos(2 * M_PI * i / (fft_size - 1)));
+		}
+		job.window = window;
+	}
+
+	int started = 0;
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.ready_changed, NULL);
+	while (allocated && started < options -> threads) {
+		int create_stat = pthread_create(&workers[started].thread, NULL, analyze_worker_thread, &workers[started]);
+		if (create_stat != 0) {
+			log_error("Only started %d of %d spectrogram threads, error: %d\n", started, options -> threads, create_stat);
+			break;
+		}
+		started++;
+	}
+	// The barriers count the workers that were actually started, and us
+	bool barriers = started > 0 && pthread_barrier_init(&job.start, NULL, started + 1) == 0;
+	if (barriers && pthread_barrier_init(&job.done, NULL, started + 1) != 0) {
+		pthread_barrier_destroy(&job.start);
+		barriers = false;
+	}
+	release_workers(&job, !barriers);
+
+	int stat = barriers ? 0 : 1;
+	if (barriers) {
+		*threads_used = started;
+		if (options -> format == SPECTROGRAM_CSV && output != NULL) {
+			fprintf(output, "time_s");
+			for (int bin=0; bin < job.bins; bin++) fprintf(output, ",%g", (double) bin * sample_rate / fft_size);
+			fprintf(output, "\n");
+		}
+		if (image != NULL) fprintf(image, "P5\n%d %lu\n255\n", job.bins, frames);
+		stat = run_batches(&job, frames, options -> batch_frames, results, options -> format, output, image, scratch);
+		if (stat != 0) log_error("Failed to write the spectrogram\n");
+		job.stopping = true;
+		pthread_barrier_wait(&job.start);
+	}
+	for (int i=0; i < started; i++) pthread_join(workers[i].thread, NULL);
+	if (barriers) {
+		pthread_barrier_destroy(&job.start);
+		pthread_barrier_destroy(&job.done);
+	}
+	pthread_cond_destroy(&job.ready_changed);
+	pthread_mutex_destroy(&job.lock);
+
+	for (int i=0; workers != NULL && i < options -> threads; i++) {
+		free_complex_set(workers[i].input);
+		free_complex_set(workers[i].output);
+	}
+	free(workers);
+	free(results[0]);
+	free(results[1]);
+	free(scratch);
+	free(window);
+	return stat;
+}
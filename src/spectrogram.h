@@ -0,0 +1,40 @@
+#pragma once
+// Offline spectrograms of a whole recording, using the same FFT engines as purses itself (see tools/purses_analyze.c)
+// The samples are split into overlapping Hann-windowed frames that are spread across a pool of worker threads
+//
+// binary - a headless record (see frame_format.h) per frame, timestamps are the frame's offset into the recording
+// csv - a header row of bin frequencies, then a row per frame of the time in seconds and each bin's magnitude
+// image - a greyscale PGM with a row per frame (time goes down) and a column per bin, lightness is the level in dB
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <processing.h>
+
+// Frames are handed out to the workers in batches, results are written out while the next batch is transformed
+#define SPECTROGRAM_BATCH_FRAMES 4096
+// Each worker claims this many frames of a batch at a time
+#define SPECTROGRAM_TASK_FRAMES 8
+#define SPECTROGRAM_MAX_FFT_SIZE 65536
+// O(N log N), where ct_fft's half-size DFTs are O(N^2)
+#define SPECTROGRAM_DEFAULT_ENGINE "iterative"
+
+typedef enum spectrogram_format {
+	SPECTROGRAM_BINARY,
+	SPECTROGRAM_CSV
+} spectrogram_format_t;
+
+typedef struct spectrogram_options {
+	// A power of 2 up to SPECTROGRAM_MAX_FFT_SIZE, the frames start step samples apart
+	int fft_size;
+	int step;
+	// Worker threads asked for, fewer are used if they can't all be started
+	int threads;
+	int batch_frames;
+	spectrogram_format_t format;
+	// One of FFT_ENGINES, they all give the same spectrum
+	const fft_engine_t* engine;
+} spectrogram_options_t;
+
+unsigned long spectrogram_frames(size_t sample_count, int fft_size, int step);
+int write_spectrogram(const int16_t* samples, size_t sample_count, int sample_rate, const spectrogram_options_t* options, FILE* output, FILE* image, int* threads_used);
@@ -0,0 +1,80 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <trace/trace.h>
+#include <log.h>
+
+tracer_t tracer = {NULL, NULL, 0, 0};
+
+// Which thread we're on and its current frame, stamped on every event
+static __thread uint8_t current_thread = TRACE_THREAD_RENDER;
+static __thread uint32_t current_frame = 0;
+
+// Creates the trace file at path, sized for capacity events (rounded up to a power of 2)
+// Returns 0 on success, 1 on failure
+int open_trace(const char* path, uint32_t capacity) {
+	uint32_t ring_size = 1;
+	while (ring_size < capacity) ring_size <<= 1;
+	size_t mapped_size = sizeof(trace_header_t) + (sizeof(trace_record_t) * ring_size);
+
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		log_error("Failed to open trace file: %s\n", path);
+		return 1;
+	}
+	int truncate_stat = ftruncate(fd, mapped_size);
+	void* mapped = truncate_stat == 0 ? mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		log_error("Failed to map trace file: %s\n", path);
+		return 1;
+	}
+
+	trace_header_t* header = mapped;
+	header -> magic = TRACE_MAGIC;
+	header -> version = TRACE_VERSION;
+	header -> record_size = sizeof(trace_record_t);
+	header -> capacity = ring_size;
+	atomic_store(&header -> next_event, 0);
+	tracer.records = (trace_record_t*) (header + 1);
+	tracer.mask = ring_size - 1;
+	tracer.mapped_size = mapped_size;
+	tracer.header = header;
+	log_info("Tracing %u events to: %s\n", ring_size, path);
+	return 0;
+}
+
+// Unmaps the trace, the kernel writes back whatever hasn't been already
+void close_trace() {
+	if (tracer.header == NULL) return;
+	trace_header_t* header = tracer.header;
+	tracer.header = NULL;
+	log_info("Traced %lu events\n", (unsigned long) atomic_load(&header -> next_event));
+	munmap(header, tracer.mapped_size);
+}
+
+// Names the calling thread in its events
+void trace_thread(trace_thread_t thread) {
+	current_thread = thread;
+}
+
+// Marks the start of a new frame on the calling thread
+void trace_frame(uint32_t frame) {
+	current_frame = frame;
+}
+
+void trace_event(trace_stage_t stage, char phase) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	uint64_t index = atomic_fetch_add_explicit(&tracer.header -> next_event, 1, memory_order_relaxed);
+	trace_record_t* record = &tracer.records[index & tracer.mask];
+	record -> timestamp_ns = ((uint64_t) now.tv_sec * 1000000000) + now.tv_nsec;
+	record -> frame = current_frame;
+	record -> stage = stage;
+	record -> phase = phase;
+	record -> thread = current_thread;
+	record -> reserved = 0;
+}
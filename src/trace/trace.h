@@ -0,0 +1,26 @@
+#pragma once
+// Optional per-frame stage timings, written to an mmap'd trace file ring
+// Enabled with PURSES_TRACE=<file>, convert the file with tools/trace2json for chrome://tracing or Perfetto
+// When disabled each trace point is a single predictable branch
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <trace/trace_format.h>
+
+typedef struct tracer {
+	trace_header_t* header;
+	trace_record_t* records;
+	uint32_t mask;
+	size_t mapped_size;
+} tracer_t;
+
+extern tracer_t tracer;
+
+#define trace_begin(stage) do { if (tracer.header != NULL) trace_event(stage, 'B'); } while (0)
+#define trace_end(stage) do { if (tracer.header != NULL) trace_event(stage, 'E'); } while (0)
+
+int open_trace(const char* path, uint32_t capacity);
+void close_trace();
+void trace_thread(trace_thread_t thread);
+void trace_frame(uint32_t frame);
+void trace_event(trace_stage_t stage, char phase);
@@ -0,0 +1,54 @@
+#pragma once
+// The layout of a purses trace file, shared with tools/trace2json.c
+// A header then a ring of fixed-size event records, the file is mmap'd so events are plain stores
+// Event n is at records[n % capacity], next_event is how many have ever been written
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define TRACE_MAGIC 0x54535250 // "PRST"
+#define TRACE_VERSION 1
+// Must be a power of 2, 1M events (16MB) is a few minutes of frames
+#define TRACE_DEFAULT_CAPACITY (1 << 20)
+
+typedef enum trace_stage {
+	TRACE_FRAME,
+	TRACE_CAPTURE,
+	TRACE_CONVERT,
+	TRACE_FFT,
+	TRACE_MAGNITUDE,
+	TRACE_BANDS,
+	TRACE_RENDER,
+	TRACE_STAGE_COUNT
+} trace_stage_t;
+
+typedef enum trace_thread {
+	TRACE_THREAD_RENDER,
+	TRACE_THREAD_ANALYSIS,
+	TRACE_THREAD_CAPTURE,
+	TRACE_THREAD_COUNT
+} trace_thread_t;
+
+// A stage starting (phase 'B') or ending ('E'), 16 bytes
+typedef struct trace_record {
+	// CLOCK_MONOTONIC
+	uint64_t timestamp_ns;
+	// The render or analysis frame the event belongs to
+	uint32_t frame;
+	uint8_t stage;
+	uint8_t phase;
+	uint8_t thread;
+	uint8_t reserved;
+} trace_record_t;
+
+typedef struct trace_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t capacity;
+	_Atomic uint64_t next_event;
+	uint64_t reserved[5];
+} trace_header_t;
+
+static const char* const TRACE_STAGE_NAMES[] = {"frame", "capture", "convert", "fft", "magnitude", "bands", "render"};
+static const char* const TRACE_THREAD_NAMES[] = {"render", "analysis", "capture"};
@@ -0,0 +1,37 @@
+#include <triple_buffer.h>
+
+// The writer starts with first, the reader with third, neither has been published
+void init_triple_buffer(triple_buffer_t* triple, void* first, void* second, void* third) {
+	triple -> buffers[0] = first;
+	triple -> buffers[1] = second;
+	triple -> buffers[2] = third;
+	triple -> back = 0;
+	triple -> front = 2;
+	atomic_init(&triple -> middle, 1);
+}
+
+// The buffer the writer fills next
+void* triple_buffer_back(triple_buffer_t* triple) {
+	return triple -> buffers[triple -> back];
+}
+
+// The buffer the reader last acquired, it's the reader's until it acquires another
+void* triple_buffer_front(triple_buffer_t* triple) {
+	return triple -> buffers[triple -> front];
+}
+
+// Publishes the back buffer, the writer gets the middle one to fill next
+// Release ordering, so whatever was written to the buffer is visible to the reader once it acquires it
+void publish_triple_buffer(triple_buffer_t* triple) {
+	int middle = atomic_exchange_explicit(&triple -> middle, triple -> back | TRIPLE_BUFFER_FRESH, memory_order_acq_rel);
+	triple -> back = middle & TRIPLE_BUFFER_INDEX;
+}
+
+// Takes the newest published buffer as the front one, if there's been one since the last acquire
+// Returns true if front changed
+bool acquire_triple_buffer(triple_buffer_t* triple) {
+	if ((atomic_load_explicit(&triple -> middle, memory_order_relaxed) & TRIPLE_BUFFER_FRESH) == 0) return false;
+	int middle = atomic_exchange_explicit(&triple -> middle, triple -> front, memory_order_acq_rel);
+	triple -> front = middle & TRIPLE_BUFFER_INDEX;
+	return true;
+}
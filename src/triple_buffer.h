@@ -0,0 +1,29 @@
+#pragma once
+// Hands buffers from one thread to another without copying them, and without either side waiting on the other
+// The writer fills its back buffer then publishes it, swapping it with the middle one
+// The reader acquires the middle buffer when a newer one's been published, swapping it with its front one
+// So the writer always has a buffer to fill and the reader always has the newest complete one to itself, any it's too slow for are overwritten
+// Only one thread may write, and only one may read
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Set in middle when it holds a buffer the reader hasn't acquired yet
+#define TRIPLE_BUFFER_FRESH 4
+#define TRIPLE_BUFFER_INDEX 3
+
+typedef struct triple_buffer {
+	void* buffers[3];
+	// The index of the writer's buffer, only touched by the writer
+	int back;
+	// The index of the reader's buffer, only touched by the reader
+	int front;
+	// The index of the buffer in between, or'd with TRIPLE_BUFFER_FRESH when it's newer than front
+	atomic_int middle;
+} triple_buffer_t;
+
+void init_triple_buffer(triple_buffer_t* triple, void* first, void* second, void* third);
+void* triple_buffer_back(triple_buffer_t* triple);
+void* triple_buffer_front(triple_buffer_t* triple);
+void publish_triple_buffer(triple_buffer_t* triple);
+bool acquire_triple_buffer(triple_buffer_t* triple);
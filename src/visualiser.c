@@ -1,52 +1,194 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <pulse/pulseaudio.h>
 #include <ncurses.h>
 #include <visualiser.h>
+#include <waterfall.h>
+#include <log.h>
+#include <trace/trace.h>
 
-int calculate_height(complex_wrapper_t wrapper) {
-	int decibels = wrapper.decibels;
+static const char* BANNER = "===PulseAudio ncurses Visualiser===";
+static const char* HELP_TEXT = "q - Quit, s - Choose device, f - FPS, w - Waterfall, l - Latency";
+
+// Bar glyphs indexed by how many eighths of the cell are filled
+static const char* EIGHTH_BLOCKS[BAR_CELL_STEPS+1] = {" ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+// For terminals without UTF-8, rounds to a full or empty cell
+static const char* ASCII_BLOCKS[BAR_CELL_STEPS+1] = {" ", " ", " ", " ", "#", "#", "#", "#", "#"};
+
+// Returns the bar height in eighths of a row, up to max_rows
+int calculate_height(double decibels, int max_rows) {
 	if (decibels > 0) {
-    int bar_height = wrapper.decibels/5;
-		return bar_height <= VIS_HEIGHT-2 ? bar_height : VIS_HEIGHT - 2;
-	} 
+		int bar_height = (int) (decibels * BAR_CELL_STEPS / DB_PER_ROW);
+		int max_height = max_rows * BAR_CELL_STEPS;
+		return bar_height <= max_height ? bar_height : max_height;
+	}
 	return 0;
 }
 
+// How many eighths of a bar's cell in the given row (1 being the bottom row) are filled
+int cell_fill(int bar_height, int row) {
+	int fill = bar_height - ((row-1) * BAR_CELL_STEPS);
+	if (fill < 0) return 0;
+	return fill > BAR_CELL_STEPS ? BAR_CELL_STEPS : fill;
+}
+
 // bin_frequency - the frequency in Hertz per sample bin
 // index - the index of the bin in question
-// Returns a descriptive string of the frequency multiplied by the index i.e "43Hz" or "16kHz"
-char* label_frequency(int bin_frequency, int bin_index) {
+// Writes a descriptive string of the frequency multiplied by the index i.e "43Hz" or "16kHz" into label
+void label_frequency(char* label, size_t size, int bin_frequency, int bin_index) {
 	int frequency = bin_frequency * bin_index;
-	char* (output) = malloc(sizeof(char) * 6); // 6 chars max
 	// If greater than 1000 use the kilo-suffix
 	if (frequency > 1000) {
-		sprintf(output, "%dkHz", frequency / 1000);
+		snprintf(label, size, "%dkHz", frequency / 1000);
 	} else {
-		sprintf(output, "%dHz", frequency);
+		snprintf(label, size, "%dHz", frequency);
 	}
-	return output;
 }
 
-void draw_bar(WINDOW* win, int start_x, int height, int width, const char* label){
+void init_visualiser_state(visualiser_state_t* state, bool unicode, int bar_columns, int width, int height, spectrum_history_t* history) {
+	state -> unicode = unicode;
+	state -> view = VIEW_BARS;
+	state -> history = history;
+	state -> waterfall_win = NULL;
+	init_waterfall_colours();
+	state -> bar_columns = bar_columns;
+	state -> layout = (vis_layout_t) {0};
+	state -> layout.data_size = -1;
+	state -> bar_heights = NULL;
+	state -> next_heights = NULL;
+	state -> row_buffer = NULL;
+	resize_visualiser(state, width, height);
+}
+
+void free_visualiser_state(visualiser_state_t* state) {
+	free_waterfall_window(state);
+	free(state -> layout.band_start);
+	free(state -> layout.band_end);
+	free(state -> bar_heights);
+	free(state -> next_heights);
+	free(state -> row_buffer);
+}
+
+// Switches between the bar and waterfall views
+void set_visualiser_view(visualiser_state_t* state, vis_view_t view) {
+	state -> view = view;
+	invalidate_visualiser(state);
+}
+
+// Records a new window size, the layout is rebuilt on the next frame
+void resize_visualiser(visualiser_state_t* state, int width, int height) {
+	state -> layout.width = width;
+	state -> layout.height = height;
+	state -> layout_dirty = true;
+}
+
+// Changes the columns per bar (and so the bar count) from the next frame
+void set_visualiser_bar_columns(visualiser_state_t* state, int bar_columns) {
+	if (bar_columns == state -> bar_columns) return;
+	state -> bar_columns = bar_columns;
+	state -> layout_dirty = true;
+}
+
+// Forces a full redraw on the next frame i.e after another window has drawn over ours
+void invalidate_visualiser(visualiser_state_t* state) {
+	state -> chrome_dirty = true;
+	if (state -> bar_heights != NULL) {
+		memset(state -> bar_heights, 0, sizeof(int) * state -> layout.bar_count);
+	}
+}
+
+// Works out the bar count/positions for the window size, and which spectrum bins each bar covers
+void build_layout(WINDOW* win, visualiser_state_t* state, int data_size, int frequency) {
+	vis_layout_t* layout = &state -> layout;
+	layout -> data_size = data_size;
+	layout -> frequency = frequency;
+	// Account for the boxing of the window, and the label row
+	layout -> bar_rows = layout -> height - 3;
+	layout -> bar_spacing = state -> bar_columns;
+	// Leave a gap between bars where we can
+	layout -> bar_width = layout -> bar_spacing > 1 ? layout -> bar_spacing - 1 : 1;
+	layout -> start_x = VIS_AXIS_WIDTH;
+	int usable_width = layout -> width - layout -> start_x - 1;
+	int bar_count = usable_width > 0 ? usable_width / layout -> bar_spacing : 0;
+	// Bin 0 is the DC offset, so there's at most one bar for each of the rest
+	if (data_size > 1 && bar_count > data_size - 1) {
+		bar_count = data_size - 1;
+	}
+	layout -> bar_count = bar_count;
+
+	layout -> band_start = realloc(layout -> band_start, sizeof(int) * bar_count);
+	layout -> band_end = realloc(layout -> band_end, sizeof(int) * bar_count);
+	state -> bar_heights = realloc(state -> bar_heights, sizeof(int) * bar_count);
+	state -> next_heights = realloc(state -> next_heights, sizeof(int) * bar_count);
+	// Each glyph is at most 3 bytes in UTF-8
+	state -> row_buffer = realloc(state -> row_buffer, (bar_count * layout -> bar_spacing * 3) + 1);
+
+	// Split bins 1..data_size evenly between the bars
+	int bins = data_size > 1 ? data_size - 1 : 0;
+	for (int i=0; i < bar_count; i++) {
+		layout -> band_start[i] = 1 + (i * bins) / bar_count;
+		layout -> band_end[i] = 1 + ((i+1) * bins) / bar_count;
+		if (layout -> band_end[i] <= layout -> band_start[i]) {
+			layout -> band_end[i] = layout -> band_start[i] + 1;
+		}
+	}
+	log_debug("Built layout for %dx%d: %d bars over %d bins (%dHz)\n", layout -> width, layout -> height, bar_count, data_size, frequency);
+	build_waterfall_window(win, state);
+	state -> layout_dirty = false;
+	invalidate_visualiser(state);
+}
+
+// Writes every row where a bar's top changed as a single string
+// The new heights in next_heights replace those in bar_heights
+void draw_bar_rows(WINDOW* win, visualiser_state_t* state) {
+	vis_layout_t* layout = &state -> layout;
 	// Account for the boxing of the window
-	int start_y = VIS_HEIGHT-2;
-	mvwprintw(win, start_y, start_x, label);
-	init_pair(1, COLOR_GREEN, COLOR_GREEN);
+	int start_y = layout -> height - 2;
+	const char** glyphs = state -> unicode ? EIGHTH_BLOCKS : ASCII_BLOCKS;
+	int* heights = state -> next_heights;
+	int* old_heights = state -> bar_heights;
+
+	init_pair(1, COLOR_GREEN, -1);
 	wattron(win, COLOR_PAIR(1));
-	for (int i=1; i<height; i++) {
-  	for (int j=1; j<width; j++) {
-      mvwprintw(win, start_y-i, start_x + j, "A");
-    }
+	for (int row=1; row <= layout -> bar_rows; row++) {
+		bool changed = false;
+		for (int i=0; i < layout -> bar_count; i++) {
+			if (cell_fill(heights[i], row) != cell_fill(old_heights[i], row)) {
+				changed = true;
+				break;
+			}
+		}
+		if (!changed) continue;
+
+		char* cursor = state -> row_buffer;
+		for (int i=0; i < layout -> bar_count; i++) {
+			const char* glyph = glyphs[cell_fill(heights[i], row)];
+			size_t glyph_len = strlen(glyph);
+			for (int col=0; col < layout -> bar_spacing; col++) {
+				if (col < layout -> bar_width) {
+					memcpy(cursor, glyph, glyph_len);
+					cursor += glyph_len;
+				} else {
+					*cursor++ = ' ';
+				}
+			}
+		}
+		*cursor = '\0';
+		mvwaddnstr(win, start_y-row, layout -> start_x, state -> row_buffer, cursor - state -> row_buffer);
 	}
 	wattroff(win, COLOR_PAIR(1));
+
+	// Swap so this frame's heights become the last drawn
+	state -> bar_heights = heights;
+	state -> next_heights = old_heights;
 }
 
 // Draw decibel increments
-void draw_y_labels(WINDOW* win) {
+void draw_y_labels(WINDOW* win, vis_layout_t* layout) {
 	// Account for the boxing of the window
-	int start_y = VIS_HEIGHT-2;
+	int start_y = layout -> height - 2;
 	int decibels = 0;
 	for(int i=0; i<start_y; i+=2) {
 		decibels = i*5;
@@ -55,47 +197,149 @@ void draw_y_labels(WINDOW* win) {
 	}
 }
 
-void update_graph(WINDOW* win, complex_set_t* output_set) {
-	FILE* logfile = get_logfile();
+// Draws frequency labels under the bars, skipping bars where the last label would overlap
+void draw_x_labels(WINDOW* win, vis_layout_t* layout) {
+	int start_y = layout -> height - 2;
+	int bin_frequency = (layout -> data_size > 0) ? layout -> frequency / layout -> data_size : 0;
+	int next_free_x = layout -> start_x;
+	for (int i=0; i < layout -> bar_count; i++) {
+		int x = layout -> start_x + (i * layout -> bar_spacing);
+		if (x < next_free_x) continue;
+		char label[FREQUENCY_LABEL_SIZE];
+		label_frequency(label, sizeof(label), bin_frequency, layout -> band_start[i]);
+		int label_len = strlen(label);
+		if (x + label_len < layout -> width - 1) {
+			mvwprintw(win, start_y, x, "%s", label);
+		}
+		next_free_x = x + label_len + 2;
+	}
+}
 
-	// sF/sN (Sample Frequency/Sample Count) = bF (Hertz per bin)
-	// 44100/1024 = 43.06
+// Draws everything that doesn't change between frames
+void draw_chrome(WINDOW* win, visualiser_state_t* state) {
+	vis_layout_t* layout = &state -> layout;
+	werase(win);
+	box(win, 0, 0);
+	if (state -> view == VIEW_BARS) {
+		draw_y_labels(win, layout);
+	}
+	// find the midpoint for our banner
+	int target_x = (layout -> width - strlen(BANNER)) / 2;
+	mvwprintw(win, 0, target_x, BANNER);
+	draw_x_labels(win, layout);
+	mvwprintw(win, layout -> height - 1, 1, HELP_TEXT);
+	state -> chrome_dirty = false;
+	if (state -> view == VIEW_WATERFALL) {
+		repaint_waterfall(state);
+	}
+}
 
+void update_graph(WINDOW* win, visualiser_state_t* state, complex_set_t* output_set, bool new_spectrum) {
 	complex_wrapper_t* complex_vals = output_set -> complex_numbers;
 	int data_size = output_set -> data_size;
 	int frequency = output_set -> frequency;
-	fprintf(logfile, "%d output samples.\n", data_size);
-	fprintf(logfile, "%d output frequency.\n", frequency);
-
-	// divide by 2 to get the Nyquist freuency divided by the sample count
-	int bin_frequency = (data_size > 0) ? frequency / data_size : 0;
-  // Divide the total sample count by 11 bars
-	int bin_increment =  (data_size > 0) ? data_size / VIS_BARS : 0;
-	fprintf(logfile, "%dHz frequency per bin.\n", bin_frequency);
-	fprintf(logfile, "%d bin index increment.\n", bin_increment);
-	// From 5 to avoid window border, up to 5 + 12 bars
-	for (int i=1; i < 11; i++) {
-		int bin_index = i*bin_increment;
-		char* label = label_frequency(bin_frequency, bin_index);
-		fprintf(logfile, "%d bin index == %s\n" , bin_index, label);
-    int bar_height = calculate_height(complex_vals[bin_index]);
-		draw_bar(win, i*sizeof(label), bar_height, 3, label);
-	}
-	wrefresh(win);
-}
-
-void draw_visualiser(WINDOW* win, complex_set_t* output_set, struct timeval time_taken) {
+
+	// The layout only changes along with the window size and the sample count/rate
+	vis_layout_t* layout = &state -> layout;
+	if (state -> layout_dirty || data_size != layout -> data_size || frequency != layout -> frequency) {
+		build_layout(win, state, data_size, frequency);
+	}
+	if (state -> chrome_dirty) {
+		// Also repaints the waterfall from the history, so no need to scroll
+		draw_chrome(win, state);
+	} else if (state -> view == VIEW_WATERFALL && new_spectrum) {
+		scroll_waterfall(state);
+	}
+	if (state -> view == VIEW_WATERFALL) return;
+
+	// Each bar shows the loudest bin in its band
+	trace_begin(TRACE_BANDS);
+	for (int i=0; i < layout -> bar_count; i++) {
+		double decibels = 0.0;
+		for (int bin=layout -> band_start[i]; bin < layout -> band_end[i] && bin < data_size; bin++) {
+			if (complex_vals[bin].decibels > decibels) decibels = complex_vals[bin].decibels;
+		}
+		state -> next_heights[i] = calculate_height(decibels, layout -> bar_rows);
+	}
+	trace_end(TRACE_BANDS);
+	draw_bar_rows(win, state);
+}
+
+void draw_visualiser(WINDOW* win, visualiser_state_t* state, complex_set_t* output_set, bool new_spectrum, frame_stats_t* frame_stats, uint64_t analysis_ns, int target_fps, int quality_level) {
+	int width = state -> layout.width;
+	int height = state -> layout.height;
+	if (width < VIS_MIN_WIDTH || height < VIS_MIN_HEIGHT) {
+		werase(win);
+		mvwprintw(win, 0, 0, "Terminal too small");
+		state -> chrome_dirty = true;
+		return;
+	}
+
+	update_graph(win, state, output_set, new_spectrum);
+	// Fixed widths so each value overwrites the last without clearing
+	// Q is the governor's level, 0 being full quality
+	mvwprintw(win, height-1, width-43, "Q%d A:%5.1fms F:%5.2f/%5.2fms %5.1f/%3dFPS",
+		quality_level, analysis_ns / 1e6, frame_stats -> avg_frame_ms, frame_stats -> max_frame_ms, frame_stats -> fps, target_fps);
+	// Only where there's room between the key help and the frame stats
+	int target_x = (width - strlen(BANNER)) / 2;
+	if (target_x > (int) strlen(HELP_TEXT) + 2 && target_x + 20 < width - 43) {
+		mvwprintw(win, height-1, target_x, "%4dSamples@%dHz", output_set -> data_size, output_set -> sample_rate);
+	}
+}
+
+// Draws the mean hardware counts per stage (in thousands) below the latencies, from the divider at row y
+static void draw_perf_counters(WINDOW* win, int y) {
+	mvwhline(win, y, 1, ACS_HLINE, LATENCY_OVERLAY_WIDTH - 2);
+	mvwprintw(win, y, 2, " Counters (k per run) ");
+	mvwprintw(win, y + 1, 2, "%-9s %7s %7s %7s %7s", "stage", "cycles", "ipc", "cmiss", "bmiss");
+	for (int stage=0; stage < LATENCY_STAGE_COUNT; stage++) {
+		perf_summary_t summary;
+		summarise_perf_counters(stage, &summary);
+		mvwprintw(win, y + 2 + stage, 2, "%-9s", LATENCY_STAGE_NAMES[stage]);
+		const int columns[] = {PERF_CYCLES, -1, PERF_CACHE_MISSES, PERF_BRANCH_MISSES};
+		for (int i=0; i < 4; i++) {
+			int counter = columns[i];
+			if (counter == -1 && summary.ipc > 0) wprintw(win, " %7.2f", summary.ipc);
+			else if (counter != -1 && summary.available[counter]) wprintw(win, " %7.1f", summary.means[counter] / 1000);
+			else wprintw(win, " %7s", "-");
+		}
+	}
+}
+
+// Fills the overlay window with each stage's latency percentiles
+void draw_latency_overlay(WINDOW* win) {
 	werase(win);
 	box(win, 0, 0);
-	draw_y_labels(win);
-	char* banner = "===PulseAudio ncurses Visualiser===";
-	// find the midpoint for our banner
-	int target_x = (VIS_WIDTH/2) - sizeof(banner);
-	mvwprintw(win, 0, target_x, banner);
-	long int time_milis = (long int) time_taken.tv_usec / 1000;
-	float fps = time_milis > 0 ? 1000 / time_milis : 0;
-	update_graph(win, output_set);
-	mvwprintw(win, VIS_HEIGHT-1, VIS_WIDTH-16, "%ldms", time_milis);
-	mvwprintw(win, VIS_HEIGHT-1, VIS_WIDTH-10, "%.1fFPS", fps);
-	mvwprintw(win, VIS_HEIGHT-1, target_x, "%dSamples@%dHz", output_set -> data_size, output_set -> sample_rate);
+	mvwprintw(win, 0, 2, " Latency (ms) ");
+	mvwprintw(win, 1, 2, "%-9s %7s %7s %7s %7s", "stage", "p50", "p95", "p99", "max");
+	for (int stage=0; stage < LATENCY_STAGE_COUNT; stage++) {
+		latency_summary_t summary;
+		summarise_latency(stage, &summary);
+		mvwprintw(win, 2 + stage, 2, "%-9s %7.2f %7.2f %7.2f %7.2f", LATENCY_STAGE_NAMES[stage],
+			summary.p50_ns / 1e6, summary.p95_ns / 1e6, summary.p99_ns / 1e6, summary.max_ns / 1e6);
+	}
+	if (perf_counters_enabled()) draw_perf_counters(win, 2 + LATENCY_STAGE_COUNT);
+}
+
+// Shows the PulseAudio reconnect metrics along the top border once capture has failed at least once
+void draw_reconnect_status(WINDOW* win, pa_reconnect_t* reconnect) {
+	pa_reconnect_stats_t stats = reconnect -> stats;
+	if (stats.failures == 0) return;
+	char status[40];
+	if (reconnect -> recovering) {
+		snprintf(status, sizeof(status), "Reconnecting (attempt %lu)...", stats.reconnect_attempts);
+	} else {
+		snprintf(status, sizeof(status), "Reconnects: %lu, last %lums, max %lums", stats.reconnect_count,
+			(unsigned long) stats.last_recovery_ms, (unsigned long) stats.max_recovery_ms);
+	}
+	// Padded so a shorter status overwrites a longer one
+	mvwprintw(win, 0, 2, "%-39s", status);
+}
+
+// Marks the top right of the border while the input's silent and the display is paused
+void draw_idle_status(WINDOW* win, bool idle) {
+	int width = getmaxx(win);
+	if (width < VIS_MIN_WIDTH) return;
+	if (idle) mvwprintw(win, 0, width - 8, " Idle ");
+	else mvwhline(win, 0, width - 8, ACS_HLINE, 6);
 }
@@ -1,3 +1,4 @@
+#pragma once
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
@@ -6,11 +7,88 @@
 #include <ncurses.h>
 
 #include <shared.h>
+#include <pulseaudio/pa_reconnect.h>
+#include <frame_timing.h>
+#include <history.h>
+#include <latency.h>
+#include <perf_counters.h>
 
-#define VIS_HEIGHT 25
-#define VIS_WIDTH 120
-#define VIS_BARS 11
+// Smallest window we'll try to draw into
+#define VIS_MIN_HEIGHT 10
+#define VIS_MIN_WIDTH 50
+// Columns to the left of the bars for the dB axis labels
+#define VIS_AXIS_WIDTH 6
+// Room for the longest x axis label, e.g "22kHz" or an out of range "2147483647Hz"
+#define FREQUENCY_LABEL_SIZE 16
+// Each row is split into eighths using the Unicode block elements
+#define BAR_CELL_STEPS 8
+#define DB_PER_ROW 5.0
+// The latency overlay, a row per stage between a header and the border
+#define LATENCY_OVERLAY_WIDTH 46
+#define LATENCY_OVERLAY_HEIGHT (LATENCY_STAGE_COUNT + 3)
+// With hardware counters enabled, a divider, header and a row per stage are added below
+#define PERF_OVERLAY_HEIGHT (LATENCY_OVERLAY_HEIGHT + LATENCY_STAGE_COUNT + 2)
 
-void draw_bar(WINDOW* win, int start_x, int height, int width, const char* label);
+typedef enum vis_view {
+	VIEW_BARS,
+	VIEW_WATERFALL
+} vis_view_t;
 
-void draw_visualiser(WINDOW* win, complex_set_t* output_set, struct timeval time_taken);
+// Where everything goes for the current window size and spectrum
+// Rebuilt whenever the window is resized or the spectrum size changes, never per frame
+typedef struct vis_layout {
+	// Window size
+	int width;
+	int height;
+	// Rows available to the bars, between the top border and the labels
+	int bar_rows;
+	int bar_count;
+	// Columns from the start of one bar to the next, and the columns each bar fills
+	int bar_spacing;
+	int bar_width;
+	int start_x;
+	// The spectrum bins covered by each bar, from band_start up to (not including) band_end
+	int* band_start;
+	int* band_end;
+	// The spectrum the band table was built for
+	int data_size;
+	int frequency;
+} vis_layout_t;
+
+// What's currently on screen, so each frame only redraws what changed
+typedef struct visualiser_state {
+	// Whether the box, axis, banner and labels need drawing again
+	bool chrome_dirty;
+	// Whether the window size has changed since the layout was built
+	bool layout_dirty;
+	// Columns per bar, from the config
+	int bar_columns;
+	vis_layout_t layout;
+	// Bar heights (in eighths of a row) drawn by the last frame
+	int* bar_heights;
+	// Bar heights for the frame being drawn
+	int* next_heights;
+	// Space for one row of bar glyphs
+	char* row_buffer;
+	// Whether the terminal can show the UTF-8 eighth blocks
+	bool unicode;
+	vis_view_t view;
+	// Past spectra for the waterfall view
+	spectrum_history_t* history;
+	// The scrolling area of the waterfall view, over the bar area
+	WINDOW* waterfall_win;
+} visualiser_state_t;
+
+void init_visualiser_state(visualiser_state_t* state, bool unicode, int bar_columns, int width, int height, spectrum_history_t* history);
+void set_visualiser_view(visualiser_state_t* state, vis_view_t view);
+void free_visualiser_state(visualiser_state_t* state);
+void resize_visualiser(visualiser_state_t* state, int width, int height);
+void set_visualiser_bar_columns(visualiser_state_t* state, int bar_columns);
+void invalidate_visualiser(visualiser_state_t* state);
+
+void draw_bar_rows(WINDOW* win, visualiser_state_t* state);
+
+void draw_visualiser(WINDOW* win, visualiser_state_t* state, complex_set_t* output_set, bool new_spectrum, frame_stats_t* frame_stats, uint64_t analysis_ns, int target_fps, int quality_level);
+void draw_latency_overlay(WINDOW* win);
+void draw_reconnect_status(WINDOW* win, pa_reconnect_t* reconnect);
+void draw_idle_status(WINDOW* win, bool idle);
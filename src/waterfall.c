@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <waterfall.h>
+
+// Quietest to loudest
+static const short WATERFALL_COLOURS[WATERFALL_LEVELS] = {
+	-1, COLOR_BLUE, COLOR_CYAN, COLOR_GREEN, COLOR_YELLOW, COLOR_RED, COLOR_MAGENTA, COLOR_WHITE
+};
+
+void init_waterfall_colours() {
+	for (int i=0; i < WATERFALL_LEVELS; i++) {
+		init_pair(WATERFALL_PAIR_BASE + i, WATERFALL_COLOURS[i], WATERFALL_COLOURS[i]);
+	}
+}
+
+// Maps a quantised history level onto one of the colour levels
+int waterfall_level(uint8_t quantised) {
+	double decibels = dequantise_decibels(quantised);
+	if (decibels <= WATERFALL_FLOOR_DB) return 0;
+	int level = (int) (((decibels - WATERFALL_FLOOR_DB) * WATERFALL_LEVELS) / (WATERFALL_CEILING_DB - WATERFALL_FLOOR_DB));
+	return level < WATERFALL_LEVELS ? level : WATERFALL_LEVELS - 1;
+}
+
+// (Re)creates the scrolling area over the bar area of the visualiser window, for the current layout
+// The area spans every bar row, so the box border on both sides stays the same on each line
+// and ncurses can scroll the terminal rather than rewriting every line
+void build_waterfall_window(WINDOW* win, visualiser_state_t* state) {
+	free_waterfall_window(state);
+	vis_layout_t* layout = &state -> layout;
+	int columns = layout -> bar_count * layout -> bar_spacing;
+	if (layout -> bar_rows < 1 || columns < 1) return;
+	state -> waterfall_win = derwin(win, layout -> bar_rows, columns, 1, layout -> start_x);
+	if (state -> waterfall_win == NULL) return;
+	// Scrolling is only enabled for wscrl, otherwise writing the bottom right cell would scroll us
+	scrollok(state -> waterfall_win, false);
+	idlok(state -> waterfall_win, true);
+	idlok(win, true);
+	// So our changes mark the parent's lines as changed, as the parent window is what gets refreshed
+	syncok(state -> waterfall_win, true);
+}
+
+void free_waterfall_window(visualiser_state_t* state) {
+	if (state -> waterfall_win != NULL) {
+		delwin(state -> waterfall_win);
+		state -> waterfall_win = NULL;
+	}
+}
+
+// Paints a history row at line y of the waterfall, one colour run at a time
+void paint_waterfall_row(WINDOW* area, vis_layout_t* layout, const uint8_t* row, int bins, int y) {
+	wmove(area, y, 0);
+	int run_level = -1;
+	int run_length = 0;
+	char spaces[layout -> bar_spacing * layout -> bar_count + 1];
+	memset(spaces, ' ', sizeof(spaces));
+	// Rows are always bins wide, the bands may be for a smaller spectrum (see push_history)
+	int scale = layout -> data_size > 0 && layout -> data_size < bins ? bins / layout -> data_size : 1;
+	for (int i=0; i <= layout -> bar_count; i++) {
+		int level = -1;
+		if (i < layout -> bar_count) {
+			// Each bar's columns show the loudest bin in its band
+			uint8_t peak = 0;
+			for (int bin=layout -> band_start[i] * scale; bin < layout -> band_end[i] * scale && bin < bins; bin++) {
+				if (row[bin] > peak) peak = row[bin];
+			}
+			level = waterfall_level(peak);
+		}
+		// Write out the run once the colour changes, or we reach the end
+		if (level != run_level && run_length > 0) {
+			wattron(area, COLOR_PAIR(WATERFALL_PAIR_BASE + run_level));
+			waddnstr(area, spaces, run_length);
+			wattroff(area, COLOR_PAIR(WATERFALL_PAIR_BASE + run_level));
+			run_length = 0;
+		}
+		run_level = level;
+		run_length += layout -> bar_spacing;
+	}
+}
+
+// Paints every visible line from the history, i.e after a resize or switching view
+void repaint_waterfall(visualiser_state_t* state) {
+	WINDOW* area = state -> waterfall_win;
+	spectrum_history_t* history = state -> history;
+	if (area == NULL || history == NULL) return;
+	werase(area);
+	int lines = getmaxy(area);
+	for (int age=0; age < lines; age++) {
+		const uint8_t* row = history_row(history, age);
+		if (row == NULL) break;
+		paint_waterfall_row(area, &state -> layout, row, history -> bins, age);
+	}
+}
+
+// Scrolls the waterfall down by a line and paints the newest history row at the top
+void scroll_waterfall(visualiser_state_t* state) {
+	WINDOW* area = state -> waterfall_win;
+	spectrum_history_t* history = state -> history;
+	if (area == NULL || history == NULL) return;
+	const uint8_t* row = history_row(history, 0);
+	if (row == NULL) return;
+	scrollok(area, true);
+	wscrl(area, -1);
+	scrollok(area, false);
+	paint_waterfall_row(area, &state -> layout, row, history -> bins, 0);
+}
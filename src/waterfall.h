@@ -0,0 +1,21 @@
+#pragma once
+// The waterfall (scrolling spectrogram) view
+// Each new spectrum becomes one row of coloured cells at the top of the graph area,
+// with older rows scrolled down, so only the new row needs writing to the terminal
+
+#include <ncurses.h>
+#include <visualiser.h>
+#include <history.h>
+
+// Colour pairs used for the intensity levels
+#define WATERFALL_PAIR_BASE 10
+#define WATERFALL_LEVELS 8
+// Decibel range mapped across the intensity levels
+#define WATERFALL_FLOOR_DB 20.0
+#define WATERFALL_CEILING_DB 120.0
+
+void init_waterfall_colours();
+void build_waterfall_window(WINDOW* win, visualiser_state_t* state);
+void free_waterfall_window(visualiser_state_t* state);
+void repaint_waterfall(visualiser_state_t* state);
+void scroll_waterfall(visualiser_state_t* state);
@@ -0,0 +1,69 @@
+#include <string.h>
+#include <wav.h>
+
+static void put_u16(uint8_t* buffer, uint16_t value) {
+	buffer[0] = value & 0xFF;
+	buffer[1] = value >> 8;
+}
+
+static void put_u32(uint8_t* buffer, uint32_t value) {
+	for (int i=0; i < 4; i++) buffer[i] = (value >> (i * 8)) & 0xFF;
+}
+
+static uint16_t get_u16(const uint8_t* buffer) {
+	return buffer[0] | (buffer[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t* buffer) {
+	uint32_t value = 0;
+	for (int i=0; i < 4; i++) value |= (uint32_t) buffer[i] << (i * 8);
+	return value;
+}
+
+// Fills header with a WAV_HEADER_SIZE header for 16-bit PCM followed by data_bytes of samples
+void build_wav_header(uint8_t* header, int sample_rate, int channels, uint32_t data_bytes) {
+	int block_align = channels * sizeof(int16_t);
+	memcpy(header, "RIFF", 4);
+	put_u32(header + 4, 36 + data_bytes);
+	memcpy(header + 8, "WAVE", 4);
+	memcpy(header + 12, "fmt ", 4);
+	put_u32(header + 16, 16);
+	// PCM
+	put_u16(header + 20, 1);
+	put_u16(header + 22, channels);
+	put_u32(header + 24, sample_rate);
+	put_u32(header + 28, sample_rate * block_align);
+	put_u16(header + 32, block_align);
+	put_u16(header + 34, 16);
+	memcpy(header + 36, "data", 4);
+	put_u32(header + 40, data_bytes);
+}
+
+// Finds the format and sample data of an in-memory WAV file
+// A data size beyond the end (e.g a recording that was never finalised) is cut to what's there
+// Returns 0 on success, 1 if it isn't a PCM WAV
+int parse_wav(const uint8_t* data, size_t length, wav_info_t* info) {
+	if (length < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) return 1;
+	bool found_format = false;
+	size_t offset = 12;
+	while (offset + 8 <= length) {
+		const uint8_t* chunk = data + offset;
+		size_t chunk_size = get_u32(chunk + 4);
+		if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16 && offset + 8 + 16 <= length) {
+			if (get_u16(chunk + 8) != 1) return 1;
+			info -> channels = get_u16(chunk + 10);
+			info -> sample_rate = get_u32(chunk + 12);
+			info -> bits_per_sample = get_u16(chunk + 22);
+			found_format = true;
+		} else if (memcmp(chunk, "data", 4) == 0) {
+			if (!found_format) return 1;
+			info -> data_offset = offset + 8;
+			size_t available = length - info -> data_offset;
+			info -> data_bytes = chunk_size < available ? chunk_size : available;
+			return 0;
+		}
+		// Chunks are padded to an even size
+		offset += 8 + chunk_size + (chunk_size & 1);
+	}
+	return 1;
+}
@@ -0,0 +1,23 @@
+#pragma once
+// Reading and writing the canonical 16-bit PCM WAV layout that purses records
+// Recordings are 44 byte RIFF headers followed by the samples, readers also skip any extra chunks
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WAV_HEADER_SIZE 44
+// The RIFF sizes are 32-bit
+#define WAV_MAX_DATA_BYTES 0xFFFFFFD3UL
+
+typedef struct wav_info {
+	int sample_rate;
+	int channels;
+	int bits_per_sample;
+	// Where the samples start and how many bytes of them there are
+	size_t data_offset;
+	size_t data_bytes;
+} wav_info_t;
+
+void build_wav_header(uint8_t* header, int sample_rate, int channels, uint32_t data_bytes);
+int parse_wav(const uint8_t* data, size_t length, wav_info_t* info);
@@ -9,6 +9,23 @@
 #include <pulseaudio/pulsehandler.h>
 #include <shared.h>
 #include <processing.h>
+#include <history.h>
+#include <frame_format.h>
+#include <shm/shm_publisher.h>
+#include <shm/shm_reader.h>
+#include <server/subscription.h>
+#include <wav.h>
+#include <replay.h>
+#include <latency.h>
+#include <analysis.h>
+#include <alloc_stats.h>
+#include <triple_buffer.h>
+#include <silence.h>
+#include <governor.h>
+#include <sliding_dft.h>
+#include <trace/trace.h>
+#include <spectrogram.h>
+#include <recorder.h>
 
 #define EPS 0.01
 
@@ -265,6 +282,176 @@ void test_dft_wiki_example_ctfft() {
 	assert_complex(CMPLX(4.00, cimag(4.00*I)), output_data[3].complex_number);
 }
 
+void test_reconnect_backoff() {
+	printf("=== Testing PulseAudio reconnect backoff ===\n");
+	pa_reconnect_t reconnect;
+	init_reconnect(&reconnect);
+
+	// GIVEN capture fails at t=1s
+	uint64_t now_ns = 1000000000;
+	reconnect_failed(&reconnect, now_ns);
+	assert_int(1, reconnect.recovering);
+	assert_int(1, reconnect.stats.failures);
+	// THEN the first attempt is due straight away
+	assert_int(1, reconnect_due(&reconnect, now_ns));
+
+	// WHEN attempts keep failing
+	for (int i=0; i < 10; i++) {
+		reconnect_attempted(&reconnect, now_ns);
+		// THEN we wait out the backoff before the next attempt
+		assert_int(0, reconnect_due(&reconnect, now_ns));
+		now_ns = reconnect.next_attempt_ns;
+		assert_int(1, reconnect_due(&reconnect, now_ns));
+		reconnect_failed(&reconnect, now_ns);
+	}
+	// AND the backoff doubles up to the max
+	assert_int(RECONNECT_MAX_BACKOFF_MS, reconnect.backoff_ms);
+	// AND repeated failures during a recovery count as a single failure
+	assert_int(1, reconnect.stats.failures);
+
+	// WHEN capture works again
+	reconnect_succeeded(&reconnect, now_ns);
+	// THEN the recovery metrics are recorded
+	assert_int(0, reconnect.recovering);
+	assert_int(1, reconnect.stats.reconnect_count);
+	assert_int(10, reconnect.stats.reconnect_attempts);
+	assert_int((now_ns - 1000000000) / 1000000, reconnect.stats.last_recovery_ms);
+	assert_int(RECONNECT_INITIAL_BACKOFF_MS, reconnect.backoff_ms);
+}
+
+void test_history_ring() {
+	printf("=== Testing spectrum history ring ===\n");
+	spectrum_history_t history;
+	assert_int(0, init_history(&history, 3, 4));
+
+	complex_set_t* spectrum = NULL;
+	malloc_complex_set(&spectrum, 4, 44100);
+	// GIVEN 4 spectra pushed into a ring of 3 rows
+	for (int row=0; row < 4; row++) {
+		for (int i=0; i < 4; i++) {
+			spectrum -> complex_numbers[i].decibels = (row * 10) + i;
+		}
+		push_history(&history, spectrum);
+	}
+
+	// THEN only the 3 newest rows are kept
+	assert_int(3, history_size(&history));
+	assert_int(1, history_row(&history, 3) == NULL);
+	// AND the newest row is at age 0
+	assert_double(31.0, dequantise_decibels(history_row(&history, 0)[1]));
+	// AND the oldest row has been overwritten
+	assert_double(10.0, dequantise_decibels(history_row(&history, 2)[0]));
+	// AND levels are clamped to the quantised range
+	assert_int(0, quantise_decibels(-20.0));
+	assert_int(UINT8_MAX, quantise_decibels(500.0));
+
+	free_complex_set(spectrum);
+	free_history(&history);
+}
+
+void test_frame_format_round_trip() {
+	printf("=== Testing headless frame encoding ===\n");
+	complex_set_t* spectrum = NULL;
+	malloc_complex_set(&spectrum, 4, 44100);
+	for (int i=0; i < 4; i++) {
+		spectrum -> complex_numbers[i].magnitude = i * 1.5;
+	}
+
+	// GIVEN a buffer too small for the record
+	uint8_t buffer[FRAME_HEADER_SIZE + (4 * sizeof(float))];
+	// THEN nothing is encoded
+	assert_int(0, encode_frame(buffer, sizeof(buffer) - 1, 0, 0, spectrum));
+
+	// WHEN a spectrum is encoded
+	size_t size = encode_frame(buffer, sizeof(buffer), 1234567890123ULL, 42, spectrum);
+	assert_int(sizeof(buffer), size);
+
+	// THEN the header decodes to the same values
+	frame_header_t header;
+	assert_int(0, decode_frame_header(buffer, size, &header));
+	assert_int(FRAME_VERSION, header.version);
+	assert_int(1, header.timestamp_ns == 1234567890123ULL);
+	assert_int(42, header.sequence);
+	assert_int(44100, header.sample_rate);
+	assert_int(4, header.bin_count);
+	// AND so do the magnitudes
+	assert_double(4.5, decode_frame_magnitude(buffer, &header, 3));
+	// AND truncated records are rejected
+	assert_int(1, decode_frame_header(buffer, size - 1, &header));
+
+	free_complex_set(spectrum);
+}
+
+void test_shm_ring() {
+	printf("=== Testing shared memory spectrum ring ===\n");
+	shm_publisher_t publisher;
+	assert_int(0, open_shm_publisher(&publisher, "/purses-test-ring"));
+	shm_reader_t reader;
+	assert_int(0, open_shm_reader(&reader, "/purses-test-ring"));
+	// GIVEN nothing has been published
+	assert_int(0, shm_latest_sequence(&reader));
+
+	complex_set_t* spectrum = NULL;
+	malloc_complex_set(&spectrum, 4, 44100);
+	// WHEN more spectra are published than there are slots
+	for (int sequence=1; sequence <= SPECTRUM_SHM_SLOTS + 2; sequence++) {
+		for (int i=0; i < 4; i++) {
+			spectrum -> complex_numbers[i].magnitude = sequence + i;
+		}
+		publish_shm_spectrum(&publisher, spectrum, sequence, 1000 + sequence);
+	}
+
+	// THEN the reader sees the latest
+	assert_int(SPECTRUM_SHM_SLOTS + 2, shm_latest_sequence(&reader));
+	float magnitudes[4];
+	shm_frame_info_t info;
+	assert_int(0, shm_read_spectrum(&reader, SPECTRUM_SHM_SLOTS + 2, magnitudes, 4, &info));
+	assert_int(4, info.bin_count);
+	assert_int(1000 + SPECTRUM_SHM_SLOTS + 2, info.timestamp_ns);
+	assert_double(SPECTRUM_SHM_SLOTS + 5, magnitudes[3]);
+	// AND overwritten or future spectra aren't available
+	assert_int(1, shm_read_spectrum(&reader, 1, magnitudes, 4, &info));
+	assert_int(1, shm_read_spectrum(&reader, SPECTRUM_SHM_SLOTS + 3, magnitudes, 4, &info));
+
+	free_complex_set(spectrum);
+	close_shm_reader(&reader);
+	close_shm_publisher(&publisher);
+}
+
+void test_subscription_parsing() {
+	printf("=== Testing socket subscriptions ===\n");
+	subscription_t subscription;
+	// GIVEN a subscription with options
+	assert_int(0, parse_subscription("SUBSCRIBE bands rate=30 decimate=2 bands=8", &subscription));
+	// THEN they're all picked up
+	assert_int(SUBSCRIBE_BANDS, subscription.kind);
+	assert_int(30, subscription.rate);
+	assert_int(2, subscription.decimate);
+	assert_int(8, subscription.bands);
+	// AND the defaults are used otherwise
+	assert_int(0, parse_subscription("SUBSCRIBE levels", &subscription));
+	assert_int(0, subscription.rate);
+	assert_int(1, subscription.decimate);
+	// AND invalid subscriptions are rejected
+	assert_int(1, parse_subscription("SUBSCRIBE waveform", &subscription));
+	assert_int(1, parse_subscription("SUBSCRIBE spectrum decimate=0", &subscription));
+	assert_int(1, parse_subscription("HELLO", &subscription));
+
+	// WHEN a flat spectrum is reduced to bands
+	complex_set_t* spectrum = NULL;
+	malloc_complex_set(&spectrum, 64, 44100);
+	for (int i=0; i < 64; i++) {
+		spectrum -> complex_numbers[i].magnitude = 2.0;
+	}
+	float values[SUBSCRIPTION_MAX_VALUES];
+	parse_subscription("SUBSCRIBE bands bands=8", &subscription);
+	// THEN every band has the same level
+	assert_int(8, subscription_values(&subscription, spectrum, values, SUBSCRIPTION_MAX_VALUES));
+	assert_double(2.0, values[0]);
+	assert_double(2.0, values[7]);
+	free_complex_set(spectrum);
+}
+
 /**
  * For generating test data
  **/
@@ -284,6 +471,650 @@ void sine(record_stream_data_t* record_data, int frequency, int sample_rate, int
 	}
 }
 
+void test_wav_header_round_trip() {
+	printf("=== Testing WAV header round trip ===\n");
+	// GIVEN a recording header followed by 4 samples
+	uint8_t data[WAV_HEADER_SIZE + 8] = {0};
+	build_wav_header(data, 44100, 1, 8);
+
+	// WHEN it's parsed
+	wav_info_t info;
+	assert_int(0, parse_wav(data, sizeof(data), &info));
+
+	// THEN we get the format and samples back
+	assert_int(44100, info.sample_rate);
+	assert_int(1, info.channels);
+	assert_int(16, info.bits_per_sample);
+	assert_int(WAV_HEADER_SIZE, info.data_offset);
+	assert_int(8, info.data_bytes);
+	// AND a truncated recording only reports the samples that are there
+	assert_int(0, parse_wav(data, WAV_HEADER_SIZE + 4, &info));
+	assert_int(4, info.data_bytes);
+	// AND anything that isn't a WAV is rejected
+	data[0] = 'X';
+	assert_int(1, parse_wav(data, sizeof(data), &info));
+}
+
+void test_replay_blocks() {
+	printf("=== Testing replay of a raw recording ===\n");
+	// GIVEN a raw recording of 2 and a half blocks
+	int16_t samples[NUM_SAMPLES * 5 / 2];
+	for (int i=0; i < NUM_SAMPLES * 5 / 2; i++) samples[i] = i;
+	char path[] = "/tmp/purses-test-replay-XXXXXX";
+	int fd = mkstemp(path);
+	assert_int(sizeof(samples), write(fd, samples, sizeof(samples)));
+	close(fd);
+
+	// WHEN it's replayed as fast as possible
+	replay_source_t replay;
+	assert_int(0, open_replay(&replay, path, false));
+	const int16_t* first = next_replay_block(&replay, NUM_SAMPLES);
+	const int16_t* second = next_replay_block(&replay, NUM_SAMPLES);
+
+	// THEN we get each whole block in order
+	assert_int(0, first[0]);
+	assert_int(NUM_SAMPLES, second[0]);
+	assert_int(NUM_SAMPLES * 2 - 1, second[NUM_SAMPLES - 1]);
+	// AND the partial block at the end is left out
+	assert_int(1, replay_finished(&replay, NUM_SAMPLES));
+	assert_int(1, next_replay_block(&replay, NUM_SAMPLES) == NULL);
+
+	close_replay(&replay);
+	unlink(path);
+}
+
+void test_latency_percentiles() {
+	printf("=== Testing stage latency histograms ===\n");
+	// GIVEN 99 FFTs of ~1ms and one of 40ms
+	for (int i=0; i < 99; i++) record_latency(LATENCY_FFT, 1000000 + i);
+	record_latency(LATENCY_FFT, 40000000);
+
+	// WHEN they're summarised
+	latency_summary_t summary;
+	summarise_latency(LATENCY_FFT, &summary);
+
+	// THEN the percentiles are within a bucket (25%) of the real values
+	assert_int(100, summary.count);
+	assert_int(1, summary.p50_ns >= 1000000 && summary.p50_ns <= 1250000);
+	assert_int(1, summary.p99_ns >= 1000000 && summary.p99_ns <= 1250000);
+	assert_int(40000000, summary.max_ns);
+	// AND every latency falls below its bucket's limit
+	assert_int(1, 999 < latency_bucket_limit_ns(latency_bucket(999)));
+	assert_int(1, 40000000 < latency_bucket_limit_ns(latency_bucket(40000000)));
+	assert_int(LATENCY_BUCKET_COUNT - 1, latency_bucket(UINT64_MAX));
+	// AND other stages are untouched
+	summarise_latency(LATENCY_DRAW, &summary);
+	assert_int(0, summary.count);
+}
+
+void test_steady_state_allocations() {
+	printf("=== Testing the analysis thread doesn't allocate per frame or leak ===\n");
+	// GIVEN the analysis thread replaying as fast as it can, past its first few frames
+	alloc_stats_t before_start;
+	read_alloc_stats(&before_start);
+	replay_source_t replay;
+	assert_int(0, open_synthetic_replay(&replay, 1));
+	analysis_t analysis;
+	pa_device_t device = {0};
+	assert_int(0, start_analysis(&analysis, device, &replay, NULL, NULL, NULL));
+	unsigned long sequence = 0;
+	for (int i=0; i < 2; i++) assert_int(1, wait_for_spectrum(&analysis, &sequence, NULL, 5000000000));
+
+	// WHEN it transforms a few more frames
+	alloc_stats_t warm;
+	read_alloc_stats(&warm);
+	unsigned long warm_sequence = sequence;
+	for (int i=0; i < 4; i++) {
+		assert_int(1, wait_for_spectrum(&analysis, &sequence, NULL, 5000000000));
+		pthread_mutex_lock(&analysis.lock);
+		sequence = analysis.sequence;
+		pthread_mutex_unlock(&analysis.lock);
+	}
+	alloc_stats_t steady;
+	read_alloc_stats(&steady);
+
+	// THEN none of those frames allocated
+	assert_int(1, sequence - warm_sequence >= 4);
+	assert_int(0, steady.allocations - warm.allocations);
+	// AND everything is freed once it's stopped
+	stop_analysis(&analysis);
+	close_replay(&replay);
+	alloc_stats_t after_stop;
+	read_alloc_stats(&after_stop);
+	assert_int(0, after_stop.live_bytes - before_start.live_bytes);
+}
+
+#define ENGINE_MAX_SIZE 2048
+// Fixed, so a failure reproduces
+#define ENGINE_SEED 44
+// Too large for the full DFT, so only ENGINE_LARGE_BINS of its bins are summed directly
+#define ENGINE_LARGE_SIZE 65536
+#define ENGINE_LARGE_BINS 32
+// Relative to the largest bin, so bins that should be ~0 don't blow the error up
+#define ENGINE_MAX_RELATIVE_ERROR 1e-9
+
+typedef enum engine_input {
+	INPUT_RANDOM,
+	INPUT_IMPULSE,
+	INPUT_SINE,
+	INPUT_WHITE_NOISE,
+	ENGINE_INPUT_COUNT
+} engine_input_t;
+
+static const char* ENGINE_INPUT_NAMES[] = {"random", "impulse", "sine", "white noise"};
+
+static double random_unit() {
+	return (double) rand() / RAND_MAX;
+}
+
+static void fill_engine_input(complex_set_t* set, engine_input_t input, int size) {
+	int impulse_at = rand() % size;
+	// Usually between bins, so the energy leaks across the whole spectrum
+	double cycles = random_unit() * size / 2;
+	for (int i=0; i < size; i++) {
+		double complex value = 0;
+		if (input == INPUT_RANDOM) {
+			value = CMPLX((random_unit() * 2 - 1) * INT16_MAX, (random_unit() * 2 - 1) * INT16_MAX);
+		} else if (input == INPUT_IMPULSE) {
+			value = i == impulse_at ? INT16_MAX : 0;
+		} else if (input == INPUT_SINE) {
+			value = 12000 * sin(2 * M_PI * cycles * i / size);
+		} else {
+			// Gaussian, by Box-Muller
+			value = 4000 * sqrt(-2 * log(1 - random_unit())) * cos(2 * M_PI * random_unit());
+		}
+		set -> complex_numbers[i].complex_number = value;
+	}
+	set -> data_size = size;
+}
+
+static double relative_error(complex_set_t* expected, complex_set_t* actual, int size) {
+	double peak = 0;
+	double error = 0;
+	for (int i=0; i < size; i++) {
+		double magnitude = cabs(expected -> complex_numbers[i].complex_number);
+		double diff = cabs(expected -> complex_numbers[i].complex_number - actual -> complex_numbers[i].complex_number);
+		if (magnitude > peak) peak = magnitude;
+		if (diff > error) error = diff;
+	}
+	return peak > 0 ? error / peak : error;
+}
+
+// The DFT of a single bin, with the twiddles looked up from a table of size entries
+static double complex dft_bin(complex_set_t* input, double complex* twiddles, int size, int bin) {
+	double complex sum = 0;
+	for (int n=0; n < size; n++) {
+		sum += input -> complex_numbers[n].complex_number * twiddles[(int) (((long) bin * n) % size)];
+	}
+	return sum;
+}
+
+// Checks iterative_fft at ENGINE_LARGE_SIZE against the DFT of a spread of bins, for each input
+static void check_large_iterative_fft() {
+	complex_set_t* input = NULL;
+	complex_set_t* actual = NULL;
+	malloc_complex_set(&input, ENGINE_LARGE_SIZE, MAX_SAMPLE_RATE);
+	malloc_complex_set(&actual, ENGINE_LARGE_SIZE, MAX_SAMPLE_RATE);
+	double complex* twiddles = malloc(sizeof(double complex) * ENGINE_LARGE_SIZE);
+	for (int i=0; i < ENGINE_LARGE_SIZE; i++) twiddles[i] = cexp(-2 * M_PI * I * i / ENGINE_LARGE_SIZE);
+	double worst_error = 0;
+	for (int kind=0; kind < ENGINE_INPUT_COUNT; kind++) {
+		// GIVEN a large random, impulse, sine or white noise input
+		fill_engine_input(input, kind, ENGINE_LARGE_SIZE);
+		actual -> data_size = ENGINE_LARGE_SIZE;
+
+		// WHEN it's transformed by iterative_fft
+		iterative_fft(input, actual);
+
+		// THEN the bins checked match the DFT to within the bound
+		double peak = 0;
+		for (int i=0; i < ENGINE_LARGE_SIZE; i++) {
+			if (cabs(actual -> complex_numbers[i].complex_number) > peak) peak = cabs(actual -> complex_numbers[i].complex_number);
+		}
+		double error = 0;
+		for (int b=0; b < ENGINE_LARGE_BINS; b++) {
+			int bin = b == 0 ? 0 : rand() % ENGINE_LARGE_SIZE;
+			double diff = cabs(dft_bin(input, twiddles, ENGINE_LARGE_SIZE, bin) - actual -> complex_numbers[bin].complex_number);
+			if (diff > error) error = diff;
+		}
+		error = peak > 0 ? error / peak : error;
+		if (error > ENGINE_MAX_RELATIVE_ERROR) {
+			printf("iterative differs from the DFT by %g for %d samples of %s\n", error, ENGINE_LARGE_SIZE, ENGINE_INPUT_NAMES[kind]);
+		}
+		assert_int(1, error <= ENGINE_MAX_RELATIVE_ERROR);
+		if (error > worst_error) worst_error = error;
+	}
+	printf("%-10s %5d samples, max relative error %.1e over %d bins\n", "iterative", ENGINE_LARGE_SIZE, worst_error, ENGINE_LARGE_BINS);
+	free(twiddles);
+	free_complex_set(input);
+	free_complex_set(actual);
+}
+
+void test_fft_engines_match_dft() {
+	srand(ENGINE_SEED);
+	printf("=== Testing every FFT engine against the DFT (seed %d) ===\n", ENGINE_SEED);
+	complex_set_t* input = NULL;
+	complex_set_t* expected = NULL;
+	complex_set_t* actual = NULL;
+	malloc_complex_set(&input, ENGINE_MAX_SIZE, MAX_SAMPLE_RATE);
+	malloc_complex_set(&expected, ENGINE_MAX_SIZE, MAX_SAMPLE_RATE);
+	malloc_complex_set(&actual, ENGINE_MAX_SIZE, MAX_SAMPLE_RATE);
+	// dft is the reference, so it's skipped
+	for (int e=1; e < FFT_ENGINE_COUNT; e++) {
+		const fft_engine_t* engine = &FFT_ENGINES[e];
+		for (int size=2; size <= ENGINE_MAX_SIZE; size *= 2) {
+			double worst_error = 0;
+			uint64_t dft_ns = 0;
+			uint64_t engine_ns = 0;
+			for (int kind=0; kind < ENGINE_INPUT_COUNT; kind++) {
+				// GIVEN a random, impulse, sine or white noise input
+				fill_engine_input(input, kind, size);
+				expected -> data_size = size;
+				actual -> data_size = size;
+
+				// WHEN it's transformed by the engine and the DFT
+				uint64_t start_ns = get_monotonic_ns();
+				dft(input, expected);
+				uint64_t middle_ns = get_monotonic_ns();
+				engine -> transform(input, actual);
+				engine_ns += get_monotonic_ns() - middle_ns;
+				dft_ns += middle_ns - start_ns;
+
+				// THEN every bin matches to within the bound
+				double error = relative_error(expected, actual, size);
+				if (error > ENGINE_MAX_RELATIVE_ERROR) {
+					printf("%s differs from the DFT by %g for %d samples of %s\n", engine -> name, error, size, ENGINE_INPUT_NAMES[kind]);
+				}
+				assert_int(1, error <= ENGINE_MAX_RELATIVE_ERROR);
+				if (error > worst_error) worst_error = error;
+			}
+			printf("%-10s %5d samples, max relative error %.1e, %6.1fx the speed of the DFT\n",
+				engine -> name, size, worst_error, engine_ns > 0 ? (double) dft_ns / engine_ns : 0);
+		}
+	}
+	// AND the iterative engine still matches at sizes the full DFT is too slow for
+	check_large_iterative_fft();
+	// AND engines can be found by name
+	assert_int(1, find_fft_engine("iterative") == &FFT_ENGINES[2]);
+	assert_int(1, find_fft_engine("none") == NULL);
+	free_complex_set(input);
+	free_complex_set(expected);
+	free_complex_set(actual);
+}
+
+void test_triple_buffer_handoff() {
+	printf("=== Testing the triple buffer hands over the newest buffer without sharing one ===\n");
+	// GIVEN a triple buffer nothing's been published to
+	int values[3] = {0, 0, 0};
+	triple_buffer_t triple;
+	init_triple_buffer(&triple, &values[0], &values[1], &values[2]);
+	assert_int(0, acquire_triple_buffer(&triple));
+
+	// WHEN two buffers are published before the reader gets round to them
+	*(int*) triple_buffer_back(&triple) = 1;
+	publish_triple_buffer(&triple);
+	*(int*) triple_buffer_back(&triple) = 2;
+	publish_triple_buffer(&triple);
+
+	// THEN the reader gets the newest, once
+	assert_int(1, acquire_triple_buffer(&triple));
+	assert_int(2, *(int*) triple_buffer_front(&triple));
+	assert_int(0, acquire_triple_buffer(&triple));
+	// AND the writer never fills the reader's buffer
+	for (int i=3; i < 10; i++) {
+		assert_int(1, triple_buffer_back(&triple) != triple_buffer_front(&triple));
+		*(int*) triple_buffer_back(&triple) = i;
+		publish_triple_buffer(&triple);
+		assert_int(2, *(int*) triple_buffer_front(&triple));
+	}
+	assert_int(1, acquire_triple_buffer(&triple));
+	assert_int(9, *(int*) triple_buffer_front(&triple));
+}
+
+void test_silence_gate() {
+	printf("=== Testing the silence gate closes after the hold time and opens on the first loud block ===\n");
+	// GIVEN a gate that closes after 100ms of samples no louder than 16
+	silence_options_t options = {16, 100};
+	silence_gate_t gate;
+	init_silence_gate(&gate, &options);
+	int16_t quiet[NUM_SAMPLES];
+	int16_t loud[NUM_SAMPLES];
+	for (int i=0; i < NUM_SAMPLES; i++) {
+		quiet[i] = (i % 33) - 16;
+		loud[i] = quiet[i];
+	}
+	loud[NUM_SAMPLES - 1] = -17;
+	assert_int(16, block_peak(quiet, NUM_SAMPLES));
+	assert_int(17, block_peak(loud, NUM_SAMPLES));
+	// AND a full scale sample in the SIMD lanes or the tail isn't lost to overflow
+	loud[8] = INT16_MIN;
+	assert_int(32768, block_peak(loud, NUM_SAMPLES));
+	assert_int(32768, block_peak(loud, 9));
+	assert_int(16, block_peak(loud, 8));
+	loud[8] = quiet[8];
+
+	// WHEN quiet blocks arrive for less than the hold time
+	// THEN it stays open
+	assert_int(0, update_silence_gate(&gate, quiet, NUM_SAMPLES, 1000000000));
+	assert_int(0, update_silence_gate(&gate, quiet, NUM_SAMPLES, 1099999999));
+	// AND it closes once they've been quiet for the hold time
+	assert_int(1, update_silence_gate(&gate, quiet, NUM_SAMPLES, 1100000000));
+	// AND a single loud sample opens it again straight away
+	assert_int(0, update_silence_gate(&gate, loud, NUM_SAMPLES, 1200000000));
+	assert_int(0, update_silence_gate(&gate, quiet, NUM_SAMPLES, 1250000000));
+	// AND a hold time of 0 never closes it
+	options.hold_ms = 0;
+	init_silence_gate(&gate, &options);
+	assert_int(0, update_silence_gate(&gate, quiet, NUM_SAMPLES, 1000000000));
+	assert_int(0, update_silence_gate(&gate, quiet, NUM_SAMPLES, 9000000000));
+}
+
+void test_quality_governor() {
+	printf("=== Testing the governor drops quality when over budget and regains it when well under ===\n");
+	// GIVEN a 60fps frame period and a governor at full quality
+	uint64_t period_ns = 1000000000 / 60;
+	quality_governor_t governor;
+	init_governor(&governor);
+	// AND an FFT taking 46.4ms, twice the time between blocks (the FFT's budget, being longer than the frame period)
+	double load = frame_load(governor_level(&governor), period_ns / 2, 46439909, period_ns);
+	assert_int(1, load > 1.99 && load < 2.01);
+
+	// WHEN frames are over budget for less than GOVERNOR_DOWN_NS
+	uint64_t now_ns = 1000000000;
+	int changes = 0;
+	for (; now_ns < 1000000000 + GOVERNOR_DOWN_NS / 2; now_ns += period_ns) changes += update_governor(&governor, load, now_ns);
+	// THEN nothing changes
+	assert_int(0, changes);
+	assert_int(0, governor.level);
+	// AND once they've been over for longer it drops a level
+	for (; now_ns < 1000000000 + GOVERNOR_DOWN_NS * 2 && changes == 0; now_ns += period_ns) changes += update_governor(&governor, load, now_ns);
+	assert_int(1, governor.level);
+
+	// WHEN the load is just under budget
+	// THEN it stays at that level
+	changes = 0;
+	uint64_t start_ns = now_ns;
+	for (; now_ns < start_ns + GOVERNOR_UP_NS * 2; now_ns += period_ns) changes += update_governor(&governor, 0.8, now_ns);
+	assert_int(0, changes);
+	// AND it regains full quality once it's been well under for GOVERNOR_UP_NS
+	for (; now_ns < start_ns + GOVERNOR_UP_NS * 4 && changes == 0; now_ns += period_ns) changes += update_governor(&governor, 0.1, now_ns);
+	assert_int(0, governor.level);
+	// AND it never goes beyond the lowest level
+	for (int i=0; i < 10000; i++, now_ns += period_ns) update_governor(&governor, 100.0, now_ns);
+	assert_int(QUALITY_LEVEL_COUNT - 1, governor.level);
+}
+
+// Over budget, but not by so much it's still over once a level's halved it
+#define GOVERNOR_OVER_LOAD 1.5
+
+// Feeds the governor frames of the given load at 60fps, until the level changes or for_ns has passed
+// Returns true if the level changed
+static bool drive_governor(quality_governor_t* governor, double load, uint64_t* now_ns, uint64_t for_ns) {
+	uint64_t end_ns = *now_ns + for_ns;
+	for (; *now_ns < end_ns; *now_ns += 1000000000 / 60) {
+		if (update_governor(governor, load, *now_ns)) return true;
+	}
+	return false;
+}
+
+void test_governor_backoff() {
+	printf("=== Testing the governor waits longer to regain a level it keeps dropping, up to a limit ===\n");
+	// GIVEN a governor that's dropped a level
+	quality_governor_t governor;
+	init_governor(&governor);
+	uint64_t now_ns = 1000000000;
+	assert_int(1, drive_governor(&governor, GOVERNOR_OVER_LOAD, &now_ns, GOVERNOR_UP_NS));
+	assert_int(1, governor.level);
+	assert_int(1, governor.up_hold_ns == GOVERNOR_UP_NS);
+
+	// WHEN it keeps dropping straight back after regaining the level
+	uint64_t expected_ns = GOVERNOR_UP_NS;
+	for (int i=0; i < 8; i++) {
+		uint64_t start_ns = now_ns;
+		assert_int(1, drive_governor(&governor, 0.1, &now_ns, GOVERNOR_MAX_UP_NS * 2));
+		// THEN it waited at least as long as the hold before regaining it
+		assert_int(1, now_ns - start_ns >= expected_ns);
+		assert_int(0, governor.level);
+		assert_int(1, drive_governor(&governor, GOVERNOR_OVER_LOAD, &now_ns, GOVERNOR_UP_NS));
+		// AND the hold doubles each time, until it reaches GOVERNOR_MAX_UP_NS
+		expected_ns = expected_ns * 2 < GOVERNOR_MAX_UP_NS ? expected_ns * 2 : GOVERNOR_MAX_UP_NS;
+		assert_int(1, governor.up_hold_ns == expected_ns);
+	}
+	assert_int(1, governor.up_hold_ns == GOVERNOR_MAX_UP_NS);
+
+	// WHEN the level is regained and held for longer than GOVERNOR_UP_NS before it drops again
+	assert_int(1, drive_governor(&governor, 0.1, &now_ns, GOVERNOR_MAX_UP_NS * 2));
+	assert_int(0, drive_governor(&governor, 0.8, &now_ns, GOVERNOR_UP_NS * 2));
+	assert_int(1, drive_governor(&governor, GOVERNOR_OVER_LOAD, &now_ns, GOVERNOR_UP_NS));
+	// THEN the hold goes back to GOVERNOR_UP_NS
+	assert_int(1, governor.level);
+	assert_int(1, governor.up_hold_ns == GOVERNOR_UP_NS);
+}
+
+// The sliding DFT's bins against the DFT of the same window, oldest sample first
+static double sliding_dft_error(sliding_dft_t* sliding, const int16_t* samples, int end, complex_set_t* input, complex_set_t* expected) {
+	fill_complex_set(input, samples + end - sliding -> size, sliding -> size);
+	dft(input, expected);
+	// Only the displayed bins are tracked
+	complex_set_t actual = {.complex_numbers = input -> complex_numbers, .data_size = sliding -> bins};
+	for (int k=0; k < sliding -> bins; k++) actual.complex_numbers[k].complex_number = sliding -> values[k];
+	return relative_error(expected, &actual, sliding -> bins);
+}
+
+void test_sliding_dft_matches_dft() {
+	printf("=== Testing the sliding DFT matches the DFT of its window, before and after re-anchoring ===\n");
+	// GIVEN a sliding DFT and more samples than are slid between anchors
+	sliding_dft_t sliding;
+	assert_int(0, init_sliding_dft(&sliding, NUM_SAMPLES));
+	int count = SLIDING_DFT_ANCHOR_SAMPLES + 3000;
+	int16_t* samples = malloc(sizeof(int16_t) * count);
+	srand(50);
+	// Positive only, as fill_complex_set drops negative samples
+	for (int i=0; i < count; i++) samples[i] = (int16_t) (4000 + 3000 * sin(2 * M_PI * 1000 * i / 44100.0) + (rand() % 2000));
+	complex_set_t* input = NULL;
+	complex_set_t* expected = NULL;
+	malloc_complex_set(&input, NUM_SAMPLES, MAX_SAMPLE_RATE);
+	malloc_complex_set(&expected, NUM_SAMPLES, MAX_SAMPLE_RATE);
+
+	// WHEN it's slid a sample at a time up to just before an anchor
+	int end = SLIDING_DFT_ANCHOR_SAMPLES - 1;
+	for (int i=0; i < end; i++) slide_dft(&sliding, samples + i, 1);
+	// THEN its bins still match, drift and all
+	double drifted = sliding_dft_error(&sliding, samples, end, input, expected);
+	printf("Relative error after %d samples: %.1e\n", end, drifted);
+	assert_int(1, drifted <= ENGINE_MAX_RELATIVE_ERROR);
+
+	// WHEN it's slid on past the anchor in odd sized chunks
+	for (int i=end; i < count; i += 77) slide_dft(&sliding, samples + i, count - i < 77 ? count - i : 77);
+	// THEN it matches again
+	assert_int(1, sliding_dft_error(&sliding, samples, count, input, expected) <= ENGINE_MAX_RELATIVE_ERROR);
+	// AND it's published as the FFT path would, bins below nyquist doubled
+	sliding_dft_spectrum(&sliding, expected, MAX_SAMPLE_RATE);
+	assert_int(NUM_SAMPLES / 2, expected -> data_size);
+	assert_int(MAX_SAMPLE_RATE / 2, expected -> frequency);
+	assert_double(cabs(sliding.values[23]) * 2, expected -> complex_numbers[23].magnitude);
+
+	free_sliding_dft(&sliding);
+	free_complex_set(input);
+	free_complex_set(expected);
+	free(samples);
+}
+
+void test_trace_ring_wraps() {
+	printf("=== Testing the trace ring keeps the newest events once it wraps ===\n");
+	// GIVEN a trace with room for 5 events, rounded up to 8
+	char path[] = "/tmp/purses-test-trace-XXXXXX";
+	close(mkstemp(path));
+	assert_int(0, open_trace(path, 5));
+
+	// WHEN 3 frames of 4 events are traced on the analysis thread
+	trace_thread(TRACE_THREAD_ANALYSIS);
+	for (int frame=0; frame < 3; frame++) {
+		trace_frame(frame);
+		trace_begin(TRACE_FRAME);
+		trace_begin(TRACE_FFT);
+		trace_end(TRACE_FFT);
+		trace_end(TRACE_FRAME);
+	}
+	close_trace();
+
+	// THEN the file holds the header and the newest 8 of the 12 events, as trace2json reads it
+	FILE* file = fopen(path, "rb");
+	trace_header_t header;
+	trace_record_t records[8];
+	assert_int(1, fread(&header, sizeof(header), 1, file));
+	assert_int(8, fread(records, sizeof(trace_record_t), 8, file));
+	fclose(file);
+	unlink(path);
+	assert_int(TRACE_MAGIC, header.magic);
+	assert_int(8, header.capacity);
+	assert_int(12, atomic_load(&header.next_event));
+	const trace_stage_t stages[] = {TRACE_FRAME, TRACE_FFT, TRACE_FFT, TRACE_FRAME};
+	const char phases[] = {'B', 'B', 'E', 'E'};
+	uint64_t last_ns = 0;
+	for (int event=4; event < 12; event++) {
+		trace_record_t* record = &records[event % 8];
+		assert_int(event / 4, record -> frame);
+		assert_int(stages[event % 4], record -> stage);
+		assert_int(phases[event % 4], record -> phase);
+		assert_int(TRACE_THREAD_ANALYSIS, record -> thread);
+		// AND they're in order
+		assert_int(1, record -> timestamp_ns >= last_ns);
+		last_ns = record -> timestamp_ns;
+	}
+}
+
+#define SPECTROGRAM_TEST_SIZE 256
+#define SPECTROGRAM_TEST_STEP 128
+#define SPECTROGRAM_TEST_FRAMES 20
+// Centred on a bin, so it's the loudest in every frame
+#define SPECTROGRAM_TEST_BIN 16
+
+void test_spectrogram_batches() {
+	printf("=== Testing the offline spectrogram writes every frame in order across batches ===\n");
+	// GIVEN a WAV of a tone, long enough for 20 frames
+	int sample_count = SPECTROGRAM_TEST_STEP * (SPECTROGRAM_TEST_FRAMES - 1) + SPECTROGRAM_TEST_SIZE;
+	int16_t samples[sample_count];
+	for (int i=0; i < sample_count; i++) samples[i] = 12000 * sin(2 * M_PI * SPECTROGRAM_TEST_BIN * i / SPECTROGRAM_TEST_SIZE);
+	uint8_t header[WAV_HEADER_SIZE];
+	build_wav_header(header, MAX_SAMPLE_RATE, 1, sizeof(samples));
+	char path[] = "/tmp/purses-test-spectrogram-XXXXXX";
+	int fd = mkstemp(path);
+	assert_int(WAV_HEADER_SIZE, write(fd, header, WAV_HEADER_SIZE));
+	assert_int(sizeof(samples), write(fd, samples, sizeof(samples)));
+	close(fd);
+	replay_source_t recording;
+	assert_int(0, open_replay(&recording, path, false));
+	assert_int(SPECTROGRAM_TEST_FRAMES, spectrogram_frames(recording.sample_count, SPECTROGRAM_TEST_SIZE, SPECTROGRAM_TEST_STEP));
+
+	// WHEN it's analysed by 3 threads, 6 frames a batch, so the last batch is partial
+	spectrogram_options_t options = {SPECTROGRAM_TEST_SIZE, SPECTROGRAM_TEST_STEP, 3, 6, SPECTROGRAM_BINARY, find_fft_engine(SPECTROGRAM_DEFAULT_ENGINE)};
+	FILE* output = tmpfile();
+	FILE* image = tmpfile();
+	int threads_used = 0;
+	assert_int(0, write_spectrogram(recording.samples, recording.sample_count, recording.sample_rate, &options, output, image, &threads_used));
+	close_replay(&recording);
+	unlink(path);
+
+	// THEN there's a record for every frame, in order, each peaking at the tone
+	int bins = SPECTROGRAM_TEST_SIZE / 2;
+	assert_int(3, threads_used);
+	assert_int(SPECTROGRAM_TEST_FRAMES * frame_size(bins), ftell(output));
+	rewind(output);
+	uint8_t record[frame_size(bins)];
+	for (int frame=0; frame < SPECTROGRAM_TEST_FRAMES; frame++) {
+		assert_int(1, fread(record, sizeof(record), 1, output));
+		frame_header_t frame_header;
+		assert_int(0, decode_frame_header(record, sizeof(record), &frame_header));
+		assert_int(frame, frame_header.sequence);
+		assert_int(bins, frame_header.bin_count);
+		uint64_t offset_ns = (double) frame * SPECTROGRAM_TEST_STEP / MAX_SAMPLE_RATE * 1000000000;
+		assert_int(1, frame_header.timestamp_ns == offset_ns);
+		int loudest = 0;
+		for (int bin=1; bin < bins; bin++) {
+			if (decode_frame_magnitude(record, &frame_header, bin) > decode_frame_magnitude(record, &frame_header, loudest)) loudest = bin;
+		}
+		assert_int(SPECTROGRAM_TEST_BIN, loudest);
+	}
+	fclose(output);
+	// AND the image has a row per frame
+	char image_header[32];
+	int header_size = snprintf(image_header, sizeof(image_header), "P5\n%d %d\n255\n", bins, SPECTROGRAM_TEST_FRAMES);
+	assert_int(header_size + (SPECTROGRAM_TEST_FRAMES * bins), ftell(image));
+	fclose(image);
+}
+
+// Reads a whole file into memory, NULL if it couldn't be read
+static uint8_t* read_whole_file(const char* path, size_t* length) {
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) return NULL;
+	fseek(file, 0, SEEK_END);
+	*length = ftell(file);
+	rewind(file);
+	uint8_t* data = malloc(*length);
+	if (data != NULL && fread(data, 1, *length, file) != *length) {
+		free(data);
+		data = NULL;
+	}
+	fclose(file);
+	return data;
+}
+
+// The recorded samples count up, so each file can be checked to carry on from the last
+#define RECORDER_TEST_SAMPLES (RECORDER_CHUNK_COUNT * RECORDER_CHUNK_SAMPLES)
+#define RECORDER_TEST_OVERFLOW 1000
+#define RECORDER_TEST_MAX_BYTES 3000000
+
+void test_recorder_rotates_and_drops() {
+	printf("=== Testing the recorder rotates files at the limit and counts the samples it drops ===\n");
+	// GIVEN a recorder rotating files every 3MB
+	char directory[] = "/tmp/purses-test-recorder-XXXXXX";
+	assert_int(1, mkdtemp(directory) != NULL);
+	char path[64];
+	snprintf(path, sizeof(path), "%s/capture.wav", directory);
+	pcm_recorder_t recorder;
+	assert_int(0, start_recorder(&recorder, path, MAX_SAMPLE_RATE, RECORDER_TEST_MAX_BYTES, 0));
+
+	// WHEN more samples than the whole chunk pool holds are recorded at once
+	// The lock's held throughout, so the writer can't free any chunks until it's over
+	int count = RECORDER_TEST_SAMPLES + RECORDER_TEST_OVERFLOW;
+	int16_t* samples = malloc(sizeof(int16_t) * count);
+	for (int i=0; i < count; i++) samples[i] = i & INT16_MAX;
+	record_pcm(&recorder, samples, count);
+	stop_recorder(&recorder);
+
+	// THEN what didn't fit is dropped and counted
+	assert_int(RECORDER_TEST_OVERFLOW, recorder.dropped_samples);
+	assert_int(2, recorder.files_written);
+	assert_int(1, recorder.total_bytes == RECORDER_TEST_SAMPLES * sizeof(int16_t));
+	// AND the rest is split across two numbered files at the limit, each with its real size in the header
+	const size_t expected_bytes[] = {RECORDER_TEST_MAX_BYTES, (RECORDER_TEST_SAMPLES * sizeof(int16_t)) - RECORDER_TEST_MAX_BYTES};
+	int first_sample = 0;
+	for (int file=0; file < 2; file++) {
+		snprintf(path, sizeof(path), "%s/capture-%04d.wav", directory, file + 1);
+		size_t length = 0;
+		uint8_t* data = read_whole_file(path, &length);
+		assert_int(1, data != NULL);
+		wav_info_t info;
+		assert_int(0, parse_wav(data, length, &info));
+		assert_int(MAX_SAMPLE_RATE, info.sample_rate);
+		assert_int(expected_bytes[file], info.data_bytes);
+		// AND the samples carry on across the boundary
+		int16_t first;
+		int16_t last;
+		memcpy(&first, data + info.data_offset, sizeof(int16_t));
+		memcpy(&last, data + info.data_offset + info.data_bytes - sizeof(int16_t), sizeof(int16_t));
+		int samples_in_file = info.data_bytes / sizeof(int16_t);
+		assert_int(first_sample & INT16_MAX, first);
+		assert_int((first_sample + samples_in_file - 1) & INT16_MAX, last);
+		first_sample += samples_in_file;
+		free(data);
+		unlink(path);
+	}
+	free(samples);
+	rmdir(directory);
+}
+
 /**
 void generate_sine_10hz_44100hz() {
 	record_stream_data_t* sample_date = 0;
@@ -368,4 +1199,22 @@ int main(void) {
 	run_test(test_dft_1hz_8hz);
 	run_test(test_dft_wiki_example);
 	run_test(test_dft_wiki_example_ctfft);
+	run_test(test_reconnect_backoff);
+	run_test(test_history_ring);
+	run_test(test_frame_format_round_trip);
+	run_test(test_shm_ring);
+	run_test(test_subscription_parsing);
+	run_test(test_wav_header_round_trip);
+	run_test(test_replay_blocks);
+	run_test(test_latency_percentiles);
+	run_test(test_steady_state_allocations);
+	run_test(test_fft_engines_match_dft);
+	run_test(test_triple_buffer_handoff);
+	run_test(test_silence_gate);
+	run_test(test_quality_governor);
+	run_test(test_governor_backoff);
+	run_test(test_sliding_dft_matches_dft);
+	run_test(test_trace_ring_wraps);
+	run_test(test_spectrogram_batches);
+	run_test(test_recorder_rotates_and_drops);
 }
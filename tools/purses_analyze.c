@@ -0,0 +1,105 @@
+// Offline spectrogram of a recording, using the same FFT as purses itself
+// Splits a WAV/raw recording into overlapping Hann-windowed frames and spreads them across a pool of worker threads (see spectrogram.h)
+// Usage: purses-analyze [-n fft size] [-s step] [-j threads] [-e engine] [-f binary|csv] [-o output] [-i image.pgm] <recording>
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <shared.h>
+#include <replay.h>
+#include <spectrogram.h>
+#include <log.h>
+
+static void usage(const char* name) {
+	fprintf(stderr, "Usage: %s [-n fft size] [-s step] [-j threads] [-e engine] [-f binary|csv] [-o output] [-i image.pgm] <recording>\n", name);
+}
+
+int main(int argc, char** argv) {
+	int fft_size = NUM_SAMPLES;
+	int step = 0;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	spectrogram_format_t format = SPECTROGRAM_BINARY;
+	const fft_engine_t* engine = find_fft_engine(SPECTROGRAM_DEFAULT_ENGINE);
+	const char* output_path = NULL;
+	const char* image_path = NULL;
+	int option;
+	while ((option = getopt(argc, argv, "n:s:j:e:f:o:i:")) != -1) {
+		switch (option) {
+			case 'n': fft_size = atoi(optarg); break;
+			case 's': step = atoi(optarg); break;
+			case 'j': threads = atoi(optarg); break;
+			case 'e':
+				engine = find_fft_engine(optarg);
+				if (engine == NULL) {
+					fprintf(stderr, "Unknown FFT engine: %s\n", optarg);
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'f':
+				if (strcmp(optarg, "csv") == 0) format = SPECTROGRAM_CSV;
+				else if (strcmp(optarg, "binary") == 0) format = SPECTROGRAM_BINARY;
+				else {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'o': output_path = optarg; break;
+			case 'i': image_path = optarg; break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (fft_size < 2 || fft_size > SPECTROGRAM_MAX_FFT_SIZE || (fft_size & (fft_size - 1)) != 0) {
+		fprintf(stderr, "The FFT size must be a power of 2 up to %d\n", SPECTROGRAM_MAX_FFT_SIZE);
+		return 1;
+	}
+	// Half overlapping frames by default
+	if (step <= 0) step = fft_size / 2;
+	if (threads < 1) threads = 1;
+	// Only errors are of interest, and they go to purses.log as usual
+	set_log_level(LOG_ERROR);
+
+	replay_source_t recording;
+	if (open_replay(&recording, argv[optind], false) != 0) {
+		fprintf(stderr, "Couldn't read recording: %s\n", argv[optind]);
+		return 1;
+	}
+	FILE* output = NULL;
+	if (output_path == NULL || strcmp(output_path, "-") == 0) {
+		output = image_path == NULL || output_path != NULL ? stdout : NULL;
+	} else {
+		output = fopen(output_path, "wb");
+	}
+	FILE* image = image_path != NULL ? fopen(image_path, "wb") : NULL;
+	if ((output_path != NULL && output == NULL) || (image_path != NULL && image == NULL)) {
+		fprintf(stderr, "Couldn't open the output files\n");
+		close_replay(&recording);
+		return 1;
+	}
+
+	spectrogram_options_t options = {fft_size, step, threads, SPECTROGRAM_BATCH_FRAMES, format, engine};
+	unsigned long frames = spectrogram_frames(recording.sample_count, fft_size, step);
+	int threads_used = 0;
+	uint64_t start_ns = get_monotonic_ns();
+	int stat = write_spectrogram(recording.samples, recording.sample_count, recording.sample_rate, &options, output, image, &threads_used);
+	uint64_t elapsed_ns = get_monotonic_ns() - start_ns;
+	if (output != NULL && output != stdout && fclose(output) != 0) stat = 1;
+	if (image != NULL && fclose(image) != 0) stat = 1;
+	if (stat != 0) {
+		fprintf(stderr, "Failed to analyse the recording or write the results, see purses.log\n");
+	} else {
+		fprintf(stderr, "Analysed %lu frames of %d samples on %d threads with %s in %.2fs (%.0f frames/s)\n",
+			frames, fft_size, threads_used, engine -> name, elapsed_ns / 1e9, elapsed_ns > 0 ? frames / (elapsed_ns / 1e9) : 0);
+	}
+	close_replay(&recording);
+	return stat;
+}
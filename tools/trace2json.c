@@ -0,0 +1,81 @@
+// Converts a purses trace file (PURSES_TRACE) into Chrome trace event JSON
+// Open the output in chrome://tracing or https://ui.perfetto.dev to see each frame's stages on a timeline
+// Usage: trace2json <trace file> [output.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <trace/trace_format.h>
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <trace file> [output.json]\n", argv[0]);
+		return 1;
+	}
+	FILE* input = fopen(argv[1], "rb");
+	if (input == NULL) {
+		fprintf(stderr, "Couldn't open trace file: %s\n", argv[1]);
+		return 1;
+	}
+	trace_header_t header;
+	if (fread(&header, sizeof(header), 1, input) != 1 || header.magic != TRACE_MAGIC
+			|| header.version != TRACE_VERSION || header.record_size != sizeof(trace_record_t)) {
+		fprintf(stderr, "Not a purses trace file (or a different version): %s\n", argv[1]);
+		fclose(input);
+		return 1;
+	}
+	trace_record_t* records = malloc(sizeof(trace_record_t) * header.capacity);
+	if (records == NULL || fread(records, sizeof(trace_record_t), header.capacity, input) != header.capacity) {
+		fprintf(stderr, "Trace file is truncated: %s\n", argv[1]);
+		fclose(input);
+		free(records);
+		return 1;
+	}
+	fclose(input);
+
+	FILE* output = argc > 2 ? fopen(argv[2], "w") : stdout;
+	if (output == NULL) {
+		fprintf(stderr, "Couldn't open output: %s\n", argv[2]);
+		free(records);
+		return 1;
+	}
+
+	// Once the ring has wrapped, only the newest capacity events are left
+	uint64_t next_event = atomic_load(&header.next_event);
+	uint64_t first_event = next_event > header.capacity ? next_event - header.capacity : 0;
+	uint64_t start_ns = next_event > 0 ? records[first_event % header.capacity].timestamp_ns : 0;
+
+	fprintf(output, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (int thread=0; thread < TRACE_THREAD_COUNT; thread++) {
+		fprintf(output, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			thread > 0 ? ",\n" : "", thread, TRACE_THREAD_NAMES[thread]);
+	}
+	// How many of each thread's stages have begun and not yet ended
+	// Ends whose beginning was overwritten are dropped, or the viewer nests everything after them wrongly
+	unsigned long open_stages[TRACE_THREAD_COUNT][TRACE_STAGE_COUNT] = {{0}};
+	unsigned long written = 0;
+	unsigned long unmatched = 0;
+	for (uint64_t event=first_event; event < next_event; event++) {
+		trace_record_t* record = &records[event % header.capacity];
+		if (record -> stage >= TRACE_STAGE_COUNT || record -> thread >= TRACE_THREAD_COUNT) continue;
+		if (record -> phase != 'B' && record -> phase != 'E') continue;
+		unsigned long* open = &open_stages[record -> thread][record -> stage];
+		if (record -> phase == 'B') {
+			(*open)++;
+		} else if (*open > 0) {
+			(*open)--;
+		} else {
+			unmatched++;
+			continue;
+		}
+		// Timestamps are in microseconds
+		double timestamp_us = record -> timestamp_ns >= start_ns ? (record -> timestamp_ns - start_ns) / 1000.0 : 0;
+		fprintf(output, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"frame\":%u}}",
+			TRACE_STAGE_NAMES[record -> stage], record -> phase, timestamp_us, record -> thread, record -> frame);
+		written++;
+	}
+	fprintf(output, "\n]}\n");
+	if (output != stdout) fclose(output);
+	fprintf(stderr, "Converted %lu events (%lu were overwritten, %lu ends without a beginning dropped)\n", written, (unsigned long) first_event, unmatched);
+	free(records);
+	return 0;
+}